@@ -0,0 +1,40 @@
+#ifndef DEDUP_H
+#define DEDUP_H
+
+/*
+ * Drops packets already counted on another interface, e.g. a frame seen on a
+ * bridge and its member port, a bond and its slave, or a VLAN and its parent
+ *
+ * A packet's key is a hash of its length and the first DEDUP_HASH_BYTES from
+ * the network header on, after any VLAN tags, so the same packet gets the same
+ * key on every interface it crosses. Keys go in a Bloom filter that rotates
+ * every window: lookups check the current and previous window and the one
+ * after next is cleared ahead of time, so a duplicate is caught if it arrives
+ * within one to two windows. Bits are set with atomic ors so every capture
+ * thread shares one filter without a lock, at a fixed cost per packet.
+ *
+ * Identical packets within a window, e.g. IPv6 datagrams with the same
+ * payload, count once, and a false positive rate of about 1e-4 at 100k
+ * packets per window drops that share of unique packets.
+ */
+
+#include <sys/types.h>
+
+#define DEDUP_HASH_BYTES 64
+#define DEDUP_HASHES 4
+#define DEDUP_DEFAULT_BITS (1u << 22)
+#define DEDUP_DEFAULT_WINDOW_USEC 20000
+
+struct dedup {
+	u_int64_t *bits;			// 3 slots of `words` words
+	u_int32_t words;			// words per slot, a power of two
+	u_int64_t windowUsec;
+	u_int64_t epoch;			// current window, time / windowUsec
+};
+typedef struct dedup dedup;
+
+struct dedup *dedup_create(u_int32_t bits, u_int64_t windowUsec);
+void dedup_free(struct dedup *d);
+int dedup_seen(struct dedup *d, const u_char *frame, u_int32_t caplen, u_int32_t len, u_int64_t stampUsec);
+
+#endif
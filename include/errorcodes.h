@@ -16,5 +16,10 @@ typedef enum err {
 	ERR_IMMEDIATE,
 	ERR_BLEN,
 	ERR_ALLOC,
-	ERR_SOCKET
+	ERR_SOCKET,
+	ERR_KQUEUE,
+	ERR_DROPS,
+	ERR_NOIF,
+	ERR_PROC,
+	ERR_QUOTA
 } err;
\ No newline at end of file
@@ -3,6 +3,9 @@
 
 #include "minunit.h"
 #include "errorcodes.h"
+#include "netstats.h"
+#include "history.h"
+#include "netman.h"
 #include <fcntl.h> // open
 
 #include <sys/types.h>
@@ -17,6 +20,7 @@
 #include <pthread.h>
 
 #include <net/ethernet.h> // ether_header etc
+#include <arpa/inet.h> // ntohs
 #include <getopt.h>
 #include <signal.h> // for kill
 
@@ -24,6 +28,14 @@
 #include <net/if.h> // AF_LINK if_req etc
 
 #include <spawn.h> // posix_spawn
+#include <sys/wait.h> // waitpid
+#include <sys/event.h> // kqueue
+#include <poll.h> // poll
+#include <sys/mman.h> // mmap
+
+#include <mach/mach.h>
+#include <mach/thread_policy.h> // thread affinity tags
+#include <mach/vm_statistics.h> // superpages
 #include <stdbool.h>
 
 extern char **environ;
@@ -47,7 +59,10 @@ typedef enum COMMAND {
 	BYTES,
 	UP, 
 	DOWN,
-	MONITOR
+	MONITOR,
+	HISTORY,
+	QUOTA,
+	AGGREGATE
 } COMMAND;
 
 #define println(...) { \
@@ -90,26 +105,77 @@ typedef enum COMMAND {
 #define printDEBUG(...) {}
 #endif
 
-u_int64_t bytesRead;// total number of bytes read from the bpf
+extern int verbose_flag; 	// flag set by --verbose, --silent, --quite
 
-int verbose_flag; 	// flag set by --verbose, --silent, --quite
-int label_flag;   	// flag set by --label
+/**
+ * - returns: the monotonic clock in nanoseconds
+ */
+static inline u_int64_t monotonicNsec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u_int64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
 
-pthread_mutex_t thread_mutex;
-pthread_t threads[20];
+/**
+ * adds to a metric that other threads read, only its capture thread may call this
+ */
+static inline void metricAdd(u_int64_t *metric, u_int64_t value) {
+    __atomic_store_n(metric, *metric + value, __ATOMIC_RELAXED);
+}
 
-int threadCount();
+// stages of the packet processing pipeline, see `process_packets`; every
+// combination of the specialized ones has its own loop
+#define PIPELINE_DIRECTION 0x01     // tell sent from received by the interface's MAC
+#define PIPELINE_BUDGETS 0x02       // charge prefix budgets
+#define PIPELINE_TOP 0x04           // add to the top talker sketches
+#define PIPELINE_HISTOGRAMS 0x08    // record sizes, gaps and latency
+#define PIPELINE_SAMPLE 0x10        // scale up sampled IPv4 packets
+#define PIPELINE_DEDUP 0x20         // skip packets seen on another interface
+#define PIPELINE_SPECIALIZED 0x3f
+#define PIPELINE_DUMP 0x40          // print every packet, for --verbose
+
+// how long --busy-poll spins after the last packet by default
+#define BUSY_POLL_DEFAULT_USEC 500
+// the most `netman_set_busy_poll` spins before blocking
+#define BUSY_POLL_MAX_USEC 1000000
+// how often the monitor loop checks the limit while waiting on the command
+#define CMD_POLL_NSEC 1000000
+// how often an interface's counters are read once bpf can't keep up
+#define COUNTER_POLL_USEC 100000
+// instructions in the --sample filter
+#define SAMPLE_FILTER_LEN 9
+// the longest an idle capture thread waits before checking whether to stop
+#define CAPTURE_WAKE_MSEC 100
+// size of the superpages bpf buffers are backed by with --hugepages
+#define SUPERPAGE_SIZE (2 * 1024 * 1024)
+// how long `netman_set_aggregator` waits for the first grant
+#define LEASE_WAIT_MSEC 2000
+// sampling switches to exact counting once the estimate's upper bound, at SAMPLE_EXACT_Z
+// standard deviations, reaches this share of the limit
+#define SAMPLE_EXACT_SHARE 0.9
+#define SAMPLE_EXACT_Z 3.29
 
 void version();
 void usage();
 
+int parseBytes(const char *value, u_int64_t *bytes);
 pid_t runCmd(char *cmd);
-
-void* monitor(void *ifname);
+int watchCmd(pid_t pid);
+int cmdExited(int kq, pid_t pid, const struct timespec *timeout);
+int killGroup(pid_t pid);
+int killCmd(pid_t pid);
+
+void* monitor(void *arg);
+int set_thread_affinity(pthread_t thread, int tag);
+void *capture_alloc(size_t len, int hugepages);
+void capture_free(void *buf, size_t len, int hugepages);
 int open_dev_at(int start);
 int open_dev(void);
 int check_dlt(int fd, char *iface);
 int set_options(int fd, char *iface);
-int read_packets(int fd, char *iface);
+ssize_t spin_read(int fd, char *buf, size_t blen, u_int32_t spinUsec);
+int set_buffer_len(int fd, u_int32_t *blen);
+u_int sample_program(u_int32_t n, struct bpf_insn *insns);
+int set_sample_filter(int fd, u_int32_t n);
 
 #endif
\ No newline at end of file
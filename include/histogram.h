@@ -0,0 +1,51 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+/*
+ * Fixed size log-linear (HDR style) histograms
+ * Values below 2^(HIST_SUB_BITS + 1) get a bucket each, above that every
+ * power of two is split into 2^HIST_SUB_BITS buckets, so a bucket is at
+ * most 1/2^HIST_SUB_BITS (about 3%) wide relative to its values
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+
+#define HIST_SUB_BITS 5
+#define HIST_BUCKETS ((65 - HIST_SUB_BITS) << HIST_SUB_BITS)
+
+struct histogram {
+	u_int64_t count;
+	u_int64_t sum;
+	u_int64_t buckets[HIST_BUCKETS];
+};
+typedef struct histogram histogram;
+
+/**
+ * - returns: the bucket for a value, without branches
+ */
+static inline u_int32_t histogram_bucket(u_int64_t value) {
+	// or-ing in the first sub bucket bit keeps small values at shift 0
+	u_int32_t msb = 63 - __builtin_clzll(value | (1ull << HIST_SUB_BITS));
+	u_int32_t shift = msb - HIST_SUB_BITS;
+	return (shift << HIST_SUB_BITS) + (u_int32_t) (value >> shift);
+}
+
+/**
+ * Records a value, only one thread may record into a histogram
+ * Relaxed stores let other threads take snapshots while it records
+ */
+static inline void histogram_record(struct histogram *h, u_int64_t value) {
+	u_int64_t *bucket = &h->buckets[histogram_bucket(value)];
+	__atomic_store_n(bucket, *bucket + 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&h->count, h->count + 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&h->sum, h->sum + value, __ATOMIC_RELAXED);
+}
+
+u_int64_t histogram_lower(u_int32_t bucket);
+u_int64_t histogram_upper(u_int32_t bucket);
+void histogram_snapshot(const struct histogram *h, struct histogram *copy);
+u_int64_t histogram_percentile(const struct histogram *h, double percentile);
+void histogram_print(FILE *out, const char *name, const char *unit, const struct histogram *h);
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+/*
+ * An append-only file of byte deltas per series (interface or budget)
+ *
+ * The first HISTORY_BLOCK_SIZE bytes are the header and series names,
+ * then fixed size blocks follow. Each block starts with the time of its
+ * first tick, so the block headers are a sparse time index that a query
+ * binary searches. A tick is varint(seconds since the previous tick or
+ * the block start), varint(entries), then varint(series), varint(bytes)
+ * for each entry.
+ */
+
+#include <sys/types.h>
+#include <time.h>
+
+#define HISTORY_DEFAULT_PATH "/var/tmp/netman.history"
+#define HISTORY_MAGIC 0x4e4d4849 // "NMHI"
+#define HISTORY_VERSION 1
+#define HISTORY_BLOCK_SIZE 4096
+#define HISTORY_MAX_SERIES 64
+#define HISTORY_NAME_LEN 32
+#define HISTORY_DEFAULT_RESOLUTION 60
+
+struct history_header {
+	u_int32_t magic;
+	u_int32_t version;
+	u_int32_t blockSize;
+	u_int32_t resolution;		// seconds between ticks
+	u_int32_t seriesCount;
+	u_int32_t reserved;
+	char series[HISTORY_MAX_SERIES][HISTORY_NAME_LEN];
+};
+
+struct history_block {
+	u_int64_t start;			// time of the first tick
+	u_int32_t used;				// bytes of ticks after this header
+	u_int32_t ticks;
+};
+
+#define HISTORY_PAYLOAD (HISTORY_BLOCK_SIZE - sizeof(struct history_block))
+
+struct history {
+	int fd;
+	struct history_header header;
+	u_int64_t blockIndex;		// block being appended to
+	u_int64_t lastTick;			// time of the last tick written
+	struct history_block *block;	// in-memory copy of the block being appended to
+};
+typedef struct history history;
+
+/**
+ * Called by `history_query` with the bytes a series moved in the range
+ */
+typedef void (*history_total_cb)(const char *series, u_int64_t bytes, void *ctx);
+
+struct history *history_open(const char *path, u_int32_t resolution);
+void history_close(struct history *h);
+int history_series(struct history *h, const char *name);
+int history_append(struct history *h, time_t now, const int *series, const u_int64_t *bytes, int count);
+
+int history_query(const char *path, time_t since, time_t until, history_total_cb cb, void *ctx);
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef IFTABLE_H
+#define IFTABLE_H
+
+/*
+ * A contiguous table of interfaces, for callers that enumerate them repeatedly
+ *
+ * Each field is a column indexed by row, so a scan over names or counters
+ * walks one array. The columns share one arena and the kernel's list is read
+ * into a buffer kept with the table, so refreshing a steady set of interfaces
+ * allocates nothing. Rows are in the order the kernel lists the interfaces.
+ * One refresh gives every interface's flags, MTU and type, so status checks
+ * are memory reads instead of a socket and an ioctl each.
+ */
+
+#include <sys/sysctl.h>
+#include <net/route.h> // RTM_IFINFO2
+#include <net/if_dl.h> // sockaddr_dl
+
+struct iftable {
+	int count;					// rows filled by the last refresh
+	int cap;					// rows the arena holds
+	u_int64_t *ibytes;
+	u_int64_t *obytes;
+	int *flags;
+	u_int32_t *mtus;
+	u_short *indices;
+	u_char *types;
+	char (*names)[IFNAMSIZ];
+	char only[IFNAMSIZ];		// keep just this interface, empty for every one
+	void *arena;				// backs every column
+	char *buf;					// the kernel's list, reused between refreshes
+	size_t bufLen;
+};
+
+struct iftable *iftable_create(void);
+void iftable_free(struct iftable *t);
+int iftable_only(struct iftable *t, const char *name);
+int iftable_load(struct iftable *t, const char *buf, size_t len);
+int iftable_refresh(struct iftable *t);
+int iftable_find(const struct iftable *t, const char *name);
+void iftable_print(FILE *out, const struct iftable *t);
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+/*
+ * Runs the commands of a job file side by side under one capture session
+ *
+ * A job file has one job per line:
+ *     <name> <limit bytes> <rate bytes/s> <interfaces> <command>
+ * Interfaces are comma separated or 'all', a limit or rate of 0 is
+ * unlimited and the command is the rest of the line. Lines starting with
+ * '#' are comments.
+ *
+ * The session captures each interface once and every job counts the bytes
+ * on its interfaces while it runs. A job is killed at its limit. A job over
+ * its rate is stopped with SIGSTOP until its allowance, which grows at the
+ * rate up to one second's worth, pays for what it went over.
+ */
+
+#include "netman.h"
+
+#define JOBS_LINE_LEN 1024
+#define JOBS_INTERFACES_LEN 256
+// how often the scheduler checks limits and rates while no command exits
+#define JOBS_TICK_MSEC 10
+
+typedef enum job_state {
+	JOB_WAITING,
+	JOB_RUNNING,
+	JOB_DONE,				// the command exited
+	JOB_KILLED,				// killed at its limit or the session's
+	JOB_FAILED				// the command could not start
+} job_state;
+
+struct job {
+	char name[NETMAN_JOB_NAME_LEN];
+	u_int64_t limit;		// 0 is unlimited
+	u_int64_t rate;			// bytes per second, 0 is unlimited
+	char *interfaces;		// comma separated, or NULL for all
+	char *command;
+	int id;					// the session's counter for the job
+	job_state state;
+	pid_t pid;
+	int status;				// from waitpid once done
+	int paused;				// stopped for going over its rate
+	double allowance;		// bytes the job may still move at its rate
+	u_int64_t counted;		// its bytes at the last tick
+	u_int64_t startNsec;	// monotonic time it started
+	u_int64_t runNsec;		// how long it ran
+};
+
+int jobs_load(const char *path, struct job **out, int *line);
+void jobs_free(struct job *jobs, int count);
+int jobs_add(netman_session *session, struct job *jobs, int count);
+int jobs_run(netman_session *session, struct job *jobs, int count, int concurrency);
+
+#endif
@@ -0,0 +1,113 @@
+#ifndef LEASE_H
+#define LEASE_H
+
+/*
+ * One byte budget shared by netman instances on several hosts
+ *
+ * An aggregator (`netman aggregate`) holds each group's budget. Instances
+ * report the bytes they have used over UDP and are granted a slice of the
+ * budget, so they enforce it locally and only talk to the aggregator about
+ * once per slice. Every count in a message is a running total since the
+ * instance started, so a lost, repeated or reordered message changes
+ * nothing. A grant is a lease, an instance that can't renew it may still
+ * use what it was granted and no more. The aggregator keeps an unused
+ * slice reserved for LEASE_GRACE leases before giving it to others.
+ *
+ * Messages are fixed size and in network byte order.
+ */
+
+#include <sys/types.h>
+
+#define LEASE_MAGIC 0x4e4d4c53 // "NMLS"
+#define LEASE_VERSION 1
+#define LEASE_DEFAULT_PORT "7447"
+#define LEASE_DEFAULT_GROUP "netman"
+#define LEASE_GROUP_LEN 32
+#define LEASE_DEFAULT_MSEC 2000
+#define LEASE_GRACE 2
+#define LEASE_MIN_SLICE (1024 * 1024)
+#define LEASE_MAX_GROUPS 64
+#define LEASE_MAX_INSTANCES 256
+// how often an instance reports and checks for grants
+#define LEASE_REPORT_MSEC 50
+
+// message types
+#define LEASE_REQUEST 1
+#define LEASE_GRANT 2
+#define LEASE_RELEASE 3
+
+// grant flags
+#define LEASE_FINAL 0x1			// the group's budget ends at this grant
+#define LEASE_FULL 0x2			// the aggregator has no room for the instance
+
+struct lease_msg {
+	u_int32_t magic;
+	u_int16_t version;
+	u_int16_t type;
+	u_int64_t instance;			// random id of the instance
+	u_int32_t seq;				// a grant echoes the request's
+	u_int32_t flags;
+	char group[LEASE_GROUP_LEN];
+	u_int64_t used;				// bytes the instance used
+	u_int64_t want;				// bytes the instance asks for past `used`
+	u_int64_t granted;			// bytes the instance may use in all
+	u_int64_t total;			// bytes the group used
+	u_int64_t limit;			// the group's budget
+	u_int32_t leaseMsec;		// how long the grant holds
+	u_int32_t reserved;
+};
+
+struct lease_instance {
+	u_int64_t id;
+	int group;					// index into the groups, -1 for a free slot
+	u_int64_t used;
+	u_int64_t granted;
+	u_int64_t expires;			// monotonic nanoseconds the grant's reservation ends
+};
+
+struct lease_group {
+	char name[LEASE_GROUP_LEN];
+	u_int64_t retired;			// bytes used by instances that released or were evicted
+};
+
+struct lease_server {
+	int fd;
+	u_int64_t limit;			// bytes per group
+	u_int32_t leaseMsec;
+	struct lease_group groups[LEASE_MAX_GROUPS];
+	u_int32_t groupCount;
+	struct lease_instance instances[LEASE_MAX_INSTANCES];
+};
+
+struct lease_client {
+	int fd;
+	u_int64_t id;
+	char group[LEASE_GROUP_LEN];
+	u_int32_t seq;				// of the last request sent
+	u_int32_t grantSeq;			// of the newest grant applied
+	u_int64_t granted;			// bytes that may be used in all, read by the capture threads
+	int final;					// no larger grant is coming, the group is used up or the lease ran out
+	u_int64_t total;			// the group's bytes at the last grant
+	u_int64_t limit;
+	u_int32_t leaseMsec;
+	u_int64_t grantNsec;		// monotonic time of the last grant
+	u_int64_t sentNsec;			// monotonic time of the last request
+	u_int64_t sentUsed;			// `used` in the last request
+	u_int64_t slice;			// the last slice asked for
+};
+
+// aggregator
+struct lease_server *lease_server_create(const char *port, u_int64_t limit, u_int32_t leaseMsec);
+void lease_server_free(struct lease_server *s);
+int lease_server_port(struct lease_server *s);
+int lease_server_serve(struct lease_server *s, int timeoutMsec);
+u_int64_t lease_server_total(struct lease_server *s, const char *group);
+
+// instance
+struct lease_client *lease_client_create(const char *host, const char *port, const char *group);
+void lease_client_free(struct lease_client *c);
+int lease_client_wait(struct lease_client *c, u_int64_t used, int timeoutMsec);
+int lease_client_tick(struct lease_client *c, u_int64_t used);
+int lease_client_release(struct lease_client *c, u_int64_t used);
+
+#endif
@@ -3,6 +3,7 @@
 
 #include <netinet/in.h> // IPPROTO_TCP
 #include <ifaddrs.h>
+#include "iftable.h"
 
 struct interface {
 	char *name;
@@ -13,6 +14,7 @@ struct interface {
 typedef struct interface interface;
 
 void interfaces(list **interfaces);
+void interfacesFrom(struct ifaddrs *ifap, list **interfaces);
 void freeInterfaces(list **interfaces);
 
 int turnOffInterfaces(list *interfaces);
@@ -21,9 +23,12 @@ int set_if_up(char *ifname, short flags);
 int set_up(struct interface *i);
 int set_if_down(char *ifname, short flags);
 int set_down(struct interface *i);
+int setInterfacesUp(const struct iftable *t, int up);
 
 int getInterfaceStatus(char *interface);
 int isInterfaceUp(char *interface);
+int interfaceBytes(char *ifname, u_long *ibytes, u_long *obytes);
+int interfaceMAC(char *ifname, u_int8_t *mac);
 
 int loopInterfaces(list *interfaces, int (*f)(struct interface *));
 int print(struct interface *i);
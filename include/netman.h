@@ -0,0 +1,119 @@
+#ifndef NETMAN_H
+#define NETMAN_H
+
+/*
+ * libnetman: capture and budget enforcement without the netman CLI
+ *
+ * A session owns its capture threads and counters, so several sessions can
+ * run side by side in one process. Functions return 0 (or a count) on
+ * success and a negative error from errorcodes.h otherwise.
+ *
+ * Embedders only need this header, the headers it includes and libnetman.a
+ */
+
+#include <sys/types.h>
+#include "netstats.h"
+#include "histogram.h"
+#include "sketch.h"
+#include "prefix.h"
+#include "dedup.h"
+#include "procsock.h"
+#include "quota.h"
+#include "lease.h"
+
+// which addresses `netman_top` ranks
+#define NETMAN_TOP_MAC 0
+#define NETMAN_TOP_IP 1
+
+// the sparsest 1 in N sampling `netman_set_sample` takes
+#define NETMAN_SAMPLE_MAX 65536
+
+// the longest job name `netman_add_job` takes, with its terminator
+#define NETMAN_JOB_NAME_LEN 32
+
+typedef struct netman_session netman_session;
+
+/**
+ * Called once, from a capture thread or the socket poller, when a session's bytes reach its limit
+ */
+typedef void (*netman_limit_cb)(netman_session *session, u_int64_t bytes, void *ctx);
+
+/**
+ * What a capture thread has done and what it cost, see `netman_stats`
+ */
+struct netman_capture_stats {
+    char name[16];
+    u_int64_t packets;
+    u_int64_t bytes;
+    u_int64_t batches;          // reads that returned packets
+    u_int64_t readNsec;         // time in read, including waiting for packets
+    u_int64_t processNsec;      // time handling what read returned
+    u_int64_t cpuNsec;          // thread CPU time, user and system
+    u_int64_t drops;            // packets the kernel dropped
+    u_int64_t duplicates;       // packets skipped as already counted on another interface
+    u_int64_t wallNsec;         // time since the capture started
+};
+
+/**
+ * A session's byte and packet totals with 95% confidence intervals, see `netman_estimate`
+ * Without sampling the bounds equal the totals
+ */
+struct netman_estimate {
+    u_int32_t sampleRate;       // 1 in N IPv4 packets were counted, 0 without sampling
+    int exact;                  // counting switched to exact near the limit
+    u_int64_t bytes;
+    u_int64_t bytesLow;
+    u_int64_t bytesHigh;
+    u_int64_t packets;
+    u_int64_t packetsLow;
+    u_int64_t packetsHigh;
+};
+
+netman_session *netman_open(void);
+void netman_close(netman_session *session);
+
+int netman_set_buffer_max(netman_session *session, u_int32_t bytes);
+int netman_set_hugepages(netman_session *session, int enable);
+int netman_set_busy_poll(netman_session *session, u_int32_t spinUsec);
+int netman_set_shm(netman_session *session, const char *name);
+struct netstats_entry *netman_shm_budget(netman_session *session, const char *name, u_int64_t limit);
+int netman_set_histograms(netman_session *session, int enable);
+int netman_set_top(netman_session *session, int k);
+int netman_set_dedup(netman_session *session, u_int64_t windowUsec);
+int netman_set_sample(netman_session *session, u_int32_t n);
+int netman_set_budgets(netman_session *session, const char *path);
+int netman_set_history(netman_session *session, const char *path, u_int32_t resolution, const char *name);
+int netman_add_job(netman_session *session, const char *name, u_int64_t limit, const char *interfaces);
+int netman_set_quota(netman_session *session, const char *path, const char *name);
+int netman_set_aggregator(netman_session *session, const char *host, const char *port, const char *group);
+
+int netman_capture(netman_session *session, const char *ifname, int affinityTag);
+int netman_capture_count(netman_session *session);
+int netman_poll_sockets(netman_session *session, pid_t pgid, u_int32_t intervalMsec);
+
+u_int64_t netman_bytes(netman_session *session);
+u_int64_t netman_drops(netman_session *session);
+int netman_direction_bytes(netman_session *session, u_int64_t *rx, u_int64_t *tx);
+int netman_histogram_snapshot(netman_session *session, const char *ifname,
+                              struct histogram *sizes, struct histogram *gaps);
+int netman_latency_snapshot(netman_session *session, const char *ifname, struct histogram *latency);
+int netman_stats(netman_session *session, struct netman_capture_stats *out, int max);
+int netman_estimate(netman_session *session, struct netman_estimate *out);
+int netman_top(netman_session *session, int by, struct sketch_entry *out, int max, u_int64_t *error);
+
+int netman_budget_count(netman_session *session);
+int netman_budget(netman_session *session, int index, struct prefix_budget *out);
+int netman_quota(netman_session *session, struct quota_entry *out);
+u_int64_t netman_group_bytes(netman_session *session, u_int64_t *limit);
+
+int netman_jobs_watch(netman_session *session, const char *ifname);
+int netman_job_running(netman_session *session, int job, int running);
+u_int64_t netman_job_bytes(netman_session *session, int job);
+int netman_job_reached(netman_session *session, int job);
+
+int netman_set_limit(netman_session *session, u_int64_t limit);
+int netman_set_direction_limits(netman_session *session, u_int64_t rx, u_int64_t tx);
+int netman_limit_reached(netman_session *session);
+int netman_on_limit(netman_session *session, netman_limit_cb cb, void *ctx);
+
+#endif
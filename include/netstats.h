@@ -0,0 +1,81 @@
+#ifndef NETSTATS_H
+#define NETSTATS_H
+
+/*
+ * A shared memory segment of netman's live counters
+ * netman is the only writer, every entry is guarded by its own seqlock so
+ * readers take consistent snapshots without syscalls or locks
+ *
+ * This header is self contained so readers only need it and libnetstats.a
+ */
+
+#include <sys/types.h>
+
+#define NETSTATS_DEFAULT_NAME "/netman.stats"
+#define NETSTATS_MAGIC 0x4e4d5354 // "NMST"
+#define NETSTATS_VERSION 1
+#define NETSTATS_MAX_INTERFACES 20
+#define NETSTATS_MAX_BUDGETS 16
+#define NETSTATS_NAME_LEN 16
+
+/**
+ * One seqlock guarded record, sized to a cache line so writers on
+ * different threads never share one
+ * For interfaces `bytes`, `packets` and `drops` are what was captured,
+ * for budgets `bytes` is what was used of `limit` (0 is unlimited)
+ */
+struct netstats_entry {
+	u_int32_t seq;			// odd while being written
+	u_int32_t active;
+	char name[NETSTATS_NAME_LEN];
+	u_int64_t bytes;
+	u_int64_t packets;
+	u_int64_t drops;
+	u_int64_t limit;
+	u_int64_t updated;		// CLOCK_REALTIME in nanoseconds
+};
+typedef struct netstats_entry netstats_entry;
+
+struct netstats_header {
+	u_int32_t magic;
+	u_int16_t version;
+	u_int16_t entrySize;
+	u_int32_t interfaceCount;
+	u_int32_t budgetCount;
+	u_int64_t pid;
+	u_int64_t started;		// CLOCK_REALTIME in nanoseconds
+	u_int8_t reserved[32];
+};
+
+/**
+ * The fixed layout of the segment, changing it bumps NETSTATS_VERSION
+ */
+struct netstats_segment {
+	struct netstats_header header;
+	struct netstats_entry interfaces[NETSTATS_MAX_INTERFACES];
+	struct netstats_entry budgets[NETSTATS_MAX_BUDGETS];
+};
+typedef struct netstats_segment netstats_segment;
+
+struct netstats_snapshot {
+	u_int32_t interfaceCount;
+	u_int32_t budgetCount;
+	struct netstats_entry interfaces[NETSTATS_MAX_INTERFACES];
+	struct netstats_entry budgets[NETSTATS_MAX_BUDGETS];
+};
+
+// writer
+struct netstats_segment *netstats_create(const char *name);
+void netstats_destroy(struct netstats_segment *seg, const char *name);
+struct netstats_entry *netstats_add_interface(struct netstats_segment *seg, const char *name);
+struct netstats_entry *netstats_add_budget(struct netstats_segment *seg, const char *name, u_int64_t limit);
+void netstats_publish(struct netstats_entry *e, u_int64_t bytes, u_int64_t packets, u_int64_t drops);
+void netstats_add(struct netstats_entry *e, u_int64_t bytes, u_int64_t packets, u_int64_t drops);
+
+// reader
+const struct netstats_segment *netstats_open(const char *name);
+void netstats_close(const struct netstats_segment *seg);
+int netstats_read(const struct netstats_entry *e, struct netstats_entry *copy);
+int netstats_snapshot(const struct netstats_segment *seg, struct netstats_snapshot *snap);
+
+#endif
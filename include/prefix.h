@@ -0,0 +1,83 @@
+#ifndef PREFIX_H
+#define PREFIX_H
+
+/*
+ * Byte budgets keyed by sets of IPv4 and IPv6 prefixes
+ *
+ * Prefixes are held in a multibit trie with a stride of 8 bits and leaf
+ * pushing (controlled prefix expansion): every node is 256 entries and each
+ * entry is either a budget or a child node, so a lookup is one indexed load
+ * per address byte that is still ambiguous, at most 4 for IPv4 and 16 for
+ * IPv6, with no backtracking. Prefixes are sorted shortest first before they
+ * are inserted so a longer prefix always overwrites the entries it covers.
+ *
+ * A budget file has one prefix per line:
+ *     <budget> <limit bytes> <cidr>
+ * Lines with the same budget add prefixes to it, a limit of 0 only counts.
+ * '#' starts a comment.
+ */
+
+#include <sys/types.h>
+
+#define PREFIX_NAME_LEN 32
+#define PREFIX_CHILD 0x80000000u	// set on an entry that points at a child node
+
+struct prefix_budget {
+	char name[PREFIX_NAME_LEN];
+	u_int64_t limit;			// 0 is unlimited
+	u_int64_t bytes;			// updated atomically by the capture threads
+	int reached;
+};
+
+struct prefix_trie {
+	u_int32_t (*nodes)[256];	// node 0 is the root, entries are 0, budget + 1, or PREFIX_CHILD | node
+	u_int32_t count;
+	u_int32_t cap;
+};
+
+struct prefix_pending {
+	u_int8_t addr[16];
+	u_int8_t len;				// prefix length in bits
+	u_int8_t family;			// 4 or 6
+	u_int32_t budget;
+};
+
+struct prefix_table {
+	struct prefix_trie v4;
+	struct prefix_trie v6;
+	struct prefix_budget *budgets;
+	u_int32_t budgetCount;
+	u_int32_t budgetCap;
+	struct prefix_pending *pending;	// added but not yet built into the tries
+	u_int32_t pendingCount;
+	u_int32_t pendingCap;
+	u_int32_t prefixCount;
+};
+typedef struct prefix_table prefix_table;
+
+/**
+ * Finds the budget of the longest prefix holding an address
+ * - parameter t: the family's trie
+ * - parameter addr: the address in network order
+ * - parameter len: bytes in the address, 4 or 16
+ * - returns: the budget index, or -1 if no prefix holds the address
+ */
+static inline int prefix_lookup(const struct prefix_trie *t, const u_int8_t *addr, int len) {
+	if(t->count == 0) return -1;
+
+	const u_int32_t *node = t->nodes[0];
+	for(int i = 0; i < len; i++) {
+		u_int32_t entry = node[addr[i]];
+		if((entry & PREFIX_CHILD) == 0) return (int) entry - 1;
+		node = t->nodes[entry & ~PREFIX_CHILD];
+	}
+	return -1;
+}
+
+struct prefix_table *prefix_create(void);
+void prefix_free(struct prefix_table *table);
+int prefix_add(struct prefix_table *table, const char *budget, u_int64_t limit, const char *cidr);
+int prefix_build(struct prefix_table *table);
+int prefix_load(struct prefix_table *table, const char *path, int *line);
+
+#endif
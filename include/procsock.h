@@ -0,0 +1,54 @@
+#ifndef PROCSOCK_H
+#define PROCSOCK_H
+
+/*
+ * Counts the bytes moved by the TCP and UDP sockets of one process group,
+ * without capturing packets
+ *
+ * Each poll reads every inet socket from the `net.inet.tcp.pcblist_n` and
+ * `net.inet.udp.pcblist_n` sysctls, the same tables netstat reads. A socket's
+ * record carries the pid that last used it and its lifetime rx/tx byte
+ * counters, so a socket belongs to the group if that pid does, and the group's
+ * bytes are the sum of each socket's growth since the previous poll.
+ *
+ * Polls are incremental: the group's pids are a sorted array searched per
+ * socket, and its sockets are kept in a hash keyed by kernel handle and
+ * generation with their last counters. A poll costs one pass over the records
+ * and a hash probe per matching socket, with no syscall per socket, so a
+ * command with thousands of sockets stays cheap. Bytes a socket moves between
+ * its last poll and its close are missed.
+ */
+
+#include <sys/types.h>
+
+#define PROCSOCK_DEFAULT_INTERVAL_MSEC 100
+
+struct procsock_entry {
+	u_int64_t so;				// kernel socket handle, 0 is an empty slot
+	u_int64_t gen;				// socket generation, tells a reused handle apart
+	u_int64_t rxbytes;			// lifetime counters at the last poll
+	u_int64_t txbytes;
+	u_int32_t seen;				// the poll that last saw the socket
+};
+
+struct procsock {
+	pid_t pgid;
+	pid_t *pids;				// the group's pids, sorted
+	int pidCount;
+	int pidCap;
+	struct procsock_entry *sockets;	// open addressed on so ^ gen
+	u_int32_t socketCap;		// a power of two
+	u_int32_t socketCount;
+	u_int32_t polls;
+	char *buf;					// sysctl buffer, reused between polls
+	size_t bufLen;
+	u_int64_t rxbytes;			// totals over every poll
+	u_int64_t txbytes;
+};
+typedef struct procsock procsock;
+
+struct procsock *procsock_create(pid_t pgid);
+void procsock_free(struct procsock *p);
+int procsock_poll(struct procsock *p, u_int64_t *rx, u_int64_t *tx);
+
+#endif
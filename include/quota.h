@@ -0,0 +1,67 @@
+#ifndef QUOTA_H
+#define QUOTA_H
+
+/*
+ * Named byte quotas that outlive a run, e.g. a job's daily allowance
+ *
+ * The quotas live in a small file that every netman run maps shared, so
+ * runs charge the same counters with atomic adds and a run that crashes
+ * loses at most what it had not flushed yet. A quota with a period starts
+ * over at each multiple of the period since the epoch, so daily quotas
+ * start over at midnight UTC.
+ */
+
+#include <sys/types.h>
+#include <time.h>
+
+#define QUOTA_DEFAULT_PATH "/var/tmp/netman.quota"
+#define QUOTA_MAGIC 0x4e4d5141 // "NMQA"
+#define QUOTA_VERSION 1
+#define QUOTA_MAX_ENTRIES 64
+#define QUOTA_NAME_LEN 32
+#define QUOTA_DAILY 86400
+// how often a session charges its bytes to its quota
+#define QUOTA_FLUSH_MSEC 100
+// how often a session writes the quota file to disk
+#define QUOTA_SYNC_SEC 5
+
+struct quota_entry {
+	char name[QUOTA_NAME_LEN];
+	u_int64_t limit;			// bytes per period, 0 is unlimited
+	u_int64_t used;				// bytes used in the current period
+	u_int64_t periodStart;		// seconds since the epoch the current period started
+	u_int32_t period;			// seconds, 0 never starts over
+	u_int32_t reserved;
+};
+
+struct quota_header {
+	u_int32_t magic;
+	u_int32_t version;
+	u_int32_t entrySize;
+	u_int32_t count;
+	u_int8_t reserved[48];
+};
+
+/**
+ * The fixed layout of the file, changing it bumps QUOTA_VERSION
+ */
+struct quota_file {
+	struct quota_header header;
+	struct quota_entry entries[QUOTA_MAX_ENTRIES];
+};
+
+struct quota {
+	int fd;
+	struct quota_file *file;	// the mapped file
+};
+typedef struct quota quota;
+
+struct quota *quota_open(const char *path);
+void quota_close(struct quota *q);
+int quota_sync(struct quota *q);
+int quota_find(struct quota *q, const char *name);
+int quota_define(struct quota *q, const char *name, u_int64_t limit, u_int32_t period);
+u_int64_t quota_charge(struct quota *q, int index, u_int64_t bytes, time_t now);
+int quota_get(struct quota *q, int index, time_t now, struct quota_entry *out);
+
+#endif
@@ -0,0 +1,158 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+/*
+ * The state behind a `netman_session` handle and its capture threads
+ *
+ * Private to libnetman: the CLI and embedders only get the opaque handle
+ * and the calls in netman.h.
+ */
+
+#include "general.h"
+
+/**
+ * Bytes counted for one job while it runs, see `netman_add_job`
+ */
+struct job_counter {
+    char name[NETMAN_JOB_NAME_LEN];
+    char *interfaces;               // comma separated, or NULL for every interface
+    u_int64_t limit;                // 0 is unlimited
+    u_int64_t bytes;                // updated atomically by the capture threads
+    int running;
+    int reached;
+};
+
+// a capture thread's cost counters for --stats, only the capture thread writes them
+struct capture_metrics {
+    u_int64_t packets;
+    u_int64_t bytes;
+    u_int64_t batches;              // reads that returned packets
+    u_int64_t readNsec;             // time in read, including waiting for packets
+    u_int64_t processNsec;          // time handling what read returned
+    u_int64_t cpuNsec;              // thread CPU time, sampled about once a second
+    u_int64_t drops;
+    u_int64_t duplicates;           // packets skipped as already counted on another interface
+};
+
+/**
+ * One interface being captured by a session, owned by its thread
+ */
+struct capture {
+    struct netman_session *session;
+    char name[IFNAMSIZ];
+    pthread_t thread;
+    int running;                    // cleared by the thread when it stops
+    int stop;                       // set by `netman_close`, the thread stops within CAPTURE_WAKE_MSEC
+    int fd;                         // open bpf, or -1
+    u_int32_t bufferMax;            // the session's `bufferMax`, lowered to what the kernel allows
+    struct netstats_entry *stats;   // shared memory entry, or NULL
+    struct histogram *sizes;        // packet sizes in bytes, or NULL
+    struct histogram *gaps;         // packet inter-arrival times in usec, or NULL
+    struct histogram *latency;      // usec from a packet's kernel timestamp to its read, or NULL
+    u_int64_t readUsec;             // wall clock usec the last read returned, for `latency`
+    u_int64_t bytes;                // bytes counted on this interface
+    u_int64_t historyBytes;         // `bytes` at the last history tick
+    int historySeries;              // history series id, or -1
+    struct sketch *macs;            // heavy hitters by MAC address, or NULL
+    struct sketch *ips;             // heavy hitters by IP address, or NULL
+    pthread_mutex_t sketchMutex;    // held by the capture thread for each read
+    u_int8_t mac[ETHER_ADDR_LEN];   // the interface's address, tells sent from received
+    int hasMac;
+    u_int64_t *prefixBytes;         // bytes per prefix budget in the current read, or NULL
+    u_int32_t *touched;             // budgets with bytes in prefixBytes
+    u_int32_t touchedCount;
+    struct capture_metrics metrics;
+    u_int64_t startNsec;            // monotonic time the capture started
+    u_int32_t sample;               // the bpf passes 1 in this many IPv4 packets, 1 for all
+    u_int32_t *jobs;                // jobs counting this interface, or NULL
+    u_int32_t jobCount;
+    u_int64_t rxBytes;              // `bytes` received and sent, this capture's share of the
+    u_int64_t txBytes;              // session's direction counters
+};
+
+/**
+ * The state behind a `netman_session` handle, see netman.h
+ */
+struct netman_session {
+    u_int64_t bytes;                // total number of bytes read from the bpfs
+    u_int64_t drops;                // packets the kernel dropped across all bpfs
+    u_int64_t limit;                // byte limit, 0 is unlimited
+    int limitReached;
+    u_int64_t rxBytes;              // bytes received, of `bytes`
+    u_int64_t txBytes;              // bytes sent, of `bytes`
+    u_int64_t rxLimit;              // received byte limit, 0 is unlimited
+    int directions;                 // tell received from sent, set with either limit
+    u_int64_t txLimit;              // sent byte limit, 0 is unlimited
+    netman_limit_cb onLimit;
+    void *onLimitCtx;
+
+    u_int32_t bufferMax;            // ceiling for growing a bpf buffer
+    int hugepages;                  // back capture buffers with superpages
+    u_int32_t busyPollUsec;         // spin on reads this long before blocking, 0 to block
+    int histograms;                 // keep size and inter-arrival histograms
+    int topK;                       // heavy hitters to track per capture, 0 for none
+    struct prefix_table *prefixes;  // per-prefix budgets, or NULL
+    struct dedup *dedup;            // cross-interface duplicate filter, or NULL
+    u_int32_t sampleRate;           // 1 in N IPv4 packets are counted and scaled by N, 0 for exact
+    u_int32_t sample;               // the rate captures should filter at, 1 once counting is exact
+    u_int64_t samplePackets;        // IPv4 packets counted while sampling
+    u_int64_t sampleSquares;        // sum of their squared sizes, for the variance
+    struct netstats_segment *stats; // live counters, or NULL
+    char *statsName;
+
+    struct history *history;        // byte history file, or NULL
+    u_int32_t historyResolution;    // seconds between history ticks
+    int historySeries;              // history series id of the session's total
+    u_int64_t historyBytes;         // `bytes` at the last history tick
+    int historyStop;                // set to stop the recorder, guarded by historyMutex
+    pthread_t historyThread;
+    pthread_mutex_t historyMutex;
+    pthread_cond_t historyCond;
+
+    struct procsock *sockets;       // the command's sockets, polled instead of captured, or NULL
+    u_int32_t socketsInterval;      // milliseconds between socket polls
+    int socketsStop;                // set to stop the poller, guarded by socketsMutex
+    pthread_t socketsThread;
+    pthread_mutex_t socketsMutex;
+    pthread_cond_t socketsCond;
+
+    struct quota *quota;            // persistent quota charged with the session's bytes, or NULL
+    int quotaIndex;
+    u_int64_t quotaBytes;           // `bytes` at the last flush
+    int quotaStop;                  // set to stop the flusher, guarded by quotaMutex
+    pthread_t quotaThread;
+    pthread_mutex_t quotaMutex;
+    pthread_cond_t quotaCond;
+
+    struct lease_client *lease;     // slices of a group budget from an aggregator, or NULL
+    int leaseStop;                  // set to stop the reporter, guarded by leaseMutex
+    pthread_t leaseThread;
+    pthread_mutex_t leaseMutex;
+    pthread_cond_t leaseCond;
+
+    struct job_counter *jobs;       // per job counters, or NULL
+    int jobCount;
+
+    pthread_mutex_t mutex;          // guards captures
+    struct capture **captures;
+    int captureCount;
+    int captureCap;
+};
+
+void session_count(netman_session *session, u_int64_t bytes);
+struct capture *capture_create(struct netman_session *session, const char *ifname);
+void capture_destroy(struct capture *c);
+void capture_count(struct capture *c, u_int64_t bytes);
+void prefix_count(struct capture *c);
+void sample_count(struct capture *c, u_int64_t packets, u_int64_t squares);
+void direction_count(struct netman_session *session, struct capture *c, u_int64_t rx, u_int64_t tx);
+
+int start_monitor(struct capture *c, int tag);
+u_int32_t next_buffer_len(struct capture *c, u_int32_t asked, u_int32_t got);
+u_int32_t pipeline_stages(struct capture *c);
+struct bpf_hdr *process_packets(struct capture *c, char *buf, ssize_t n,
+                                u_int64_t *packets, u_int64_t *bytes, u_int64_t *lastStamp);
+int read_packets(int fd, struct capture *c);
+int poll_counters(struct capture *c);
+
+#endif
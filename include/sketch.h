@@ -0,0 +1,59 @@
+#ifndef SKETCH_H
+#define SKETCH_H
+
+/*
+ * Count-Min sketch with a small top-k heap for finding heavy hitters
+ *
+ * Memory is fixed at creation, `depth` rows of `width` counters plus `k`
+ * heap entries, however many keys are added. An estimate never undercounts,
+ * and overcounts by more than e / width * total with probability at most
+ * e^-depth. Not thread safe, callers lock around a sketch.
+ */
+
+#include <sys/types.h>
+
+#define SKETCH_DEFAULT_WIDTH 2048
+#define SKETCH_DEFAULT_DEPTH 4
+#define SKETCH_DEFAULT_K 10
+#define SKETCH_MAX_K 64
+
+enum sketch_key_type {
+	SKETCH_MAC = 1,
+	SKETCH_IPV4,
+	SKETCH_IPV6
+};
+
+struct sketch_key {
+	u_int8_t type;				// sketch_key_type
+	u_int8_t len;				// bytes of addr in use
+	u_int8_t addr[16];
+};
+
+struct sketch_entry {
+	struct sketch_key key;
+	u_int64_t count;
+};
+
+struct sketch {
+	u_int32_t width;			// counters per row, a power of two
+	u_int32_t depth;			// rows
+	u_int32_t k;				// heap capacity
+	u_int32_t size;				// heap entries in use
+	u_int64_t total;			// everything added
+	u_int64_t *counts;			// depth * width counters
+	struct sketch_entry *top;	// min heap on count
+};
+typedef struct sketch sketch;
+
+struct sketch *sketch_create(u_int32_t width, u_int32_t depth, u_int32_t k);
+void sketch_free(struct sketch *s);
+void sketch_add(struct sketch *s, const struct sketch_key *key, u_int64_t count);
+u_int64_t sketch_estimate(const struct sketch *s, const struct sketch_key *key);
+void sketch_offer(struct sketch *s, const struct sketch_key *key);
+int sketch_merge(struct sketch *dst, const struct sketch *src);
+int sketch_top(const struct sketch *s, struct sketch_entry *out, int max);
+u_int64_t sketch_error(const struct sketch *s);
+double sketch_confidence(const struct sketch *s);
+char *sketch_key_string(const struct sketch_key *key, char *buf, size_t len);
+
+#endif
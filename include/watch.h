@@ -0,0 +1,57 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+/*
+ * Byte deltas and rates of interfaces between samples, for `bytes --watch`
+ *
+ * Counters are the kernel's 64-bit ones from an interface table, kept from
+ * one sample to the next so each interval costs one sysctl and no process.
+ * Deltas are integer math on those counters, rates are scaled by the
+ * monotonic nanoseconds between samples.
+ */
+
+#include "iftable.h"
+
+struct watch_counter {
+	char name[IFNAMSIZ];
+	u_int64_t ibytes;			// counters at the last sample
+	u_int64_t obytes;
+	u_int64_t idelta;			// bytes since the sample before it
+	u_int64_t odelta;
+	int known;					// its counters were sampled before
+	int seen;					// found in the last sample
+};
+
+struct watch {
+	struct watch_counter *counters;
+	int count;
+	int cap;
+	int all;					// follow every interface, including new ones
+	u_int64_t lastNsec;			// monotonic time of the last sample, 0 before the first
+	u_int64_t intervalNsec;		// time between the last two samples
+	struct iftable *table;		// refreshed in place by `watch_sample`
+};
+
+/**
+ * - returns: bytes a counter moved, a counter that went backwards was reset
+ *   (e.g. the interface was recreated) and moved what it now holds
+ */
+static inline u_int64_t watch_delta(u_int64_t before, u_int64_t now) {
+	return now >= before ? now - before : now;
+}
+
+/**
+ * - returns: bytes per second, exact for any delta and interval
+ */
+static inline u_int64_t watch_rate(u_int64_t bytes, u_int64_t nsec) {
+	if(nsec == 0) return 0;
+	return (u_int64_t) ((unsigned __int128) bytes * 1000000000u / nsec);
+}
+
+struct watch *watch_create(void);
+void watch_free(struct watch *w);
+int watch_add(struct watch *w, const char *name);
+int watch_update_table(struct watch *w, const struct iftable *t, u_int64_t now);
+int watch_sample(struct watch *w);
+
+#endif
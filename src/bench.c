@@ -0,0 +1,498 @@
+#include "general.h"
+#include "session.h"
+#include "netinterfaces.h"
+#include "iftable.h"
+#include <net/if_dl.h> // sockaddr_dl
+
+/*
+ * Benchmarks, built and run with `make bench`
+ *
+ * Needs no network and no privileges. Each result is printed as one JSON
+ * object per line so runs can be diffed or tracked for regressions:
+ *   parse      synthetic bpf buffers through `process_packets`, the loop
+ *              `read_packets` runs on every read, per feature set
+ *   interfaces `interfacesFrom` over a large fake address list, and
+ *              `interfaces` over the real one
+ *   iftable    `iftable_load` refreshing a table in place from a large fake
+ *              interface list, and `iftable_refresh` from the real one
+ *   limit      how long after the command's traffic crosses the limit the
+ *              limit fires, over loopback with `netman_poll_sockets`
+ *   wakeup     how long a reader takes to see a write, blocking in read as
+ *              `read_packets` does by default versus spinning with
+ *              `spin_read` as --busy-poll does, over a pipe
+ */
+
+#define BENCH_BUFFER (512 * 1024)		// a typical bpf buffer
+#define BENCH_MIN_NSEC 200000000ull		// time each case for at least this long
+#define BENCH_HOSTS 1024				// distinct addresses in the synthetic traffic
+#define BENCH_INTERFACES 4096
+#define BENCH_LIMIT (4 * 1000 * 1000)
+#define BENCH_DATAGRAM 1400
+#define BENCH_WAKEUPS 2000
+
+static const u_int8_t benchMac[ETHER_ADDR_LEN] = {0x02, 0, 0, 0, 0, 1};
+
+// a feature set for the parse benchmark, see `netman_set_*`
+struct features {
+	const char *name;
+	int histograms;
+	int top;
+	int budgets;
+	int dedup;
+};
+
+// frame mixes for the parse benchmark, simple IMIX is 7:4:1
+struct frames {
+	const char *name;
+	u_int32_t lens[12];
+	int count;
+};
+
+/**
+ * Fills a buffer with bpf records of Ethernet, IPv4 and UDP frames the way a read returns them
+ * - parameter mix: the frame lengths, cycled through
+ * - parameter bytes: set to the bytes on the wire
+ * - returns: bytes of the buffer used
+ */
+static size_t fillBuffer(char *buf, size_t len, const struct frames *mix, u_int32_t *packets, u_int64_t *bytes) {
+	// the kernel pads the header so the network header is word aligned
+	u_short hdrlen = BPF_WORDALIGN(sizeof(struct bpf_hdr) + ETHER_HDR_LEN) - ETHER_HDR_LEN;
+	size_t used = 0;
+	*packets = 0;
+	*bytes = 0;
+
+	for(u_int32_t i = 0; ; i++) {
+		u_int32_t frameLen = mix->lens[i % mix->count];
+		size_t record = BPF_WORDALIGN(hdrlen + frameLen);
+		if(used + record > len) break;
+
+		struct bpf_hdr *bh = (struct bpf_hdr *) (buf + used);
+		memset(bh, 0, hdrlen);
+		bh->bh_caplen = frameLen;
+		bh->bh_datalen = frameLen;
+		bh->bh_hdrlen = hdrlen;
+
+		// alternate sent and received, spread over a pool of hosts
+		u_char *frame = (u_char *) bh + hdrlen;
+		memset(frame, 0, frameLen);
+		u_int32_t host = (i * 2654435761u) % BENCH_HOSTS;
+		u_char *local = frame + ((i & 1) ? 0 : ETHER_ADDR_LEN);
+		u_char *remote = frame + ((i & 1) ? ETHER_ADDR_LEN : 0);
+		memcpy(local, benchMac, ETHER_ADDR_LEN);
+		remote[0] = 0x02;
+		remote[4] = (u_char) (host >> 8);
+		remote[5] = (u_char) host;
+		frame[12] = 0x08;
+
+		u_char *ip = frame + ETHER_HDR_LEN;
+		ip[0] = 0x45;
+		ip[2] = (u_char) ((frameLen - ETHER_HDR_LEN) >> 8);
+		ip[3] = (u_char) (frameLen - ETHER_HDR_LEN);
+		ip[4] = (u_char) (i >> 8);
+		ip[5] = (u_char) i;
+		ip[8] = 64;
+		ip[9] = IPPROTO_UDP;
+		u_char *src = ip + ((i & 1) ? 16 : 12);
+		u_char *dst = ip + ((i & 1) ? 12 : 16);
+		src[0] = 192; src[1] = 168; src[3] = 2;
+		dst[0] = (host & 1) ? 10 : 93;
+		dst[2] = (u_char) (host >> 8);
+		dst[3] = (u_char) host;
+
+		used += record;
+		(*packets)++;
+		*bytes += frameLen;
+	}
+	return used;
+}
+
+/**
+ * Readies the buffer for another round: packets continue the timeline a
+ * microsecond apart, as on a link at 1M packets per second, and the round
+ * goes in the IPv4 checksum so the duplicate filter sees new packets
+ * - parameter clock: the next packet's time in usec, updated
+ */
+static void restamp(char *buf, size_t len, int round, u_int64_t *clock) {
+	for(char *p = buf; p < buf + len; ) {
+		struct bpf_hdr *bh = (struct bpf_hdr *) p;
+		bh->bh_tstamp.tv_sec = (int32_t) (*clock / 1000000);
+		bh->bh_tstamp.tv_usec = (int32_t) (*clock % 1000000);
+		(*clock)++;
+
+		u_char *ip = (u_char *) p + bh->bh_hdrlen + ETHER_HDR_LEN;
+		ip[10] = (u_char) (round >> 8);
+		ip[11] = (u_char) round;
+		p += BPF_WORDALIGN(bh->bh_hdrlen + bh->bh_caplen);
+	}
+}
+
+/**
+ * - returns: a session with a feature set, or NULL on failure
+ */
+static netman_session *openSession(const struct features *f, const char *budgetsPath) {
+	netman_session *session = netman_open();
+	if(!session) return NULL;
+	netman_set_histograms(session, f->histograms);
+	if((f->top && netman_set_top(session, SKETCH_DEFAULT_K) < 0) ||
+	   (f->dedup && netman_set_dedup(session, 0) < 0) ||
+	   (f->budgets && netman_set_budgets(session, budgetsPath) < 0)) {
+		netman_close(session);
+		return NULL;
+	}
+	return session;
+}
+
+/**
+ * Times `process_packets` over a buffer until BENCH_MIN_NSEC has passed
+ * - parameter c: a capture from `capture_create`
+ * - parameter buf: BENCH_BUFFER bytes
+ */
+static void runParse(struct capture *c, char *buf, const struct features *f, const struct frames *mix) {
+	// the budgets tell sent from received by the interface's address
+	memcpy(c->mac, benchMac, ETHER_ADDR_LEN);
+	c->hasMac = true;
+
+	u_int32_t packets = 0;
+	u_int64_t wire = 0;
+	size_t len = fillBuffer(buf, BENCH_BUFFER, mix, &packets, &wire);
+
+	u_int64_t counted = 0, countedBytes = 0, lastStamp = 0, elapsed = 0, clock = 1000000;
+	int rounds = 0;
+	// the first round warms the caches and is not timed
+	for(int round = 0; elapsed < BENCH_MIN_NSEC; round++) {
+		restamp(buf, len, round, &clock);
+		u_int64_t start = monotonicNsec();
+		process_packets(c, buf, (ssize_t) len, &counted, &countedBytes, &lastStamp);
+		if(round > 0) {
+			elapsed += monotonicNsec() - start;
+			rounds++;
+		}
+	}
+
+	double nsec = (double) elapsed / ((double) rounds * packets);
+	printf("{\"bench\":\"parse\",\"layout\":\"bpf\",\"frames\":\"%s\",\"features\":\"%s\","
+		   "\"packets\":%llu,\"ns_per_packet\":%.2f,\"mpps\":%.2f,\"gbps\":%.2f}\n",
+		mix->name, f->name, (unsigned long long) rounds * packets, nsec, 1000.0 / nsec,
+		(double) wire * rounds * 8 / elapsed);
+	fflush(stdout);
+}
+
+/**
+ * Runs the parse benchmark with a feature set on a frame mix
+ */
+static void benchParse(const struct features *f, const struct frames *mix, const char *budgetsPath) {
+	netman_session *session = openSession(f, budgetsPath);
+	struct capture *c = session ? capture_create(session, "bench0") : NULL;
+	char *buf = malloc(BENCH_BUFFER);
+	if(c && buf) {
+		runParse(c, buf, f, mix);
+	} else {
+		printERR("Unable to set up the %s parse benchmark.", f->name);
+	}
+	free(buf);
+	capture_destroy(c);
+	if(session) netman_close(session);
+}
+
+// a fake `getifaddrs` result, a link layer and an IPv4 entry per interface
+struct fakeInterfaces {
+	struct ifaddrs addrs[2 * BENCH_INTERFACES];
+	struct sockaddr_dl links[BENCH_INTERFACES];
+	struct sockaddr_in inets[BENCH_INTERFACES];
+	struct if_data data[BENCH_INTERFACES];
+	char names[BENCH_INTERFACES][IFNAMSIZ];
+};
+
+/**
+ * Times building the interface list from BENCH_INTERFACES fake interfaces,
+ * then from the real ones
+ */
+static void benchInterfaces(void) {
+	struct fakeInterfaces *fake = calloc(1, sizeof(struct fakeInterfaces));
+	if(!fake) {
+		printERR("Unable to set up the interfaces benchmark.");
+		return;
+	}
+
+	for(int i = 0; i < BENCH_INTERFACES; i++) {
+		snprintf(fake->names[i], IFNAMSIZ, "feth%d", i);
+		fake->links[i].sdl_len = sizeof(struct sockaddr_dl);
+		fake->links[i].sdl_family = AF_LINK;
+		fake->inets[i].sin_family = AF_INET;
+		fake->data[i].ifi_ibytes = i;
+		fake->data[i].ifi_obytes = i;
+
+		struct ifaddrs *link = &fake->addrs[2 * i], *inet = &fake->addrs[2 * i + 1];
+		link->ifa_name = inet->ifa_name = fake->names[i];
+		link->ifa_addr = (struct sockaddr *) &fake->links[i];
+		link->ifa_data = &fake->data[i];
+		inet->ifa_addr = (struct sockaddr *) &fake->inets[i];
+		link->ifa_next = inet;
+		inet->ifa_next = i + 1 < BENCH_INTERFACES ? &fake->addrs[2 * i + 2] : NULL;
+	}
+
+	u_int64_t elapsed = 0;
+	int rounds = 0;
+	while(elapsed < BENCH_MIN_NSEC) {
+		list *l = NULL;
+		u_int64_t start = monotonicNsec();
+		interfacesFrom(fake->addrs, &l);
+		freeInterfaces(&l);
+		elapsed += monotonicNsec() - start;
+		rounds++;
+	}
+	free(fake);
+	printf("{\"bench\":\"interfaces\",\"source\":\"fake\",\"interfaces\":%d,\"us_per_call\":%.2f,\"ns_per_interface\":%.2f}\n",
+		BENCH_INTERFACES, elapsed / 1000.0 / rounds, (double) elapsed / rounds / BENCH_INTERFACES);
+
+	// the real list is dominated by getifaddrs
+	elapsed = 0;
+	rounds = 0;
+	int real = 0;
+	while(elapsed < BENCH_MIN_NSEC) {
+		list *l = NULL;
+		u_int64_t start = monotonicNsec();
+		interfaces(&l);
+		elapsed += monotonicNsec() - start;
+		rounds++;
+		real = 0;
+		for(list *i = l; i != NULL; i = i->next) real++;
+		freeInterfaces(&l);
+	}
+	printf("{\"bench\":\"interfaces\",\"source\":\"getifaddrs\",\"interfaces\":%d,\"us_per_call\":%.2f}\n",
+		real, elapsed / 1000.0 / rounds);
+	fflush(stdout);
+}
+
+// a fake `NET_RT_IFLIST2` message, as the kernel lists an interface
+struct fakeMessage {
+	struct if_msghdr2 ifm;
+	struct sockaddr_dl sdl;
+};
+
+/**
+ * Times refreshing an interface table in place from BENCH_INTERFACES fake
+ * interfaces and scanning its counters, then refreshing it from the real ones
+ */
+static void benchTable(void) {
+	struct fakeMessage *msgs = calloc(BENCH_INTERFACES, sizeof(struct fakeMessage));
+	struct iftable *t = iftable_create();
+	if(!msgs || !t) {
+		printERR("Unable to set up the iftable benchmark.");
+		free(msgs);
+		iftable_free(t);
+		return;
+	}
+
+	for(int i = 0; i < BENCH_INTERFACES; i++) {
+		msgs[i].ifm.ifm_msglen = sizeof(struct fakeMessage);
+		msgs[i].ifm.ifm_type = RTM_IFINFO2;
+		msgs[i].ifm.ifm_index = i + 1;
+		msgs[i].ifm.ifm_data.ifi_ibytes = i;
+		msgs[i].ifm.ifm_data.ifi_obytes = i;
+		msgs[i].sdl.sdl_family = AF_LINK;
+		msgs[i].sdl.sdl_nlen = snprintf(msgs[i].sdl.sdl_data, sizeof(msgs[i].sdl.sdl_data), "feth%d", i);
+	}
+	size_t len = BENCH_INTERFACES * sizeof(struct fakeMessage);
+
+	// the first load sizes the columns, the rest are the steady state
+	iftable_load(t, (char *) msgs, len);
+	u_int64_t elapsed = 0, scanned = 0, sum = 0;
+	int rounds = 0;
+	while(elapsed < BENCH_MIN_NSEC) {
+		u_int64_t start = monotonicNsec();
+		iftable_load(t, (char *) msgs, len);
+		u_int64_t loaded = monotonicNsec();
+		for(int i = 0; i < t->count; i++) sum += t->ibytes[i] + t->obytes[i];
+		scanned += monotonicNsec() - loaded;
+		elapsed += loaded - start;
+		rounds++;
+	}
+	printf("{\"bench\":\"iftable\",\"source\":\"fake\",\"interfaces\":%d,\"us_per_call\":%.2f,\"ns_per_interface\":%.2f,\"scan_ns_per_interface\":%.2f,\"sum\":%llu}\n",
+		t->count, elapsed / 1000.0 / rounds, (double) elapsed / rounds / BENCH_INTERFACES,
+		(double) scanned / rounds / BENCH_INTERFACES, (unsigned long long) sum);
+	free(msgs);
+
+	// the real table is dominated by the sysctl
+	elapsed = 0;
+	rounds = 0;
+	while(elapsed < BENCH_MIN_NSEC) {
+		u_int64_t start = monotonicNsec();
+		if(iftable_refresh(t) < 0) break;
+		elapsed += monotonicNsec() - start;
+		rounds++;
+	}
+	if(rounds > 0) {
+		printf("{\"bench\":\"iftable\",\"source\":\"sysctl\",\"interfaces\":%d,\"us_per_call\":%.2f}\n",
+			t->count, elapsed / 1000.0 / rounds);
+	}
+	iftable_free(t);
+	fflush(stdout);
+}
+
+/**
+ * on limit callback for the limit benchmark, records when the limit fired
+ */
+static void limitFired(netman_session *session, u_int64_t bytes, void *ctx) {
+	(void) session;
+	(void) bytes;
+	__atomic_store_n((u_int64_t *) ctx, monotonicNsec(), __ATOMIC_RELEASE);
+}
+
+/**
+ * Sends datagrams to itself over loopback until the session's limit fires
+ * and prints how long after the traffic crossed the limit that was
+ * bpf can't capture lo0 (DLT_NULL) so our own sockets are polled instead
+ * - parameter session: a session with no captures
+ * - parameter fd: a UDP socket
+ * - parameter intervalMsec: milliseconds between socket polls
+ */
+static void runLimit(netman_session *session, int fd, u_int32_t intervalMsec) {
+	u_int64_t fired = 0;
+	struct sockaddr_in addr = {0};
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t addrLen = sizeof(addr);
+	if(bind(fd, (struct sockaddr *) &addr, addrLen) < 0 || getsockname(fd, (struct sockaddr *) &addr, &addrLen) < 0) {
+		printERR("Unable to bind a loopback socket.");
+		return;
+	}
+
+	netman_set_limit(session, BENCH_LIMIT);
+	netman_on_limit(session, limitFired, &fired);
+	if(netman_poll_sockets(session, getpgrp(), intervalMsec) < 0) {
+		printERR("Unable to poll sockets.");
+		return;
+	}
+
+	// each datagram is counted when sent and when received
+	char payload[BENCH_DATAGRAM] = {0};
+	u_int64_t sent = 0, crossed = 0, start = monotonicNsec();
+	while(!__atomic_load_n(&fired, __ATOMIC_ACQUIRE) && monotonicNsec() - start < 5000000000ull) {
+		if(sendto(fd, payload, sizeof(payload), 0, (struct sockaddr *) &addr, addrLen) < 0) break;
+		if(recv(fd, payload, sizeof(payload), 0) < 0) break;
+		sent += 2 * sizeof(payload);
+		if(crossed == 0 && sent >= BENCH_LIMIT) crossed = monotonicNsec();
+	}
+
+	u_int64_t end = __atomic_load_n(&fired, __ATOMIC_ACQUIRE);
+	if(end == 0 || crossed == 0) {
+		printf("{\"bench\":\"limit\",\"source\":\"sockets\",\"interval_ms\":%u,\"fired\":false}\n", intervalMsec);
+	} else {
+		printf("{\"bench\":\"limit\",\"source\":\"sockets\",\"interval_ms\":%u,\"fired\":true,"
+			   "\"latency_us\":%.1f,\"overshoot_bytes\":%llu}\n",
+			intervalMsec, end > crossed ? (end - crossed) / 1000.0 : 0.0,
+			(unsigned long long) (sent > BENCH_LIMIT ? sent - BENCH_LIMIT : 0));
+	}
+	fflush(stdout);
+}
+
+/**
+ * Runs the limit benchmark with a poll interval
+ */
+static void benchLimit(u_int32_t intervalMsec) {
+	netman_session *session = netman_open();
+	int fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if(session && fd >= 0) {
+		runLimit(session, fd, intervalMsec);
+	} else {
+		printERR("Unable to set up the limit benchmark.");
+	}
+	if(fd >= 0) close(fd);
+	if(session) netman_close(session);
+}
+
+/**
+ * Writes a timestamp into a pipe every 50-250usec, the body of the wakeup benchmark's writer
+ * - parameter arg: the pipe's write end
+ */
+static void *writeStamps(void *arg) {
+	int fd = (int) (intptr_t) arg;
+	for(int i = 0; i < BENCH_WAKEUPS; i++) {
+		usleep(50 + (i * 37) % 200);
+		u_int64_t stamp = monotonicNsec();
+		if(write(fd, &stamp, sizeof(stamp)) != sizeof(stamp)) break;
+	}
+	return NULL;
+}
+
+/**
+ * Prints the latency from a write to the read that returns it
+ * - parameter spinUsec: how long to spin before blocking, 0 for a blocking read
+ */
+static void benchWakeup(u_int32_t spinUsec) {
+	int fds[2];
+	struct histogram *latency = calloc(1, sizeof(struct histogram));
+	int enable = 1;
+	if(!latency || pipe(fds) < 0) {
+		printERR("Unable to set up the wakeup benchmark.");
+		free(latency);
+		return;
+	}
+	if(spinUsec > 0) ioctl(fds[0], FIONBIO, &enable);
+
+	pthread_t writer;
+	pthread_create(&writer, NULL, writeStamps, (void *) (intptr_t) fds[1]);
+	u_int64_t stamp = 0;
+	for(int i = 0; i < BENCH_WAKEUPS; i++) {
+		ssize_t n = spinUsec > 0 ? spin_read(fds[0], (char *) &stamp, sizeof(stamp), spinUsec)
+		                         : read(fds[0], &stamp, sizeof(stamp));
+		if(n != sizeof(stamp)) break;
+		histogram_record(latency, monotonicNsec() - stamp);
+	}
+	pthread_join(writer, NULL);
+	close(fds[0]);
+	close(fds[1]);
+
+	printf("{\"bench\":\"wakeup\",\"mode\":\"%s\",\"spin_us\":%u,\"reads\":%llu,"
+		   "\"p50_ns\":%llu,\"p99_ns\":%llu,\"max_ns\":%llu}\n",
+		spinUsec > 0 ? "spin" : "block", spinUsec, (unsigned long long) latency->count,
+		(unsigned long long) histogram_percentile(latency, 50),
+		(unsigned long long) histogram_percentile(latency, 99),
+		(unsigned long long) histogram_percentile(latency, 100));
+	fflush(stdout);
+	free(latency);
+}
+
+int main(void) {
+	static const struct features features[] = {
+		{"count", 0, 0, 0, 0},
+		{"histograms", 1, 0, 0, 0},
+		{"top", 0, 1, 0, 0},
+		{"budgets", 0, 0, 1, 0},
+		{"dedup", 0, 0, 0, 1},
+		{"all", 1, 1, 1, 1},
+	};
+	static const struct frames mixes[] = {
+		{"64", {64}, 1},
+		{"1514", {1514}, 1},
+		{"imix", {60, 60, 60, 60, 60, 60, 60, 590, 590, 590, 590, 1514}, 12},
+	};
+
+	char budgetsPath[] = "/tmp/netman.bench.XXXXXX";
+	int fd = mkstemp(budgetsPath);
+	if(fd < 0) {
+		printERR("Unable to create a budget file.");
+		return ERR_OPEN;
+	}
+	dprintf(fd, "internal 0 10.0.0.0/8\ninternet 0 0.0.0.0/0\n");
+	close(fd);
+
+	for(size_t m = 0; m < sizeof(mixes) / sizeof(mixes[0]); m++) {
+		for(size_t f = 0; f < sizeof(features) / sizeof(features[0]); f++) {
+			benchParse(&features[f], &mixes[m], budgetsPath);
+		}
+	}
+	unlink(budgetsPath);
+
+	benchInterfaces();
+	benchTable();
+
+	benchLimit(1);
+	benchLimit(10);
+	benchLimit(PROCSOCK_DEFAULT_INTERVAL_MSEC);
+
+	benchWakeup(0);
+	benchWakeup(BUSY_POLL_DEFAULT_USEC);
+	return 0;
+}
@@ -0,0 +1,128 @@
+#include "dedup.h"
+
+#include <stdlib.h> // calloc
+#include <string.h> // memcpy
+#include <stdbool.h>
+#include <net/ethernet.h> // ETHER_HDR_LEN
+
+#define VLAN_TAG_LEN 4
+
+/**
+ * - returns: a 64 bit hash of a packet from its network header on
+ */
+static u_int64_t hashPacket(const u_char *l3, u_int32_t caplen, u_int32_t len) {
+	u_int64_t h = 0x9e3779b97f4a7c15ull ^ len;
+	u_int32_t n = caplen < DEDUP_HASH_BYTES ? caplen : DEDUP_HASH_BYTES;
+
+	// a word at a time, the tail is zero padded
+	for(u_int32_t i = 0; i < n; i += 8) {
+		u_int64_t w = 0;
+		memcpy(&w, l3 + i, n - i < 8 ? n - i : 8);
+		h = (h ^ w) * 0xff51afd7ed558ccdull;
+		h ^= h >> 32;
+	}
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ull;
+	h ^= h >> 33;
+	return h;
+}
+
+/**
+ * Creates an empty filter
+ * - parameter bits: bits per window, rounded up to a power of two
+ * - parameter windowUsec: length of a window in microseconds
+ * - returns: the filter, or NULL on failure
+ */
+struct dedup *dedup_create(u_int32_t bits, u_int64_t windowUsec) {
+	if(bits < 64 || bits > (1u << 31) || windowUsec == 0) return NULL;
+
+	struct dedup *d = calloc(1, sizeof(struct dedup));
+	if(!d) return NULL;
+	d->words = 1;
+	while(d->words * 64 < bits) d->words <<= 1;
+	d->windowUsec = windowUsec;
+	d->bits = calloc(3 * (size_t) d->words, sizeof(u_int64_t));
+	if(!d->bits) {
+		free(d);
+		return NULL;
+	}
+	return d;
+}
+
+/**
+ * - parameter d: filter from `dedup_create`
+ */
+void dedup_free(struct dedup *d) {
+	if(!d) return;
+	free(d->bits);
+	free(d);
+}
+
+/**
+ * Moves the filter to the window holding a time, the thread that moves it
+ * clears the slot the next window will use
+ * - returns: the current window
+ */
+static u_int64_t advance(struct dedup *d, u_int64_t stampUsec) {
+	u_int64_t epoch = stampUsec / d->windowUsec;
+	u_int64_t current = __atomic_load_n(&d->epoch, __ATOMIC_ACQUIRE);
+
+	while(epoch > current) {
+		if(!__atomic_compare_exchange_n(&d->epoch, &current, epoch, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			continue;
+		}
+		if(epoch - current >= 2) {
+			// every slot is stale after a gap
+			memset(d->bits, 0, 3 * (size_t) d->words * sizeof(u_int64_t));
+		} else {
+			memset(d->bits + ((epoch + 1) % 3) * d->words, 0, d->words * sizeof(u_int64_t));
+		}
+		return epoch;
+	}
+	// a packet stamped before the current window is checked against it
+	return current;
+}
+
+/**
+ * Records a packet and tells if it was already recorded within the last window or two
+ * Safe to call from every capture thread at once
+ * - parameter frame: the ethernet frame
+ * - parameter caplen: bytes of the frame captured
+ * - parameter len: bytes of the frame on the wire
+ * - parameter stampUsec: the packet's capture time in microseconds
+ * - returns: true if the packet is a duplicate
+ */
+int dedup_seen(struct dedup *d, const u_char *frame, u_int32_t caplen, u_int32_t len, u_int64_t stampUsec) {
+	if(caplen < ETHER_HDR_LEN) return false;
+
+	// skip VLAN tags so a tagged frame on a parent matches the untagged one on its VLAN
+	u_int32_t offset = ETHER_HDR_LEN;
+	u_int16_t type = (u_int16_t) (frame[12] << 8 | frame[13]);
+	for(int tags = 0; tags < 2 && (type == 0x8100 || type == 0x88a8) && caplen >= offset + VLAN_TAG_LEN; tags++) {
+		type = (u_int16_t) (frame[offset + 2] << 8 | frame[offset + 3]);
+		offset += VLAN_TAG_LEN;
+	}
+	if(len < offset) return false;
+
+	u_int64_t hash = hashPacket(frame + offset, caplen - offset, len - offset);
+	u_int64_t epoch = advance(d, stampUsec);
+	u_int64_t *current = d->bits + (epoch % 3) * d->words;
+	u_int64_t *previous = d->bits + ((epoch + 2) % 3) * d->words;
+
+	u_int32_t h1 = (u_int32_t) hash;
+	u_int32_t h2 = (u_int32_t) (hash >> 32) | 1;
+	u_int64_t mask = (u_int64_t) d->words * 64 - 1;
+	int inCurrent = true, inPrevious = true;
+
+	for(u_int32_t i = 0; i < DEDUP_HASHES; i++) {
+		u_int64_t bit = (h1 + i * h2) & mask;
+		u_int64_t word = bit >> 6, flag = 1ull << (bit & 63);
+
+		u_int64_t old = __atomic_fetch_or(&current[word], flag, __ATOMIC_RELAXED);
+		inCurrent &= (old & flag) != 0;
+		if(inPrevious) {
+			inPrevious = (__atomic_load_n(&previous[word], __ATOMIC_RELAXED) & flag) != 0;
+		}
+	}
+	return inCurrent || inPrevious;
+}
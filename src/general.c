@@ -1,7 +1,11 @@
 #include "general.h"
+#include "session.h"
+#include "netinterfaces.h"
 
 static char *VERSION = "1.0";
 
+int verbose_flag = 0;
+
 /**
  * prints the version number
  */
@@ -21,6 +25,12 @@ void usage() {
     println("  up                    Turn the selected interface(s) up and exit. (privileged)");
     println("  down                  Turn the selected interface(s) down and exit. (privileged)");
     println("  monitor               Monitor the selected interface(s). (privileged)");
+    println("  history               Print the bytes each interface and budget moved between");
+    println("                        --since and --until, from the --history file.");
+    println("  quota                 Print what each quota used of its limit, from the");
+    println("                        --quota-file. A --quota with a limit is saved first.");
+    println("  aggregate             Hand out slices of a --limit per group to monitors on");
+    println("                        other hosts, over UDP. Runs until killed.");
 
     println("\nOptions:");
     println("  -v, --version         Print the version number of netman and exit.");
@@ -34,50 +44,105 @@ void usage() {
     println("  -t, --totalbytes      Print the (RX + TX) bytes. (default)");
     println("  -i, --ibytes          Print the RX bytes.");
     println("  -o, --obytes          Print the TX bytes.");
+    println("  --watch               Every this many seconds, print the bytes each interface");
+    println("                        moved since the last and its rate per second, with a");
+    println("                        total. Runs until killed.");
 
     println("\nmonitor Options:");
     println("  -l, --limit           The byte limit. In MB if -H is set, otherwise B.");
     println("  -c, --command         Command to run.");
+    println("  --rx-limit            The received byte limit, with --tx-limit the sent one.");
+    println("                        Either kills the command when reached, alongside");
+    println("                        --limit. In MB if -H is set, otherwise B.");
+    println("  --buffer-max          The most kernel buffer (KB) a bpf may grow to when it");
+    println("                        drops packets. (default %d)", BPF_MAXBUFSIZE / 1024);
+    println("  --affinity            Comma separated affinity tags, one per capture thread,");
+    println("                        or 'auto' to give each thread its own tag.");
+    println("  --hugepages           Back the capture buffers with 2MB superpages.");
+    println("  --busy-poll[=usec]    Experimental. Spin on reads this long after each packet");
+    println("                        before blocking. Not shown to lower latency, compare");
+    println("                        the `wakeup` results of `make bench` first. Costs a");
+    println("                        core per interface. (default %d)", BUSY_POLL_DEFAULT_USEC);
+    println("  --histogram           Print packet size, inter-arrival and read latency");
+    println("                        histograms per interface when done.");
+    println("  --shm[=name]          Publish live counters in a shared memory segment.");
+    println("                        (default %s)", NETSTATS_DEFAULT_NAME);
+    println("  --top[=k]             Print the k heaviest MAC and IP addresses when done,");
+    println("                        counted in fixed memory. (default %d, at most %d)", SKETCH_DEFAULT_K, SKETCH_MAX_K);
+    println("  --top-interval        Also print them every this many seconds.");
+    println("  --budgets             File of '<budget> <limit bytes> <cidr>' lines. Each packet");
+    println("                        counts against the budget of the longest prefix holding");
+    println("                        its remote address, the command is killed when any");
+    println("                        budget with a limit is reached.");
+    println("  --dedup[=msec]        Count a packet once when it is seen on several interfaces,");
+    println("                        e.g. a bridge and its members, within a window.");
+    println("                        (default %d)", DEDUP_DEFAULT_WINDOW_USEC / 1000);
+    println("  --sample              Count 1 in this many IPv4 packets, a power of two, and");
+    println("                        scale them up. Counts switch to exact near the --limit.");
+    println("                        Prints the estimate with its 95%% confidence interval.");
+    println("  --sockets[=msec]      Count the bytes of the command's TCP and UDP sockets,");
+    println("                        polled every msec, instead of capturing interfaces.");
+    println("                        Needs no privileges. (default %d)", PROCSOCK_DEFAULT_INTERVAL_MSEC);
+    println("  --stats               Print each capture thread's packets, bytes, reads, time");
+    println("                        in read versus processing, CPU time and drops when done.");
+    println("  --stats-interval      Also print them every this many seconds.");
+    println("  --history[=path]      Record the bytes of each interface and the budget every");
+    println("                        --resolution seconds. (default %s)", HISTORY_DEFAULT_PATH);
+    println("  --resolution          Seconds between history records for a new history file.");
+    println("                        (default %d)", HISTORY_DEFAULT_RESOLUTION);
+    println("  --quota               Charge the bytes to a named quota that persists across runs,");
+    println("                        '<name>[,<limit>[,daily|<seconds>]]'. A limit saves it.");
+    println("                        The command is not started once the quota is used up,");
+    println("                        and is killed when it runs out. In MB if -H is set.");
+    println("  --quota-file          The quota file. (default %s)", QUOTA_DEFAULT_PATH);
+    println("  --aggregator          host[:port] of an aggregator. The --group's budget is");
+    println("                        shared with every monitor reporting to it.");
+    println("  --group               The group to share a budget with. (default %s)", LEASE_DEFAULT_GROUP);
+    println("  --jobs                File of '<name> <limit> <rate> <interfaces> <command>'");
+    println("                        lines. The commands run side by side under one capture,");
+    println("                        each killed at its byte limit and paused over its rate");
+    println("                        (bytes/s). 0 is unlimited, interfaces are comma separated");
+    println("                        or 'all'. The --limit covers every job.");
+    println("  --concurrency         How many --jobs run at once, 0 for all. (default 0)");
     println("  --run                 Run the specified command until completion then print")
     println("                        the total RX + TX bytes. This ignores any limit set.")
-}
-
-/** 
- * removes the thread from the bpf thread list
- */
-void removeThread() {
-    pthread_t thread = pthread_self();
 
-    pthread_mutex_lock(&thread_mutex);
-
-    for(u_int32_t i = 0; i < sizeof(threads); i++) {
-        if(threads[i] == thread) {
-            threads[i] = 0;
-            break;
-        }
-    }
+    println("\naggregate Options:");
+    println("  -l, --limit           Each group's budget. In MB if -H is set, otherwise B.");
+    println("  --port                The UDP port to listen on. (default %s)", LEASE_DEFAULT_PORT);
+    println("  --lease               Milliseconds a grant holds. (default %d)", LEASE_DEFAULT_MSEC);
 
-    pthread_mutex_unlock(&thread_mutex);
+    println("\nhistory Options:");
+    println("  --history[=path]      The history file to read. (default %s)", HISTORY_DEFAULT_PATH);
+    println("  --since               Start of the range, as epoch seconds, 'YYYY-MM-DD[ HH:MM]'");
+    println("                        or 'HH:MM' for today. (default 24 hours ago)");
+    println("  --until               End of the range, same formats. (default now)");
 }
 
 /**
- * - returns: the number of bpf threads 
+ * Parses a byte count given on the command line, which can be past 32 bits
+ * - parameter value: the option's value, digits only
+ * - parameter bytes: set to the count
+ * - returns: 0 on success, otherwise ERR_OPTIONS
  */
-int threadCount() {
-    int count = 0;
-    pthread_mutex_lock(&thread_mutex);
-    for(int i = 0; i < 20; i++) {
-        if(threads[i] != NULL) {
-            count++;
-        }
-    }
-    pthread_mutex_unlock(&thread_mutex);
-    return count;
+int parseBytes(const char *value, u_int64_t *bytes) {
+    if(!value || !bytes) return ERR_NULL;
+    // strtoull skips spaces and accepts a sign, so check for a digit first
+    if(*value < '0' || *value > '9') return ERR_OPTIONS;
+
+    char *end = NULL;
+    errno = 0;
+    unsigned long long n = strtoull(value, &end, 10);
+    if(errno == ERANGE || *end != '\0') return ERR_OPTIONS;
+    *bytes = n;
+    return 0;
 }
 
 /**
  *  Runs a specified command in sh in another process
  *  If the user is root, bumps the user down to their original uid
+ *  The command leads its own process group so the whole pipeline can be
+ *  signalled at once, see `killCmd`
  *  - returns: pid of the fork or a negative number if an error has occured, 0 if command is null
  */
 pid_t runCmd(char *cmd) {
@@ -85,6 +150,7 @@ pid_t runCmd(char *cmd) {
 
     pid_t pid = fork();
     if(pid == 0) {
+        setpgid(0, 0);
         if(geteuid() == 0) {
             char *env = getenv("SUDO_UID");
             if(env == NULL){ 
@@ -115,49 +181,313 @@ pid_t runCmd(char *cmd) {
         printERR("Failed to fork.");
         return ERR_FORK;
     }
+
+    // also set the group from the parent so there is no window where the
+    // child is still in our group; EACCES means the child already exec'd
+    if(setpgid(pid, pid) < 0 && errno != EACCES) {
+        printVERBOSE("Failed to set process group for %d: %s", pid, strerror(errno));
+    }
     return pid;
 }
 
 /**
- * Monitor an interface name by opening a bpf device and read the 
- * incoming packets
- * - parameter ifname: interface name to monitor
+ * Creates a kqueue that fires once the command's process exits
+ * - parameter pid: pid of the command from `runCmd`
+ * - returns: kqueue descriptor, otherwise ERR_KQUEUE
+ */
+int watchCmd(pid_t pid) {
+    if(pid <= 0) return ERR_NULL;
+
+    int kq = kqueue();
+    if(kq < 0) {
+        printERR("Unable to create kqueue.");
+        return ERR_KQUEUE;
+    }
+
+    struct kevent ev;
+    EV_SET(&ev, pid, EVFILT_PROC, EV_ADD | EV_ONESHOT, NOTE_EXIT, 0, NULL);
+    // ESRCH means the command already exited, `cmdExited` will reap it
+    if(kevent(kq, &ev, 1, NULL, 0, NULL) < 0 && errno != ESRCH) {
+        printERR("Unable to watch command %d.", pid);
+        close(kq);
+        return ERR_KQUEUE;
+    }
+    return kq;
+}
+
+/**
+ * Checks if the command's process has exited, waiting at most `timeout`
+ * Reaps the process so it does not linger as a zombie
+ * - parameter kq: kqueue from `watchCmd`, or negative to only poll `waitpid`
+ * - parameter pid: pid of the command
+ * - parameter timeout: how long to wait for the exit, NULL to block
+ * - returns: true if the command has exited, false otherwise
+ */
+int cmdExited(int kq, pid_t pid, const struct timespec *timeout) {
+    // `waitpid` decides, the one shot exit event only saves polling for it
+    pid_t res = waitpid(pid, NULL, WNOHANG);
+    if(res == 0 && kq >= 0) {
+        struct kevent ev;
+        // once the event fires the process is exiting, so waiting to reap it is brief
+        res = waitpid(pid, NULL, kevent(kq, NULL, 0, &ev, 1, timeout) > 0 ? 0 : WNOHANG);
+    }
+    return res == pid || (res < 0 && errno == ECHILD);
+}
+
+/**
+ * Kills whatever is left in a command's process group, without touching the
+ * command itself, for use once the command has been reaped
+ * Its pid may already belong to another process, but a group id stays
+ * taken while any member is alive, so only the command's own group is hit
+ * - parameter pid: pid of the command from `runCmd`
+ * - returns: 0 on success or if nothing was left to kill, otherwise -1
+ */
+int killGroup(pid_t pid) {
+    if(pid <= 0) return ERR_NULL;
+
+    if(kill(-pid, SIGKILL) < 0 && errno != ESRCH) {
+        printERR("Failed to kill process group %d.", pid);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Kills every process in the command's process group in one step
+ * so grandchildren of the `sh -c` (e.g. each side of a pipe) die with it,
+ * then reaps the command. Only for a command that has not been reaped yet,
+ * otherwise see `killGroup`
+ * Note: processes that move themselves to a new group or session escape
+ * - parameter pid: pid of the command from `runCmd`
+ * - returns: 0 on success or if nothing was left to kill, otherwise -1
+ */
+int killCmd(pid_t pid) {
+    if(pid <= 0) return ERR_NULL;
+
+    if(kill(-pid, SIGKILL) < 0) {
+        if(errno != ESRCH) {
+            printERR("Failed to kill process group %d.", pid);
+            return -1;
+        }
+        // no group left, but the unreaped leader may still be around
+        if(kill(pid, SIGKILL) < 0 && errno != ESRCH) {
+            printERR("Failed to kill command %d.", pid);
+            return -1;
+        }
+    }
+    waitpid(pid, NULL, 0);
+    return 0;
+}
+
+/**
+ * - returns: the CPU time of the calling thread in nanoseconds
+ */
+static u_int64_t threadCpuNsec(void) {
+    struct timespec ts;
+    if(clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) < 0) return 0;
+    return (u_int64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ * Stops a capture thread, closing its bpf
+ * - parameter c: the capture
+ * - parameter res: the thread's result
+ * - returns: `res` for the thread to return
+ */
+static void *stopCapture(struct capture *c, int res) {
+    __atomic_store_n(&c->metrics.cpuNsec, threadCpuNsec(), __ATOMIC_RELAXED);
+    int fd = c->fd;
+    c->fd = -1;
+    if(fd >= 0) close(fd);
+
+    __atomic_store_n(&c->running, 0, __ATOMIC_RELEASE);
+    return (void *) (intptr_t) res;
+}
+
+/**
+ * Picks the buffer length to reopen a dropping bpf with
+ * The kernel clamps BIOCSBLEN to debug.bpf_maxbufsize, so a buffer smaller
+ * than asked for is as big as it gets and lowers the capture's `bufferMax`
+ * - parameter c: the capture
+ * - parameter asked: the length set before the bpf was attached, 0 for the kernel's default
+ * - parameter got: the length read back with BIOCGBLEN
+ * - returns: double `got` up to `bufferMax`, or 0 if the buffer can't grow
+ */
+u_int32_t next_buffer_len(struct capture *c, u_int32_t asked, u_int32_t got) {
+    if(asked > 0 && got < asked) {
+        c->bufferMax = got;
+    }
+    if(got == 0 || got >= c->bufferMax) return 0;
+    return got < c->bufferMax / 2 ? got * 2 : c->bufferMax;
+}
+
+/**
+ * Monitor an interface by opening a bpf device and read the 
+ * incoming packets, this is the body of a capture thread
+ * If the kernel drops packets the device is reopened with a bigger buffer,
+ * up to the capture's `bufferMax`, after that the interface counters are polled instead
+ * Runs until the capture's `stop` is set or reading fails
+ * - parameter arg: the `struct capture` to run
  * - returns: void pointer to an integer if error
  */
-void* monitor(void *ifname) {
-    if(ifname == NULL) {
+void* monitor(void *arg) {
+    if(arg == NULL) {
         return (void *) ERR_NULL;
     }
-    char *name = (char*)ifname;
+    struct capture *c = (struct capture *) arg;
+    char *name = c->name;
+    u_int32_t blen = 0; // zero keeps the kernel's default length
+    u_int32_t next = 0;
+    int res = 0;
+
+    while(true) {
+        printVERBOSE("[%s] Going to open device.", name);
+        int fd = 0;
+        fd = open_dev();
+        if (fd < 0) {
+            printVERBOSE("unable to open dev for %s: %s", name, strerror(errno));
+            return stopCapture(c, ERR_OPEN);
+        }
+        c->fd = fd;
 
-    printVERBOSE("[%s] Going to open device.", name);
-    int fd = 0;
-    fd = open_dev();
-    if (fd < 0) {
-        printVERBOSE("unable to open dev for %s: %s", name, strerror(errno));
-        removeThread();
-        return (void *) ERR_OPEN; 
+        // the buffer length can only be set before the interface is attached
+        u_int32_t asked = blen;
+        if (blen > 0 && set_buffer_len(fd, &blen) < 0) {
+            printVERBOSE("unable to set buffer length for %s: %s", name, strerror(errno));
+        }
+
+        printVERBOSE("[%s] Going to set options for device.", name);
+        if (set_options(fd, name) < 0) {
+            printVERBOSE("unable to do set options for %s: %s\n", name, strerror(errno));
+            return stopCapture(c, ERR_OPTIONS);
+        }
+
+        printVERBOSE("[%s] Checking dlt.", name);
+        if (check_dlt(fd, name) < 0) {
+            return stopCapture(c, ERR_DLT);
+        }
+
+        // the session may have switched to exact counting before a reopen
+        c->sample = __atomic_load_n(&c->session->sample, __ATOMIC_ACQUIRE);
+        if (c->sample > 1 && set_sample_filter(fd, c->sample) < 0) {
+            printVERBOSE("unable to set the sampling filter for %s, counting every packet", name);
+            c->sample = 1;
+        }
+
+        if(ioctl(fd, BIOCGBLEN, &blen) < 0) {
+            blen = 0;
+        }
+        // before reading, so a clamped buffer counts as maxed when packets drop
+        next = next_buffer_len(c, asked, blen);
+
+        printVERBOSE("[%s] Reading packets start.", name);
+        res = read_packets(fd, c);
+        c->fd = -1;
+        close(fd);
+
+        if(res != ERR_DROPS || __atomic_load_n(&c->stop, __ATOMIC_ACQUIRE)) {
+            break;
+        }
+
+        if(next > 0) {
+            blen = next;
+            printVERBOSE("[%s] Kernel dropped packets, growing buffer to %u bytes.", name, blen);
+            continue;
+        }
+
+        fprintf(stderr, "[!] bpf for %s can't keep up at %u bytes, polling interface counters instead.\n", name, blen);
+        poll_counters(c);
+        break;
     }
 
-    printVERBOSE("[%s] Going to set options for device.", name);
-    if (set_options(fd, name) < 0) {
-        printVERBOSE("unable to do set options for %s: %s\n", name, strerror(errno));
-        removeThread();
-        return ( void *) ERR_OPTIONS;
+    printVERBOSE("done reading packets\n");
+    return stopCapture(c, ERR_READ);
+}
+
+/**
+ * Starts a `monitor` thread for a capture
+ * With an affinity tag the thread is created suspended so the tag is set
+ * before it first runs
+ * - parameter c: the capture, `c->thread` is set to the new thread
+ * - parameter tag: affinity tag for the thread, THREAD_AFFINITY_TAG_NULL for none
+ * - returns: 0 on success, otherwise error
+ */
+int start_monitor(struct capture *c, int tag) {
+    if(!c) return ERR_NULL;
+
+    if(tag == THREAD_AFFINITY_TAG_NULL) {
+        return pthread_create(&c->thread, NULL, monitor, (void *) c);
     }
 
-    printVERBOSE("[%s] Checking dlt.", name);
-    if (check_dlt(fd, name) < 0) {
-        removeThread();
-        return (void *) ERR_DLT;
+    int res = pthread_create_suspended_np(&c->thread, NULL, monitor, (void *) c);
+    if(res != 0) return res;
+
+    set_thread_affinity(c->thread, tag);
+    if(thread_resume(pthread_mach_thread_np(c->thread)) != KERN_SUCCESS) {
+        printERR("Failed to resume thread for %s.", c->name);
+        return ERR;
     }
+    return 0;
+}
 
-    printVERBOSE("[%s] Reading packets start.", name);
-    read_packets(fd, name);
+/**
+ * Sets a thread's affinity tag. Threads sharing a tag are scheduled on cores
+ * that share an L2 cache, threads with different tags are spread apart.
+ * This is a hint, macOS has no hard CPU pinning.
+ * - parameter thread: thread to tag
+ * - parameter tag: affinity tag
+ * - returns: 0 on success, otherwise error
+ */
+int set_thread_affinity(pthread_t thread, int tag) {
+    thread_affinity_policy_data_t policy = { tag };
 
-    printVERBOSE("done reading packets\n");
-    removeThread();
-    return (void *) ERR_READ;
+    kern_return_t kr = thread_policy_set(pthread_mach_thread_np(thread), THREAD_AFFINITY_POLICY,
+                                         (thread_policy_t) &policy, THREAD_AFFINITY_POLICY_COUNT);
+    if(kr != KERN_SUCCESS) {
+        printVERBOSE("Unable to set affinity tag %d (kern_return_t %d).", tag, kr);
+        return ERR;
+    }
+    printVERBOSE("Set affinity tag %d.", tag);
+    return 0;
+}
+
+/**
+ * Allocates a capture buffer. With `hugepages` the buffer is backed by
+ * superpages, falling back to regular pages where they aren't supported
+ * - parameter len: length of the buffer
+ * - parameter hugepages: true to use superpages
+ * - returns: the buffer, or NULL on failure
+ */
+void *capture_alloc(size_t len, int hugepages) {
+    if(!hugepages) {
+        return malloc(len);
+    }
+
+    size_t rounded = (len + SUPERPAGE_SIZE - 1) & ~((size_t) SUPERPAGE_SIZE - 1);
+    // for anonymous memory the fd argument carries the vm flags
+    void *buf = mmap(NULL, rounded, PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE,
+                     VM_FLAGS_SUPERPAGE_SIZE_2MB, 0);
+    if(buf == MAP_FAILED) {
+        printVERBOSE("Superpages unavailable, using regular pages: %s", strerror(errno));
+        buf = mmap(NULL, rounded, PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE, -1, 0);
+    }
+    return buf == MAP_FAILED ? NULL : buf;
+}
+
+/**
+ * Frees a buffer from `capture_alloc`
+ * - parameter buf: the buffer
+ * - parameter len: length the buffer was allocated with
+ * - parameter hugepages: what the buffer was allocated with
+ */
+void capture_free(void *buf, size_t len, int hugepages) {
+    if(!buf) return;
+
+    if(!hugepages) {
+        free(buf);
+        return;
+    }
+    munmap(buf, (len + SUPERPAGE_SIZE - 1) & ~((size_t) SUPERPAGE_SIZE - 1));
 }
 
 /**
@@ -311,60 +641,548 @@ int set_options(int fd, char *iface) {
     if(ioctl(fd, BIOCIMMEDIATE, &enable) < 0)
         return ERR_IMMEDIATE;
 
+    // an idle read returns empty after the timeout, so the thread sees `stop`
+    struct timeval timeout = {0, CAPTURE_WAKE_MSEC * 1000};
+    if(ioctl(fd, BIOCSRTIMEOUT, &timeout) < 0)
+        return ERR_OPTIONS;
+
+    return 0;
+}
+
+/**
+ * Sets the buffer length for reads on a bpf, must be called before `set_options`
+ * - parameter fd: file descriptor for the bpf
+ * - parameter blen: requested length, set to the length the kernel accepted
+ * - returns: 0 if success, othewise error
+ */
+int set_buffer_len(int fd, u_int32_t *blen) {
+    if(!blen) return ERR_NULL;
+
+    /*
+     * Sets the buffer length for reads on bpf files.  The buffer must be set before the
+     * file is attached to an interface with BIOCSETIF.  If the requested buffer size cannot
+     * be accommodated, the closest allowable size will be set and returned in the argument.
+     */
+    if(ioctl(fd, BIOCSBLEN, blen) < 0)
+        return ERR_BLEN;
+
+    return 0;
+}
+
+/**
+ * Builds a bpf program that passes 1 in n IPv4 packets, picked by the low
+ * bits of the IPv4 ID, and every other packet
+ * The ID is set by the sending host, so it varies even when the NIC fills in
+ * the checksum. Senders that leave it 0 on unfragmentable packets still put a
+ * valid checksum on them, so those are picked by the checksum instead.
+ * - parameter n: a power of two, 1 passes everything
+ * - parameter insns: SAMPLE_FILTER_LEN instructions, filled in
+ * - returns: the number of instructions used
+ */
+u_int sample_program(u_int32_t n, struct bpf_insn *insns) {
+    struct bpf_insn sample[SAMPLE_FILTER_LEN] = {
+        BPF_STMT(BPF_LD + BPF_H + BPF_ABS, 12),                 // ethertype
+        BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, ETHERTYPE_IP, 0, 5),
+        BPF_STMT(BPF_LD + BPF_H + BPF_ABS, ETHER_HDR_LEN + 4),  // IPv4 ID
+        BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, 0, 0, 1),
+        BPF_STMT(BPF_LD + BPF_H + BPF_ABS, ETHER_HDR_LEN + 10), // IPv4 header checksum
+        BPF_STMT(BPF_ALU + BPF_AND + BPF_K, n - 1),
+        BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, 0, 0, 1),
+        BPF_STMT(BPF_RET + BPF_K, (u_int) -1),
+        BPF_STMT(BPF_RET + BPF_K, 0),
+    };
+    struct bpf_insn all = BPF_STMT(BPF_RET + BPF_K, (u_int) -1);
+
+    if(n > 1) {
+        memcpy(insns, sample, sizeof(sample));
+        return SAMPLE_FILTER_LEN;
+    }
+    insns[0] = all;
+    return 1;
+}
+
+/**
+ * Sets the filter from `sample_program` on a bpf
+ * The kernel resets the bpf's counters and buffer when a filter is set
+ * - parameter fd: file descriptor for the bpf
+ * - parameter n: a power of two, 1 passes everything
+ * - returns: 0 on success, otherwise error
+ */
+int set_sample_filter(int fd, u_int32_t n) {
+    struct bpf_insn insns[SAMPLE_FILTER_LEN];
+    struct bpf_program program;
+    program.bf_len = sample_program(n, insns);
+    program.bf_insns = insns;
+
+    if(ioctl(fd, BIOCSETF, &program) < 0)
+        return ERR_OPTIONS;
     return 0;
 }
 
+/**
+ * Adds a frame's bytes to the source and destination MAC and IP address sketches
+ * - parameter c: the capture, with sketches
+ * - parameter frame: the ethernet frame
+ * - parameter caplen: bytes of the frame captured
+ * - parameter len: bytes of the frame on the wire, the amount added
+ */
+static void sketchFrame(struct capture *c, const u_char *frame, u_int32_t caplen, u_int32_t len) {
+    if(caplen < ETHER_HDR_LEN) return;
+    const struct ether_header *eh = (const struct ether_header *) frame;
+    struct sketch_key key = {SKETCH_MAC, ETHER_ADDR_LEN, {0}};
+
+    memcpy(key.addr, eh->ether_shost, ETHER_ADDR_LEN);
+    sketch_add(c->macs, &key, len);
+    memcpy(key.addr, eh->ether_dhost, ETHER_ADDR_LEN);
+    sketch_add(c->macs, &key, len);
+
+    // the addresses sit at fixed offsets, 12 and 16 in IPv4, 8 and 24 in IPv6
+    const u_char *l3 = frame + ETHER_HDR_LEN;
+    u_int16_t type = ntohs(eh->ether_type);
+    if(type == ETHERTYPE_IP && caplen >= ETHER_HDR_LEN + 20) {
+        key.type = SKETCH_IPV4;
+        key.len = 4;
+        memcpy(key.addr, l3 + 12, 4);
+        sketch_add(c->ips, &key, len);
+        memcpy(key.addr, l3 + 16, 4);
+        sketch_add(c->ips, &key, len);
+    } else if(type == ETHERTYPE_IPV6 && caplen >= ETHER_HDR_LEN + 40) {
+        key.type = SKETCH_IPV6;
+        key.len = 16;
+        memcpy(key.addr, l3 + 8, 16);
+        sketch_add(c->ips, &key, len);
+        memcpy(key.addr, l3 + 24, 16);
+        sketch_add(c->ips, &key, len);
+    }
+}
+
+/**
+ * Charges a frame to the prefix budget of its remote address
+ * Sent frames, from the interface's own MAC, are charged by destination and
+ * received ones by source. Without the MAC the destination is tried first
+ * - parameter c: the capture, with prefix budgets
+ * - parameter frame: the ethernet frame
+ * - parameter caplen: bytes of the frame captured
+ * - parameter bytes: the amount charged, the captured bytes scaled up for a sampled frame
+ */
+static void classifyFrame(struct capture *c, const u_char *frame, u_int32_t caplen, u_int64_t bytes) {
+    if(caplen < ETHER_HDR_LEN) return;
+    const struct ether_header *eh = (const struct ether_header *) frame;
+    const u_char *l3 = frame + ETHER_HDR_LEN;
+    const struct prefix_trie *trie;
+    const u_char *src, *dst;
+    int len;
+
+    u_int16_t type = ntohs(eh->ether_type);
+    if(type == ETHERTYPE_IP && caplen >= ETHER_HDR_LEN + 20) {
+        trie = &c->session->prefixes->v4;
+        src = l3 + 12;
+        dst = l3 + 16;
+        len = 4;
+    } else if(type == ETHERTYPE_IPV6 && caplen >= ETHER_HDR_LEN + 40) {
+        trie = &c->session->prefixes->v6;
+        src = l3 + 8;
+        dst = l3 + 24;
+        len = 16;
+    } else {
+        return;
+    }
+
+    int budget;
+    if(c->hasMac) {
+        int sent = memcmp(eh->ether_shost, c->mac, ETHER_ADDR_LEN) == 0;
+        budget = prefix_lookup(trie, sent ? dst : src, len);
+    } else {
+        budget = prefix_lookup(trie, dst, len);
+        if(budget < 0) budget = prefix_lookup(trie, src, len);
+    }
+    if(budget < 0) return;
+
+    if(c->prefixBytes[budget] == 0) {
+        c->touched[c->touchedCount++] = budget;
+    }
+    c->prefixBytes[budget] += bytes;
+}
+
+/**
+ * What one pass of a pipeline over a read found
+ */
+struct batch {
+    struct bpf_hdr *last;           // the last record's header, or NULL
+    u_int64_t packets;              // not counting duplicates
+    u_int64_t bytes;                // captured bytes of those packets
+    u_int64_t counted;              // with sampled packets scaled up
+    u_int64_t sent;                 // of counted, from the interface's own MAC
+    u_int64_t duplicates;
+    u_int64_t sampledPackets;       // IPv4 packets that stand for c->sample each
+    u_int64_t sampledSquares;       // the sum of their squared sizes
+};
+
+/**
+ * Runs the stages of the processing pipeline over every record of a read
+ * Always inlined into the specialized pipelines below, where `stages` is a
+ * constant so the stages left out, and their branches, compile away. With
+ * no stages the loop only sums lengths and never touches a frame
+ * - parameter c: the capture
+ * - parameter buf: the bpf records returned by read
+ * - parameter n: bytes in buf
+ * - parameter lastStamp: the previous packet's time in usec for the gap histogram, updated
+ * - parameter b: set to what the read held
+ * - parameter stages: the PIPELINE_* stages to run
+ */
+static inline __attribute__((always_inline))
+void runPipeline(struct capture *c, char *buf, ssize_t n, u_int64_t *lastStamp, struct batch *b, u_int32_t stages) {
+    struct dedup *dedup = c->session->dedup;
+    u_int64_t packets = 0, bytes = 0, counted = 0, sent = 0, duplicates = 0;
+    u_int64_t sampledPackets = 0, sampledSquares = 0;
+    struct bpf_hdr *bh = NULL;
+
+    for(char *p = buf; p < buf + n; p += BPF_WORDALIGN(bh->bh_hdrlen + bh->bh_caplen)) {
+        bh = (struct bpf_hdr *)p;
+        u_char *frame = (u_char *) p + bh->bh_hdrlen;
+        u_int32_t caplen = bh->bh_caplen;
+
+        // a packet already counted on another interface is skipped entirely
+        if((stages & PIPELINE_DEDUP) && dedup_seen(dedup, frame, caplen, bh->bh_datalen,
+                                        (u_int64_t) bh->bh_tstamp.tv_sec * 1000000 + bh->bh_tstamp.tv_usec)) {
+            duplicates++;
+            continue;
+        }
+        packets++;
+        bytes += caplen;
+
+        // while sampling, an IPv4 packet the filter passed stands for c->sample of them
+        u_int32_t weight = 1;
+        if((stages & PIPELINE_SAMPLE) && caplen >= ETHER_HDR_LEN &&
+           ((struct ether_header *) frame)->ether_type == htons(ETHERTYPE_IP)) {
+            weight = c->sample;
+            sampledPackets++;
+            sampledSquares += (u_int64_t) caplen * caplen;
+        }
+        counted += (u_int64_t) caplen * weight;
+
+        if((stages & PIPELINE_DIRECTION) && caplen >= ETHER_HDR_LEN &&
+           memcmp(((struct ether_header *) frame)->ether_shost, c->mac, ETHER_ADDR_LEN) == 0) {
+            sent += (u_int64_t) caplen * weight;
+        }
+        if(stages & PIPELINE_HISTOGRAMS) {
+            u_int64_t stamp = (u_int64_t) bh->bh_tstamp.tv_sec * 1000000 + bh->bh_tstamp.tv_usec;
+            histogram_record(c->sizes, bh->bh_datalen);
+            histogram_record(c->gaps, stamp > *lastStamp ? stamp - *lastStamp : 0);
+            histogram_record(c->latency, c->readUsec > stamp ? c->readUsec - stamp : 0);
+            *lastStamp = stamp;
+        }
+        if(stages & PIPELINE_TOP) {
+            sketchFrame(c, frame, caplen, bh->bh_datalen * weight);
+        }
+        if(stages & PIPELINE_BUDGETS) {
+            classifyFrame(c, frame, caplen, (u_int64_t) caplen * weight);
+        }
+        if(stages & PIPELINE_DUMP) {
+            struct ether_header *eh = (struct ether_header *) frame;
+            printVERBOSE("%s: %02x:%02x:%02x:%02x:%02x:%02x -> "
+                    "%02x:%02x:%02x:%02x:%02x:%02x "
+                    "[type=%u] [len=%u/%u]",
+                    c->name,
+                    eh->ether_shost[0], eh->ether_shost[1], eh->ether_shost[2],
+                    eh->ether_shost[3], eh->ether_shost[4], eh->ether_shost[5],
+
+                    eh->ether_dhost[0], eh->ether_dhost[1], eh->ether_dhost[2],
+                    eh->ether_dhost[3], eh->ether_dhost[4], eh->ether_dhost[5],
+
+                    eh->ether_type, bh->bh_datalen, caplen);
+        }
+    }
+
+    b->last = bh;
+    b->packets = packets;
+    b->bytes = bytes;
+    b->counted = counted;
+    b->sent = sent;
+    b->duplicates = duplicates;
+    b->sampledPackets = sampledPackets;
+    b->sampledSquares = sampledSquares;
+}
+
+typedef void (*pipeline_fn)(struct capture *c, char *buf, ssize_t n, u_int64_t *lastStamp, struct batch *b);
+
+/*
+ * One pipeline per combination of the specialized stages, named by their
+ * bits from PIPELINE_DEDUP down to PIPELINE_DIRECTION, e.g. pipeline_000000
+ * only counts and pipeline_001001 keeps histograms and directions
+ */
+#define PIPELINE(bits) \
+    static void pipeline_##bits(struct capture *c, char *buf, ssize_t n, u_int64_t *lastStamp, struct batch *b) { \
+        runPipeline(c, buf, n, lastStamp, b, 0b##bits); \
+    }
+#define PIPELINES_1(bits) PIPELINE(bits##0) PIPELINE(bits##1)
+#define PIPELINES_2(bits) PIPELINES_1(bits##0) PIPELINES_1(bits##1)
+#define PIPELINES_3(bits) PIPELINES_2(bits##0) PIPELINES_2(bits##1)
+#define PIPELINES_4(bits) PIPELINES_3(bits##0) PIPELINES_3(bits##1)
+#define PIPELINES_5(bits) PIPELINES_4(bits##0) PIPELINES_4(bits##1)
+#define PIPELINES_6() PIPELINES_5(0) PIPELINES_5(1)
+PIPELINES_6()
+
+#define PIPELINE_ENTRY(bits) pipeline_##bits,
+#define PIPELINE_ENTRIES_1(bits) PIPELINE_ENTRY(bits##0) PIPELINE_ENTRY(bits##1)
+#define PIPELINE_ENTRIES_2(bits) PIPELINE_ENTRIES_1(bits##0) PIPELINE_ENTRIES_1(bits##1)
+#define PIPELINE_ENTRIES_3(bits) PIPELINE_ENTRIES_2(bits##0) PIPELINE_ENTRIES_2(bits##1)
+#define PIPELINE_ENTRIES_4(bits) PIPELINE_ENTRIES_3(bits##0) PIPELINE_ENTRIES_3(bits##1)
+#define PIPELINE_ENTRIES_5(bits) PIPELINE_ENTRIES_4(bits##0) PIPELINE_ENTRIES_4(bits##1)
+
+// indexed by the stages, in binary order
+static const pipeline_fn pipelines[PIPELINE_SPECIALIZED + 1] = {
+    PIPELINE_ENTRIES_5(0) PIPELINE_ENTRIES_5(1)
+};
+
+/**
+ * - parameter c: the capture
+ * - returns: the PIPELINE_* stages a read on the capture needs right now,
+ *   sampling stops once the session counts exactly
+ */
+u_int32_t pipeline_stages(struct capture *c) {
+    u_int32_t stages = 0;
+    if(c->session->dedup) stages |= PIPELINE_DEDUP;
+    if(c->sample > 1) stages |= PIPELINE_SAMPLE;
+    if(c->sizes) stages |= PIPELINE_HISTOGRAMS;
+    if(c->macs) stages |= PIPELINE_TOP;
+    if(c->prefixBytes) stages |= PIPELINE_BUDGETS;
+    if(c->hasMac && __atomic_load_n(&c->session->directions, __ATOMIC_RELAXED)) stages |= PIPELINE_DIRECTION;
+    if(verbose_flag) stages |= PIPELINE_DUMP;
+    return stages;
+}
+
+/**
+ * Parses and counts the packets of one read through the pipeline
+ * specialized for the stages the capture needs: the duplicate filter,
+ * sampling, directions, histograms, top talkers, prefix budgets and the
+ * verbose dump. Then adds to the capture's and session's totals, the
+ * shared memory entry and the metrics
+ * - parameter c: the capture
+ * - parameter buf: the bpf records returned by read
+ * - parameter n: bytes in buf
+ * - parameter packets: packets handled so far, incremented
+ * - parameter bytes: bytes counted so far, sampled packets scaled up, incremented
+ * - parameter lastStamp: the previous packet's time in usec for the gap histogram, updated
+ * - returns: the last record's header, or NULL if there were none
+ */
+struct bpf_hdr *process_packets(struct capture *c, char *buf, ssize_t n,
+                                u_int64_t *packets, u_int64_t *bytes, u_int64_t *lastStamp) {
+    netman_session *session = c->session;
+    struct capture_metrics *m = &c->metrics;
+    struct batch b;
+    u_int32_t stages = pipeline_stages(c);
+
+    if((stages & PIPELINE_HISTOGRAMS) && *lastStamp == 0 && n > 0) {
+        struct bpf_hdr *first = (struct bpf_hdr *)buf;
+        *lastStamp = (u_int64_t) first->bh_tstamp.tv_sec * 1000000 + first->bh_tstamp.tv_usec;
+    }
+
+    // the sketches are locked once per read, not per packet
+    if(stages & PIPELINE_TOP) pthread_mutex_lock(&c->sketchMutex);
+    if(stages & PIPELINE_DUMP) {
+        // printing costs more than any specializing saves
+        runPipeline(c, buf, n, lastStamp, &b, stages);
+    } else {
+        pipelines[stages](c, buf, n, lastStamp, &b);
+    }
+    if(stages & PIPELINE_TOP) pthread_mutex_unlock(&c->sketchMutex);
+
+    if(stages & PIPELINE_BUDGETS) prefix_count(c);
+    capture_count(c, b.counted);
+    if(stages & PIPELINE_DIRECTION) {
+        direction_count(session, c, b.counted - b.sent, b.sent);
+    } else {
+        direction_count(session, c, b.counted, 0);
+    }
+    if(b.sampledPackets) sample_count(c, b.sampledPackets, b.sampledSquares);
+    netstats_add(c->stats, b.counted, b.packets, 0);
+
+    metricAdd(&m->packets, b.packets);
+    metricAdd(&m->bytes, b.bytes);
+    metricAdd(&m->batches, 1);
+    if(b.duplicates) metricAdd(&m->duplicates, b.duplicates);
+    *packets += b.packets;
+    *bytes += b.counted;
+    return b.last;
+}
+
+/**
+ * Reads a non-blocking descriptor, spinning while it is empty and blocking
+ * in poll once it has been empty for `spinUsec`
+ * - parameter fd: the descriptor, e.g. a bpf, non-blocking
+ * - parameter spinUsec: how long to spin before blocking
+ * - returns: what read returned, 0 if nothing arrived for CAPTURE_WAKE_MSEC of blocking
+ */
+ssize_t spin_read(int fd, char *buf, size_t blen, u_int32_t spinUsec) {
+    u_int64_t until = monotonicNsec() + spinUsec * 1000ull;
+    while(true) {
+        ssize_t n = read(fd, buf, blen);
+        if(n >= 0 || (errno != EAGAIN && errno != EINTR)) return n;
+
+        if(monotonicNsec() >= until) {
+            struct pollfd pfd = {fd, POLLIN, 0};
+            int ready = poll(&pfd, 1, CAPTURE_WAKE_MSEC);
+            if(ready < 0 && errno != EINTR) return -1;
+            if(ready == 0) return 0;
+            until = monotonicNsec() + spinUsec * 1000ull;
+        }
+    }
+}
+
 /**
  * reads the bpf device for the specified interface 
+ * Bytes are added to the session once per read, not per packet.
+ * Kernel drops are checked about once a second; dropped packets are
+ * charged at the average captured size so the limit errs on the safe side
  * - parameter fd: file descriptor for the bpf
- * - parameter iface: network interface name
+ * - parameter c: the capture reading the bpf, its stats entry is published after each read
+ * - returns: ERR_DROPS if the bpf should be reopened with a bigger buffer, otherwise error
  */
-int read_packets(int fd, char *iface) {
-    if(!iface) return ERR_NULL;
+int read_packets(int fd, struct capture *c) {
+    if(!c) return ERR_NULL;
+    char *iface = c->name;
+    netman_session *session = c->session;
     char *buf = NULL;
-    char *p = NULL;
     size_t blen = 0;
     ssize_t n = 0;
     struct bpf_hdr *bh = NULL;
-    struct ether_header *eh = NULL;
+    struct bpf_stat stat;
+    u_int32_t lastRecv = 0, lastDrop = 0;
+    int32_t lastCheck = 0;
+    u_int64_t packets = 0, bytes = 0; // captured since the last drop check
+    u_int64_t lastStamp = 0;          // previous packet's time in usec, for the gap histogram
 
     // Returns the required buffer length for reads on bpf files.
     if(ioctl(fd, BIOCGBLEN, &blen) < 0)
         return ERR_BLEN;
 
-    buf = malloc(blen);
+    buf = capture_alloc(blen, session->hugepages);
     if(!buf) return ERR_ALLOC;
 
+    int enable = 1;
+    u_int32_t spinUsec = session->busyPollUsec;
+    if(spinUsec > 0 && ioctl(fd, FIONBIO, &enable) < 0) {
+        printVERBOSE("%s: unable to busy poll, blocking on reads", iface);
+        spinUsec = 0;
+    }
+
     printVERBOSE("Reading packets for \'%s\'...", iface);
 
-    while(true) {
-        memset(buf, '\0', blen);
+    struct capture_metrics *m = &c->metrics;
+    u_int64_t readStart = monotonicNsec();
+    while(!__atomic_load_n(&c->stop, __ATOMIC_ACQUIRE)) {
+        // only the n bytes read are parsed, so the buffer isn't cleared between reads
+        n = spinUsec > 0 ? spin_read(fd, buf, blen, spinUsec) : read(fd, buf, blen);
 
-        n = read(fd, buf, blen);
+        // an empty read timed out, see `set_options`
+        if (n == 0) {
+            continue;
+        }
+        if (n < 0) {
+            break;
+        }
+        u_int64_t readEnd = monotonicNsec();
+        metricAdd(&m->readNsec, readEnd - readStart);
+        if(c->latency) {
+            struct timespec now;
+            clock_gettime(CLOCK_REALTIME, &now);
+            c->readUsec = (u_int64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+        }
 
-        if (n <= 0)
-            return ERR_READ;
+        bh = process_packets(c, buf, n, &packets, &bytes, &lastStamp);
 
-        p = buf;
-        while (p < buf + n) {
-            bh = (struct bpf_hdr *)p;
-            bytesRead += bh->bh_caplen;
+        readStart = monotonicNsec();
+        metricAdd(&m->processNsec, readStart - readEnd);
 
-            eh = (struct ether_header *)(p + bh->bh_hdrlen);
+        // the limit is near, count every packet from here on
+        u_int32_t sample = __atomic_load_n(&session->sample, __ATOMIC_ACQUIRE);
+        if(sample != c->sample && set_sample_filter(fd, sample) == 0) {
+            printVERBOSE("%s: counting every packet", iface);
+            c->sample = sample;
+            // setting a filter resets the kernel's counters
+            lastRecv = 0;
+            lastDrop = 0;
+        }
 
-            printVERBOSE("%s: %02x:%02x:%02x:%02x:%02x:%02x -> "
-                    "%02x:%02x:%02x:%02x:%02x:%02x "
-                    "[type=%u] [len=%u/%u (%llu)]", 
-                    iface,
-                    eh->ether_shost[0], eh->ether_shost[1], eh->ether_shost[2],
-                    eh->ether_shost[3], eh->ether_shost[4], eh->ether_shost[5],
+        // check for drops once a second, using the packet clock so
+        // this costs nothing until a second has passed
+        if(bh == NULL || bh->bh_tstamp.tv_sec == lastCheck) {
+            continue;
+        }
+        lastCheck = bh->bh_tstamp.tv_sec;
+        __atomic_store_n(&m->cpuNsec, threadCpuNsec(), __ATOMIC_RELAXED);
 
-                    eh->ether_dhost[0], eh->ether_dhost[1], eh->ether_dhost[2],
-                    eh->ether_dhost[3], eh->ether_dhost[4], eh->ether_dhost[5],
+        // Returns the number of packets received and dropped by the filter.
+        if(ioctl(fd, BIOCGSTATS, &stat) < 0) {
+            continue;
+        }
+
+        u_int32_t drops = stat.bs_drop - lastDrop;
+        u_int32_t recv = stat.bs_recv - lastRecv;
+        lastDrop = stat.bs_drop;
+        lastRecv = stat.bs_recv;
 
-                    eh->ether_type, bh->bh_datalen, bh->bh_caplen, bytesRead);
+        if(drops > 0) {
+            __atomic_add_fetch(&session->drops, drops, __ATOMIC_RELAXED);
+            metricAdd(&m->drops, drops);
+            netstats_add(c->stats, 0, 0, drops);
+            if(packets > 0) {
+                // split between directions like what the capture counted so far
+                u_int64_t dropped = drops * (bytes / packets);
+                u_int64_t rx = c->rxBytes, tx = c->txBytes;
+                u_int64_t sent = rx + tx > 0 ? (u_int64_t) ((double) dropped * tx / (rx + tx)) : 0;
+                capture_count(c, dropped);
+                direction_count(session, c, dropped - sent, sent);
+            }
+            printVERBOSE("%s: kernel dropped %u of %u packets (%zu byte buffer)", iface, drops, recv, blen);
 
-            p += BPF_WORDALIGN(bh->bh_hdrlen + bh->bh_caplen);
+            // grow the buffer, or give up if it is maxed and more than 1% is lost
+            if(blen < c->bufferMax || (u_int64_t) drops * 100 > recv) {
+                n = ERR_DROPS;
+                break;
+            }
         }
+        packets = 0;
+        bytes = 0;
+    }
+
+    capture_free(buf, blen, session->hugepages);
+    return n == ERR_DROPS ? ERR_DROPS : ERR_READ;
+}
+
+/**
+ * Counts an interface's bytes by polling its counters every COUNTER_POLL_USEC,
+ * for when a bpf can't keep up. Counts every byte on the interface, not just
+ * the ones a bpf would see, and only returns on error or once the capture's `stop` is set
+ * - parameter c: the capture for the interface
+ * - returns: error
+ */
+int poll_counters(struct capture *c) {
+    if(!c) return ERR_NULL;
+    char *iface = c->name;
+    u_long ibytes = 0, obytes = 0;
+    u_int32_t lastIn = 0, lastOut = 0;
+
+    if(interfaceBytes(iface, &ibytes, &obytes) < 0)
+        return ERR_READ;
+    lastIn = ibytes;
+    lastOut = obytes;
+
+    while(!__atomic_load_n(&c->stop, __ATOMIC_ACQUIRE)) {
+        usleep(COUNTER_POLL_USEC);
+
+        if(interfaceBytes(iface, &ibytes, &obytes) < 0)
+            return ERR_READ;
+
+        // the counters are 32 bits wide, unsigned math handles the wrap
+        u_int64_t rx = (u_int32_t) (ibytes - lastIn), tx = (u_int32_t) (obytes - lastOut);
+        u_int64_t delta = rx + tx;
+        capture_count(c, delta);
+        direction_count(c->session, c, rx, tx);
+        netstats_add(c->stats, delta, 0, 0);
+        lastIn = ibytes;
+        lastOut = obytes;
     }
-}
\ No newline at end of file
+    return ERR_READ;
+}
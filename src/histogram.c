@@ -0,0 +1,82 @@
+#include "histogram.h"
+
+/**
+ * - returns: how many low bits a bucket ignores
+ */
+static u_int32_t bucketShift(u_int32_t bucket) {
+	if(bucket < (2u << HIST_SUB_BITS)) return 0;
+	return (bucket >> HIST_SUB_BITS) - 1;
+}
+
+/**
+ * - returns: the smallest value that lands in a bucket
+ */
+u_int64_t histogram_lower(u_int32_t bucket) {
+	u_int32_t shift = bucketShift(bucket);
+	return (u_int64_t) (bucket - (shift << HIST_SUB_BITS)) << shift;
+}
+
+/**
+ * - returns: the largest value that lands in a bucket
+ */
+u_int64_t histogram_upper(u_int32_t bucket) {
+	return histogram_lower(bucket) + ((1ull << bucketShift(bucket)) - 1);
+}
+
+/**
+ * Copies a histogram that another thread may be recording into
+ * The copy's count is the sum of its buckets so it is self consistent
+ * - parameter h: the histogram
+ * - parameter copy: set to the snapshot
+ */
+void histogram_snapshot(const struct histogram *h, struct histogram *copy) {
+	copy->count = 0;
+	copy->sum = __atomic_load_n(&h->sum, __ATOMIC_RELAXED);
+	for(u_int32_t i = 0; i < HIST_BUCKETS; i++) {
+		copy->buckets[i] = __atomic_load_n(&h->buckets[i], __ATOMIC_RELAXED);
+		copy->count += copy->buckets[i];
+	}
+}
+
+/**
+ * - parameter percentile: from 0 to 100
+ * - returns: the upper bound of the bucket holding the percentile, 0 if empty
+ */
+u_int64_t histogram_percentile(const struct histogram *h, double percentile) {
+	if(h->count == 0) return 0;
+
+	u_int64_t rank = (u_int64_t) (h->count * percentile / 100.0);
+	if(rank >= h->count) rank = h->count - 1;
+
+	u_int64_t seen = 0;
+	for(u_int32_t i = 0; i < HIST_BUCKETS; i++) {
+		seen += h->buckets[i];
+		if(seen > rank) return histogram_upper(i);
+	}
+	return 0;
+}
+
+/**
+ * Prints a summary line then every non-empty bucket
+ * - parameter out: stream to print to
+ * - parameter name: label for the histogram
+ * - parameter unit: unit of the values
+ * - parameter h: the histogram, should be a snapshot
+ */
+void histogram_print(FILE *out, const char *name, const char *unit, const struct histogram *h) {
+	fprintf(out, "%s (%s): count %llu mean %llu p50 %llu p90 %llu p99 %llu max %llu\n",
+		name, unit, (unsigned long long) h->count,
+		(unsigned long long) (h->count ? h->sum / h->count : 0),
+		(unsigned long long) histogram_percentile(h, 50),
+		(unsigned long long) histogram_percentile(h, 90),
+		(unsigned long long) histogram_percentile(h, 99),
+		(unsigned long long) histogram_percentile(h, 100));
+
+	for(u_int32_t i = 0; i < HIST_BUCKETS; i++) {
+		if(h->buckets[i] == 0) continue;
+		fprintf(out, "  [%llu, %llu] %llu\n",
+			(unsigned long long) histogram_lower(i),
+			(unsigned long long) histogram_upper(i),
+			(unsigned long long) h->buckets[i]);
+	}
+}
@@ -0,0 +1,315 @@
+#include "errorcodes.h"
+#include "history.h"
+
+#include <fcntl.h> // open
+#include <stdlib.h> // calloc
+#include <string.h> // memset
+#include <unistd.h> // pwrite
+#include <sys/mman.h> // mmap
+#include <sys/stat.h> // fstat
+
+// the longest tick: its time, its entry count and every series
+#define TICK_MAX (20 + HISTORY_MAX_SERIES * 20)
+
+/**
+ * writes an unsigned LEB128 varint
+ * - returns: the number of bytes written, at most 10
+ */
+static int putVarint(u_int8_t *out, u_int64_t value) {
+	int n = 0;
+	while(value >= 0x80) {
+		out[n++] = (u_int8_t) (value | 0x80);
+		value >>= 7;
+	}
+	out[n++] = (u_int8_t) value;
+	return n;
+}
+
+/**
+ * reads an unsigned LEB128 varint
+ * - returns: the number of bytes read, or -1 if it runs past `end`
+ */
+static int getVarint(const u_int8_t *in, const u_int8_t *end, u_int64_t *value) {
+	u_int64_t result = 0;
+	for(int n = 0; n < 10 && in + n < end; n++) {
+		result |= (u_int64_t) (in[n] & 0x7f) << (7 * n);
+		if((in[n] & 0x80) == 0) {
+			*value = result;
+			return n + 1;
+		}
+	}
+	return -1;
+}
+
+/**
+ * - returns: the payload of a block
+ */
+static u_int8_t *payload(struct history_block *block) {
+	return (u_int8_t *) (block + 1);
+}
+
+/**
+ * - returns: the time of the last tick in a block
+ */
+static u_int64_t lastTickIn(struct history_block *block) {
+	u_int64_t time = block->start;
+	u_int8_t *p = payload(block);
+	u_int8_t *end = p + block->used;
+	u_int64_t dt, entries, value;
+
+	for(u_int32_t t = 0; t < block->ticks && p < end; t++) {
+		int n = getVarint(p, end, &dt);
+		if(n < 0) break;
+		p += n;
+		time += dt;
+
+		n = getVarint(p, end, &entries);
+		if(n < 0) break;
+		p += n;
+		for(u_int64_t e = 0; e < entries * 2 && n > 0; e++) {
+			n = getVarint(p, end, &value);
+			p += n;
+		}
+	}
+	return time;
+}
+
+/**
+ * Opens a history file for appending, creating it if needed
+ * - parameter path: path of the file
+ * - parameter resolution: seconds between ticks for a new file, an existing file keeps its own
+ * - returns: the history, or NULL on failure
+ */
+struct history *history_open(const char *path, u_int32_t resolution) {
+	if(!path) return NULL;
+
+	struct history *h = calloc(1, sizeof(struct history));
+	if(!h) return NULL;
+	h->block = calloc(1, HISTORY_BLOCK_SIZE);
+	h->fd = open(path, O_RDWR | O_CREAT, 0644);
+
+	struct stat st;
+	if(!h->block || h->fd < 0 || fstat(h->fd, &st) < 0) {
+		history_close(h);
+		return NULL;
+	}
+
+	if(st.st_size == 0) {
+		h->header.magic = HISTORY_MAGIC;
+		h->header.version = HISTORY_VERSION;
+		h->header.blockSize = HISTORY_BLOCK_SIZE;
+		h->header.resolution = resolution > 0 ? resolution : HISTORY_DEFAULT_RESOLUTION;
+		if(pwrite(h->fd, &h->header, sizeof(h->header), 0) != sizeof(h->header)) {
+			history_close(h);
+			return NULL;
+		}
+		h->blockIndex = 1;
+		return h;
+	}
+
+	if(pread(h->fd, &h->header, sizeof(h->header), 0) != sizeof(h->header) ||
+	   h->header.magic != HISTORY_MAGIC || h->header.version != HISTORY_VERSION ||
+	   h->header.blockSize != HISTORY_BLOCK_SIZE || h->header.seriesCount > HISTORY_MAX_SERIES) {
+		history_close(h);
+		return NULL;
+	}
+
+	// continue the last block, `used` only counts ticks that were fully written
+	u_int64_t blocks = (st.st_size - 1) / HISTORY_BLOCK_SIZE;
+	h->blockIndex = blocks > 0 ? blocks : 1;
+	if(blocks > 0 && pread(h->fd, h->block, HISTORY_BLOCK_SIZE, h->blockIndex * HISTORY_BLOCK_SIZE) >= (ssize_t) sizeof(struct history_block)) {
+		if(h->block->used > HISTORY_PAYLOAD) {
+			h->block->used = HISTORY_PAYLOAD;
+		}
+		h->lastTick = lastTickIn(h->block);
+	} else {
+		memset(h->block, 0, HISTORY_BLOCK_SIZE);
+	}
+	return h;
+}
+
+/**
+ * - parameter h: history from `history_open`
+ */
+void history_close(struct history *h) {
+	if(!h) return;
+	if(h->fd >= 0) {
+		fsync(h->fd);
+		close(h->fd);
+	}
+	free(h->block);
+	free(h);
+}
+
+/**
+ * Finds or adds a series
+ * - parameter name: name of the series, e.g. an interface
+ * - returns: the series id, otherwise error
+ */
+int history_series(struct history *h, const char *name) {
+	if(!h || !name) return ERR_NULL;
+
+	for(u_int32_t i = 0; i < h->header.seriesCount; i++) {
+		if(strncmp(h->header.series[i], name, HISTORY_NAME_LEN) == 0) return i;
+	}
+	if(h->header.seriesCount >= HISTORY_MAX_SERIES) return ERR_ALLOC;
+
+	u_int32_t id = h->header.seriesCount;
+	strncpy(h->header.series[id], name, HISTORY_NAME_LEN - 1);
+	h->header.seriesCount++;
+	if(pwrite(h->fd, &h->header, sizeof(h->header), 0) != sizeof(h->header)) {
+		h->header.seriesCount--;
+		return ERR_OPEN;
+	}
+	return id;
+}
+
+/**
+ * Appends one tick, starting a new block when the current one is full
+ * The tick's bytes are written before the block header that counts them,
+ * so a crash loses at most the tick being written
+ * - parameter now: time of the tick, earlier than the last tick counts as the last tick
+ * - parameter series: ids from `history_series`
+ * - parameter bytes: bytes each series moved since the last tick
+ * - parameter count: number of entries
+ * - returns: 0 on success, otherwise error
+ */
+int history_append(struct history *h, time_t now, const int *series, const u_int64_t *bytes, int count) {
+	if(!h || (count > 0 && (!series || !bytes))) return ERR_NULL;
+	if(count < 0 || count > HISTORY_MAX_SERIES) return ERR_OPTIONS;
+
+	u_int64_t time = (u_int64_t) now > h->lastTick ? (u_int64_t) now : h->lastTick;
+	if(h->block->ticks == 0) {
+		h->block->start = time;
+	}
+
+	u_int8_t tick[TICK_MAX];
+	int len = 0;
+	for(int attempt = 0; attempt < 2; attempt++) {
+		len = putVarint(tick, h->block->ticks ? time - h->lastTick : time - h->block->start);
+		len += putVarint(tick + len, count);
+		for(int i = 0; i < count; i++) {
+			len += putVarint(tick + len, series[i]);
+			len += putVarint(tick + len, bytes[i]);
+		}
+		if(h->block->used + len <= HISTORY_PAYLOAD) break;
+
+		// the block is full, start the next one at this tick
+		h->blockIndex++;
+		memset(h->block, 0, HISTORY_BLOCK_SIZE);
+		h->block->start = time;
+	}
+
+	off_t offset = h->blockIndex * HISTORY_BLOCK_SIZE;
+	if(pwrite(h->fd, tick, len, offset + sizeof(struct history_block) + h->block->used) != len) {
+		return ERR_OPEN;
+	}
+	memcpy(payload(h->block) + h->block->used, tick, len);
+	h->block->used += len;
+	h->block->ticks++;
+	h->lastTick = time;
+
+	if(pwrite(h->fd, h->block, sizeof(struct history_block), offset) != sizeof(struct history_block)) {
+		return ERR_OPEN;
+	}
+	return 0;
+}
+
+/**
+ * Totals the bytes each series moved in (since, until], reading only the
+ * blocks that cover the range
+ * - parameter path: path of the file
+ * - parameter since: start of the range, exclusive
+ * - parameter until: end of the range, inclusive
+ * - parameter cb: called once per series with its total
+ * - parameter ctx: passed to `cb`
+ * - returns: 0 on success, otherwise error
+ */
+int history_query(const char *path, time_t since, time_t until, history_total_cb cb, void *ctx) {
+	if(!path || !cb) return ERR_NULL;
+
+	int fd = open(path, O_RDONLY);
+	if(fd < 0) return ERR_OPEN;
+
+	struct stat st;
+	if(fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(struct history_header)) {
+		close(fd);
+		return ERR_READ;
+	}
+
+	u_int8_t *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED) return ERR_ALLOC;
+
+	const struct history_header *header = (const struct history_header *) map;
+	if(header->magic != HISTORY_MAGIC || header->version != HISTORY_VERSION ||
+	   header->blockSize != HISTORY_BLOCK_SIZE || header->seriesCount > HISTORY_MAX_SERIES) {
+		munmap(map, st.st_size);
+		return ERR_READ;
+	}
+
+	// only blocks with a whole header count
+	u_int64_t blocks = 0;
+	if(st.st_size >= HISTORY_BLOCK_SIZE + (off_t) sizeof(struct history_block)) {
+		blocks = (st.st_size - HISTORY_BLOCK_SIZE - sizeof(struct history_block)) / HISTORY_BLOCK_SIZE + 1;
+	}
+	#define BLOCK(i) ((struct history_block *) (map + ((i) + 1) * HISTORY_BLOCK_SIZE))
+
+	// find the first block starting after `since`, the one before it may hold ticks in range
+	u_int64_t lo = 0, hi = blocks;
+	while(lo < hi) {
+		u_int64_t mid = lo + (hi - lo) / 2;
+		if(BLOCK(mid)->start <= (u_int64_t) since) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	u_int64_t totals[HISTORY_MAX_SERIES] = {0};
+	for(u_int64_t b = lo > 0 ? lo - 1 : 0; b < blocks; b++) {
+		struct history_block *block = BLOCK(b);
+		if(block->start > (u_int64_t) until) break;
+
+		u_int8_t *p = payload(block);
+		u_int8_t *end = p + (block->used < HISTORY_PAYLOAD ? block->used : HISTORY_PAYLOAD);
+		if(end > map + st.st_size) end = map + st.st_size;
+
+		u_int64_t time = block->start;
+		u_int64_t dt, entries, series, bytes;
+		for(u_int32_t t = 0; t < block->ticks; t++) {
+			int n = getVarint(p, end, &dt);
+			if(n < 0) break;
+			p += n;
+			time += dt;
+			if(time > (u_int64_t) until) break;
+
+			n = getVarint(p, end, &entries);
+			if(n < 0) break;
+			p += n;
+			for(u_int64_t e = 0; e < entries && n > 0; e++) {
+				n = getVarint(p, end, &series);
+				if(n < 0) break;
+				p += n;
+				n = getVarint(p, end, &bytes);
+				if(n < 0) break;
+				p += n;
+				if(time > (u_int64_t) since && series < header->seriesCount) {
+					totals[series] += bytes;
+				}
+			}
+			if(n < 0) break;
+		}
+	}
+	#undef BLOCK
+
+	for(u_int32_t i = 0; i < header->seriesCount; i++) {
+		char name[HISTORY_NAME_LEN];
+		strncpy(name, header->series[i], HISTORY_NAME_LEN - 1);
+		name[HISTORY_NAME_LEN - 1] = '\0';
+		cb(name, totals[i], ctx);
+	}
+
+	munmap(map, st.st_size);
+	return 0;
+}
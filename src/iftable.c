@@ -0,0 +1,192 @@
+#include "general.h"
+#include "iftable.h"
+
+/**
+ * - returns: an empty table, fill it with `iftable_refresh`, or NULL
+ */
+struct iftable *iftable_create(void) {
+	return calloc(1, sizeof(struct iftable));
+}
+
+/**
+ * - parameter t: table from `iftable_create`
+ */
+void iftable_free(struct iftable *t) {
+	if(!t) return;
+	free(t->arena);
+	free(t->buf);
+	free(t);
+}
+
+/**
+ * Keeps only one interface on later loads. It always has a row, with zeroed
+ * counters if the kernel doesn't list it, so callers report it instead of
+ * silently skipping it
+ * - parameter name: name of the interface, NULL or empty for every one
+ * - returns: 0 on success, otherwise error
+ */
+int iftable_only(struct iftable *t, const char *name) {
+	if(!t) return ERR_NULL;
+	if(name && strnlen(name, IFNAMSIZ) == IFNAMSIZ) return ERR_NOIF;
+	strlcpy(t->only, name ? name : "", sizeof(t->only));
+	return 0;
+}
+
+/**
+ * gives the columns room for at least `rows` rows, dropping what they held
+ * - returns: 0 on success, otherwise ERR_ALLOC
+ */
+static int grow(struct iftable *t, int rows) {
+	int cap = t->cap ? t->cap * 2 : 32;
+	while(cap < rows) cap *= 2;
+
+	// widest columns first so every one is aligned
+	size_t rowSize = 2 * sizeof(u_int64_t) + sizeof(int) + sizeof(u_int32_t) + sizeof(u_short) + sizeof(u_char) + IFNAMSIZ;
+	char *arena = malloc(cap * rowSize);
+	if(!arena) return ERR_ALLOC;
+	free(t->arena);
+
+	t->arena = arena;
+	t->cap = cap;
+	t->ibytes = (u_int64_t *) arena;
+	t->obytes = t->ibytes + cap;
+	t->flags = (int *) (t->obytes + cap);
+	t->mtus = (u_int32_t *) (t->flags + cap);
+	t->indices = (u_short *) (t->mtus + cap);
+	t->types = (u_char *) (t->indices + cap);
+	t->names = (char (*)[IFNAMSIZ]) (t->types + cap);
+	return 0;
+}
+
+/**
+ * - parameter p: a message of the kernel's list
+ * - parameter end: end of the list
+ * - returns: the interface message at p, NULL if it is something else or truncated
+ */
+static const struct if_msghdr2 *interfaceAt(const char *p, const char *end) {
+	const struct if_msghdr2 *ifm2 = (const struct if_msghdr2 *) p;
+	if(ifm2->ifm_type != RTM_IFINFO2) return NULL;
+	if(ifm2->ifm_msglen < sizeof(struct if_msghdr2) + sizeof(struct sockaddr_dl)) return NULL;
+	if(p + ifm2->ifm_msglen > end) return NULL;
+	return ifm2;
+}
+
+/**
+ * copies an interface's name, which is not NUL terminated in a sockaddr_dl
+ * - parameter name: set to the name, IFNAMSIZ bytes
+ */
+static void nameOf(const struct if_msghdr2 *ifm2, char *name) {
+	const struct sockaddr_dl *sdl = (const struct sockaddr_dl *) (ifm2 + 1);
+	int nlen = sdl->sdl_nlen < IFNAMSIZ ? sdl->sdl_nlen : IFNAMSIZ - 1;
+	memcpy(name, sdl->sdl_data, nlen);
+	name[nlen] = '\0';
+}
+
+/**
+ * Refills the table from a list of `NET_RT_IFLIST2` messages
+ * The columns only grow when the list has more interfaces than ever before
+ * - parameter buf: the messages, as the kernel returns them or built by hand
+ * - parameter len: bytes of the messages
+ * - returns: the number of rows, otherwise error
+ */
+int iftable_load(struct iftable *t, const char *buf, size_t len) {
+	if(!t || (!buf && len > 0)) return ERR_NULL;
+	const char *end = buf + len;
+	char name[IFNAMSIZ];
+
+	// sized first so the columns grow at most once per load
+	int rows = 0;
+	if(t->only[0]) {
+		rows = 1;
+	} else {
+		for(const char *p = buf; p + sizeof(struct if_msghdr) <= end; p += ((const struct if_msghdr *) p)->ifm_msglen) {
+			if(((const struct if_msghdr *) p)->ifm_msglen == 0) break;
+			if(interfaceAt(p, end)) rows++;
+		}
+	}
+	if(rows > t->cap && grow(t, rows) < 0) return ERR_ALLOC;
+
+	t->count = 0;
+	for(const char *p = buf; p + sizeof(struct if_msghdr) <= end && t->count < rows; p += ((const struct if_msghdr *) p)->ifm_msglen) {
+		if(((const struct if_msghdr *) p)->ifm_msglen == 0) break;
+		const struct if_msghdr2 *ifm2 = interfaceAt(p, end);
+		if(!ifm2) continue;
+
+		nameOf(ifm2, name);
+		if(t->only[0] && strncmp(name, t->only, IFNAMSIZ) != 0) continue;
+
+		int row = t->count++;
+		memcpy(t->names[row], name, IFNAMSIZ);
+		t->indices[row] = ifm2->ifm_index;
+		t->flags[row] = ifm2->ifm_flags;
+		t->mtus[row] = ifm2->ifm_data.ifi_mtu;
+		t->types[row] = ifm2->ifm_data.ifi_type;
+		t->ibytes[row] = ifm2->ifm_data.ifi_ibytes;
+		t->obytes[row] = ifm2->ifm_data.ifi_obytes;
+	}
+
+	if(t->only[0] && t->count == 0) {
+		memcpy(t->names[0], t->only, IFNAMSIZ);
+		t->indices[0] = 0;
+		t->flags[0] = 0;
+		t->mtus[0] = 0;
+		t->types[0] = 0;
+		t->ibytes[0] = t->obytes[0] = 0;
+		t->count = 1;
+	}
+	return t->count;
+}
+
+/**
+ * Refills the table with one `NET_RT_IFLIST2` sysctl, see `iftable_load`
+ * Callers that check interface state often refresh a table and read its
+ * columns instead of asking the kernel once per interface
+ * - returns: the number of rows, otherwise error
+ */
+int iftable_refresh(struct iftable *t) {
+	if(!t) return ERR_NULL;
+	int mib[] = {CTL_NET, PF_ROUTE, 0, 0, NET_RT_IFLIST2, 0};
+	size_t len = t->bufLen;
+
+	// the list can grow between sizing and reading it, so retry on ENOMEM
+	while(t->buf == NULL || sysctl(mib, 6, t->buf, &len, NULL, 0) < 0) {
+		if(t->buf != NULL && errno != ENOMEM) {
+			printERR("Unable to list interfaces.");
+			return ERR;
+		}
+		if(sysctl(mib, 6, NULL, &len, NULL, 0) < 0) {
+			printERR("Unable to size the interface list.");
+			return ERR;
+		}
+		len *= 2;
+		char *tmp = realloc(t->buf, len);
+		if(!tmp) return ERR_ALLOC;
+		t->buf = tmp;
+		t->bufLen = len;
+	}
+	return iftable_load(t, t->buf, len);
+}
+
+/**
+ * - parameter name: name of the interface
+ * - returns: the interface's row, otherwise -1
+ */
+int iftable_find(const struct iftable *t, const char *name) {
+	if(!t || !name) return -1;
+	for(int i = 0; i < t->count; i++) {
+		if(strncmp(t->names[i], name, IFNAMSIZ) == 0) return i;
+	}
+	return -1;
+}
+
+/**
+ * prints every row in a nice format
+ * - parameter out: stream to print to
+ */
+void iftable_print(FILE *out, const struct iftable *t) {
+	if(!out || !t) return;
+	for(int i = 0; i < t->count; i++) {
+		fprintf(out, "interface %u: { %s, ibytes: %llu, obytes: %llu }\n", t->indices[i], t->names[i],
+			(unsigned long long) t->ibytes[i], (unsigned long long) t->obytes[i]);
+	}
+}
@@ -0,0 +1,212 @@
+#include "general.h"
+#include "jobs.h"
+
+/**
+ * Reads a job file, see jobs.h
+ * - parameter path: the file
+ * - parameter out: set to the jobs, free them with `jobs_free`
+ * - parameter line: set to the line that failed to parse, or 0
+ * - returns: the number of jobs, otherwise error
+ */
+int jobs_load(const char *path, struct job **out, int *line) {
+	if(!path || !out) return ERR_NULL;
+	if(line) *line = 0;
+	*out = NULL;
+
+	FILE *f = fopen(path, "r");
+	if(!f) return ERR_OPEN;
+
+	struct job *jobs = NULL;
+	int count = 0, cap = 0, number = 0, res = 0;
+	char buf[JOBS_LINE_LEN];
+	while(res == 0 && fgets(buf, sizeof(buf), f)) {
+		number++;
+		buf[strcspn(buf, "\r\n")] = '\0';
+		char first[2];
+		if(sscanf(buf, " %1s", first) <= 0 || first[0] == '#') continue;
+
+		char name[NETMAN_JOB_NAME_LEN], interfaces[JOBS_INTERFACES_LEN];
+		unsigned long long limit = 0, rate = 0;
+		int command = 0;
+		if(sscanf(buf, "%31s %llu %llu %255s %n", name, &limit, &rate, interfaces, &command) != 4 ||
+		   command == 0 || buf[command] == '\0') {
+			res = ERR_OPTIONS;
+			break;
+		}
+
+		if(count == cap) {
+			cap = cap ? cap * 2 : 16;
+			struct job *tmp = realloc(jobs, cap * sizeof(struct job));
+			if(!tmp) {
+				res = ERR_ALLOC;
+				break;
+			}
+			jobs = tmp;
+		}
+		struct job *job = &jobs[count++];
+		memset(job, 0, sizeof(struct job));
+		strlcpy(job->name, name, sizeof(job->name));
+		job->limit = limit;
+		job->rate = rate;
+		job->id = -1;
+		job->command = strdup(buf + command);
+		if(strcmp(interfaces, "all") != 0) job->interfaces = strdup(interfaces);
+		if(!job->command || (strcmp(interfaces, "all") != 0 && !job->interfaces)) res = ERR_ALLOC;
+	}
+	fclose(f);
+
+	if(res < 0) {
+		if(line && res == ERR_OPTIONS) *line = number;
+		jobs_free(jobs, count);
+		return res;
+	}
+	*out = jobs;
+	return count;
+}
+
+/**
+ * - parameter jobs: jobs from `jobs_load`
+ * - parameter count: the number of jobs
+ */
+void jobs_free(struct job *jobs, int count) {
+	if(!jobs) return;
+	for(int i = 0; i < count; i++) {
+		free(jobs[i].interfaces);
+		free(jobs[i].command);
+	}
+	free(jobs);
+}
+
+/**
+ * Gives every job a counter in the session, must be called before any capture starts
+ * - returns: 0 on success, otherwise error
+ */
+int jobs_add(netman_session *session, struct job *jobs, int count) {
+	if(!session || (!jobs && count > 0)) return ERR_NULL;
+
+	for(int i = 0; i < count; i++) {
+		jobs[i].id = netman_add_job(session, jobs[i].name, jobs[i].limit, jobs[i].interfaces);
+		if(jobs[i].id < 0) return jobs[i].id;
+	}
+	return 0;
+}
+
+/**
+ * Starts a job's command and counting its bytes
+ * - parameter kq: kqueue to watch the command's exit with
+ * - returns: 0 on success, otherwise error
+ */
+static int startJob(netman_session *session, struct job *job, int kq) {
+	netman_job_running(session, job->id, true);
+	job->startNsec = monotonicNsec();
+	job->allowance = job->rate;
+	job->pid = runCmd(job->command);
+	if(job->pid <= 0) {
+		printERR("Failed to start job %s.", job->name);
+		netman_job_running(session, job->id, false);
+		job->state = JOB_FAILED;
+		return ERR_FORK;
+	}
+
+	// ESRCH means the command already exited, the next tick reaps it
+	struct kevent ev;
+	EV_SET(&ev, job->pid, EVFILT_PROC, EV_ADD | EV_ONESHOT, NOTE_EXIT, 0, NULL);
+	if(kevent(kq, &ev, 1, NULL, 0, NULL) < 0 && errno != ESRCH) {
+		printDEBUG("Unable to watch job %s, it is checked every tick\n", job->name);
+	}
+	job->state = JOB_RUNNING;
+	printVERBOSE("Started job %s (%d)", job->name, job->pid);
+	return 0;
+}
+
+/**
+ * Stops counting a job that exited or was killed
+ */
+static void endJob(netman_session *session, struct job *job, job_state state) {
+	netman_job_running(session, job->id, false);
+	job->runNsec = monotonicNsec() - job->startNsec;
+	job->state = state;
+	printVERBOSE("Job %s %s", job->name, state == JOB_KILLED ? "killed" : "finished");
+}
+
+/**
+ * Stops a job's process group while it is over its rate and continues it
+ * once its allowance is paid back
+ * - parameter seconds: time since the last tick
+ */
+static void throttle(netman_session *session, struct job *job, double seconds) {
+	if(job->rate == 0) return;
+
+	u_int64_t bytes = netman_job_bytes(session, job->id);
+	job->allowance += job->rate * seconds - (double) (bytes - job->counted);
+	job->counted = bytes;
+	// at most a second's worth builds up while the job is quiet
+	if(job->allowance > job->rate) job->allowance = job->rate;
+
+	if(!job->paused && job->allowance < 0 && kill(-job->pid, SIGSTOP) == 0) {
+		job->paused = true;
+	} else if(job->paused && job->allowance >= 0 && kill(-job->pid, SIGCONT) == 0) {
+		job->paused = false;
+	}
+}
+
+/**
+ * Runs the jobs' commands, at most `concurrency` at once in file order,
+ * until every one has exited or was killed at its limit. Reaching the
+ * session's limit kills every running job and starts no more
+ * The session's captures must be running
+ * - parameter jobs: jobs given counters by `jobs_add`
+ * - parameter concurrency: how many commands run at once, 0 for all
+ * - returns: 0 on success, otherwise error
+ */
+int jobs_run(netman_session *session, struct job *jobs, int count, int concurrency) {
+	if(!session || (!jobs && count > 0)) return ERR_NULL;
+
+	int kq = kqueue();
+	if(kq < 0) {
+		printERR("Unable to create kqueue.");
+		return ERR_KQUEUE;
+	}
+
+	int next = 0, running = 0;
+	u_int64_t last = monotonicNsec();
+	while(next < count || running > 0) {
+		int limitReached = netman_limit_reached(session);
+		while(!limitReached && next < count && (concurrency <= 0 || running < concurrency)) {
+			running += startJob(session, &jobs[next++], kq) == 0;
+		}
+		if(limitReached) next = count;
+
+		// wake for an exit or the next tick, whichever comes first
+		struct kevent ev[16];
+		struct timespec tick = {0, JOBS_TICK_MSEC * 1000000L};
+		if(running > 0) kevent(kq, NULL, 0, ev, 16, &tick);
+
+		u_int64_t now = monotonicNsec();
+		double seconds = (now - last) / 1e9;
+		last = now;
+		for(int i = 0; i < count; i++) {
+			struct job *job = &jobs[i];
+			if(job->state != JOB_RUNNING) continue;
+
+			if(limitReached || netman_job_reached(session, job->id)) {
+				killCmd(job->pid);
+				endJob(session, job, JOB_KILLED);
+				running--;
+				continue;
+			}
+			pid_t res = waitpid(job->pid, &job->status, WNOHANG);
+			if(res == job->pid || (res < 0 && errno == ECHILD)) {
+				// take down anything the command left running in its group, the
+				// command was reaped so its pid may already be another job's
+				killGroup(job->pid);
+				endJob(session, job, JOB_DONE);
+				running--;
+				continue;
+			}
+			throttle(session, job, seconds);
+		}
+	}
+	close(kq);
+	return 0;
+}
@@ -0,0 +1,458 @@
+#include "errorcodes.h"
+#include "lease.h"
+
+#include <stdlib.h> // calloc, arc4random
+#include <string.h> // memset
+#include <errno.h>
+#include <stdbool.h>
+#include <time.h> // clock_gettime
+#include <unistd.h> // close
+#include <poll.h>
+#include <netdb.h> // getaddrinfo
+#include <arpa/inet.h> // htonl
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+// how often `lease_client_wait` resends its request
+#define RESEND_MSEC 200
+
+/**
+ * - returns: the monotonic clock in nanoseconds
+ */
+static u_int64_t nowNsec(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u_int64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static u_int64_t swap64(u_int64_t v) {
+	return ((u_int64_t) htonl((u_int32_t) v) << 32) | htonl((u_int32_t) (v >> 32));
+}
+
+/**
+ * Converts a message between host and network byte order, either way
+ */
+static void swapMsg(struct lease_msg *m) {
+	m->magic = htonl(m->magic);
+	m->version = htons(m->version);
+	m->type = htons(m->type);
+	m->instance = swap64(m->instance);
+	m->seq = htonl(m->seq);
+	m->flags = htonl(m->flags);
+	m->used = swap64(m->used);
+	m->want = swap64(m->want);
+	m->granted = swap64(m->granted);
+	m->total = swap64(m->total);
+	m->limit = swap64(m->limit);
+	m->leaseMsec = htonl(m->leaseMsec);
+}
+
+/**
+ * Reads a message from a socket without waiting
+ * - returns: true if `m` was set to a valid message in host byte order, false if none is left
+ */
+static int readMsg(int fd, struct lease_msg *m, struct sockaddr_storage *from, socklen_t *fromLen) {
+	for(;;) {
+		ssize_t n = recvfrom(fd, m, sizeof(struct lease_msg), MSG_DONTWAIT, (struct sockaddr *) from, fromLen);
+		if(n < 0) return false;
+		if(n != sizeof(struct lease_msg)) continue;
+
+		swapMsg(m);
+		if(m->magic == LEASE_MAGIC && m->version == LEASE_VERSION) {
+			m->group[LEASE_GROUP_LEN - 1] = '\0';
+			return true;
+		}
+	}
+}
+
+/**
+ * Listens for instances on a UDP port, IPv6 and IPv4 where the system allows
+ * - parameter port: the port, "0" for any
+ * - parameter limit: each group's budget in bytes
+ * - parameter leaseMsec: how long a grant holds, 0 for LEASE_DEFAULT_MSEC
+ * - returns: the aggregator, or NULL on failure
+ */
+struct lease_server *lease_server_create(const char *port, u_int64_t limit, u_int32_t leaseMsec) {
+	if(!port || limit == 0) return NULL;
+
+	struct lease_server *s = calloc(1, sizeof(struct lease_server));
+	if(!s) return NULL;
+	s->limit = limit;
+	s->leaseMsec = leaseMsec ? leaseMsec : LEASE_DEFAULT_MSEC;
+	for(int i = 0; i < LEASE_MAX_INSTANCES; i++) {
+		s->instances[i].group = -1;
+	}
+
+	struct addrinfo hints, *res = NULL;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET6;
+	hints.ai_socktype = SOCK_DGRAM;
+	hints.ai_flags = AI_PASSIVE;
+	s->fd = -1;
+	for(int attempt = 0; attempt < 2 && s->fd < 0; attempt++) {
+		// an IPv6 socket takes IPv4 too, without IPv6 fall back to IPv4 only
+		if(attempt == 1) hints.ai_family = AF_INET;
+		if(getaddrinfo(NULL, port, &hints, &res) != 0) continue;
+
+		s->fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+		int off = 0;
+		if(s->fd >= 0 && res->ai_family == AF_INET6) {
+			setsockopt(s->fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+		}
+		if(s->fd >= 0 && bind(s->fd, res->ai_addr, res->ai_addrlen) < 0) {
+			close(s->fd);
+			s->fd = -1;
+		}
+		freeaddrinfo(res);
+	}
+	if(s->fd < 0) {
+		free(s);
+		return NULL;
+	}
+	return s;
+}
+
+/**
+ * - parameter s: aggregator from `lease_server_create`
+ */
+void lease_server_free(struct lease_server *s) {
+	if(!s) return;
+	if(s->fd >= 0) close(s->fd);
+	free(s);
+}
+
+/**
+ * - returns: the port the aggregator listens on, otherwise error
+ */
+int lease_server_port(struct lease_server *s) {
+	if(!s) return ERR_NULL;
+
+	struct sockaddr_storage addr;
+	socklen_t len = sizeof(addr);
+	if(getsockname(s->fd, (struct sockaddr *) &addr, &len) < 0) return ERR_SOCKET;
+	if(addr.ss_family == AF_INET6) return ntohs(((struct sockaddr_in6 *) &addr)->sin6_port);
+	return ntohs(((struct sockaddr_in *) &addr)->sin_port);
+}
+
+/**
+ * Finds or adds a group
+ * - returns: the group's index, or -1 if there is no room
+ */
+static int findGroup(struct lease_server *s, const char *name) {
+	for(u_int32_t i = 0; i < s->groupCount; i++) {
+		if(strncmp(s->groups[i].name, name, LEASE_GROUP_LEN) == 0) return i;
+	}
+	if(s->groupCount >= LEASE_MAX_GROUPS) return -1;
+
+	struct lease_group *g = &s->groups[s->groupCount];
+	strncpy(g->name, name, LEASE_GROUP_LEN - 1);
+	g->retired = 0;
+	return s->groupCount++;
+}
+
+/**
+ * Frees an instance's slot, what it used stays with its group
+ */
+static void retire(struct lease_server *s, struct lease_instance *inst) {
+	s->groups[inst->group].retired += inst->used;
+	inst->group = -1;
+}
+
+/**
+ * Finds or adds an instance, evicting the one whose lease ended longest ago when full
+ * - returns: the instance, or NULL if every lease still holds
+ */
+static struct lease_instance *findInstance(struct lease_server *s, u_int64_t id, int group, u_int64_t now) {
+	struct lease_instance *slot = NULL, *oldest = NULL;
+	for(int i = 0; i < LEASE_MAX_INSTANCES; i++) {
+		struct lease_instance *inst = &s->instances[i];
+		if(inst->group < 0) {
+			if(!slot) slot = inst;
+		} else if(inst->id == id && inst->group == group) {
+			return inst;
+		} else if(inst->expires <= now && (!oldest || inst->expires < oldest->expires)) {
+			oldest = inst;
+		}
+	}
+	if(!slot && oldest) {
+		retire(s, oldest);
+		slot = oldest;
+	}
+	if(slot) {
+		memset(slot, 0, sizeof(struct lease_instance));
+		slot->id = id;
+		slot->group = group;
+	}
+	return slot;
+}
+
+/**
+ * - returns: the bytes a group's instances used, including retired ones
+ */
+static u_int64_t groupTotal(struct lease_server *s, int group) {
+	u_int64_t total = s->groups[group].retired;
+	for(int i = 0; i < LEASE_MAX_INSTANCES; i++) {
+		if(s->instances[i].group == group) total += s->instances[i].used;
+	}
+	return total;
+}
+
+/**
+ * - returns: the bytes granted but not yet used by a group's other instances whose leases hold
+ */
+static u_int64_t groupReserved(struct lease_server *s, int group, struct lease_instance *except, u_int64_t now) {
+	u_int64_t reserved = 0;
+	for(int i = 0; i < LEASE_MAX_INSTANCES; i++) {
+		struct lease_instance *inst = &s->instances[i];
+		if(inst->group != group || inst == except || inst->expires <= now) continue;
+		if(inst->granted > inst->used) reserved += inst->granted - inst->used;
+	}
+	return reserved;
+}
+
+/**
+ * Charges an instance's report to its group and turns a request into its grant
+ * - parameter m: the message, set to the grant
+ * - returns: true if the grant should be sent
+ */
+static int handle(struct lease_server *s, struct lease_msg *m, u_int64_t now) {
+	int type = m->type;
+	if(type != LEASE_REQUEST && type != LEASE_RELEASE) return false;
+
+	int group = findGroup(s, m->group);
+	struct lease_instance *inst = group >= 0 ? findInstance(s, m->instance, group, now) : NULL;
+	m->type = LEASE_GRANT;
+	m->flags = 0;
+	m->limit = s->limit;
+	m->leaseMsec = s->leaseMsec;
+	if(!inst) {
+		m->flags = LEASE_FULL | LEASE_FINAL;
+		m->granted = m->used;
+		m->total = group >= 0 ? groupTotal(s, group) : 0;
+		return type == LEASE_REQUEST;
+	}
+
+	// counts are running totals, an older report changes nothing
+	if(m->used > inst->used) inst->used = m->used;
+	if(type == LEASE_RELEASE) {
+		retire(s, inst);
+		return false;
+	}
+
+	// a lease that ran out gave its slice back
+	if(inst->expires <= now) inst->granted = inst->used;
+
+	u_int64_t total = groupTotal(s, group);
+	u_int64_t reserved = groupReserved(s, group, inst, now);
+	u_int64_t available = s->limit > total + reserved ? s->limit - total - reserved : 0;
+	u_int64_t slice = m->want < available ? m->want : available;
+	if(inst->used + slice > inst->granted) inst->granted = inst->used + slice;
+	inst->expires = now + (u_int64_t) LEASE_GRACE * s->leaseMsec * 1000000;
+
+	m->granted = inst->granted;
+	m->total = total;
+	if(slice == available) m->flags |= LEASE_FINAL;
+	return true;
+}
+
+/**
+ * Waits for reports and answers every one that has arrived
+ * - parameter timeoutMsec: how long to wait for the first, -1 for ever
+ * - returns: the number of messages handled, otherwise error
+ */
+int lease_server_serve(struct lease_server *s, int timeoutMsec) {
+	if(!s) return ERR_NULL;
+
+	struct pollfd pfd = {s->fd, POLLIN, 0};
+	if(poll(&pfd, 1, timeoutMsec) < 0) return errno == EINTR ? 0 : ERR_READ;
+
+	int handled = 0;
+	struct lease_msg m;
+	struct sockaddr_storage from;
+	socklen_t fromLen = sizeof(from);
+	u_int64_t now = nowNsec();
+	while(readMsg(s->fd, &m, &from, &fromLen)) {
+		handled++;
+		if(handle(s, &m, now)) {
+			swapMsg(&m);
+			sendto(s->fd, &m, sizeof(m), 0, (struct sockaddr *) &from, fromLen);
+		}
+		fromLen = sizeof(from);
+	}
+	return handled;
+}
+
+/**
+ * - parameter group: name of the group
+ * - returns: the bytes the group used, 0 for an unknown group
+ */
+u_int64_t lease_server_total(struct lease_server *s, const char *group) {
+	if(!s || !group) return 0;
+	for(u_int32_t i = 0; i < s->groupCount; i++) {
+		if(strncmp(s->groups[i].name, group, LEASE_GROUP_LEN) == 0) return groupTotal(s, i);
+	}
+	return 0;
+}
+
+/**
+ * Connects to an aggregator, nothing is granted until `lease_client_wait`
+ * - parameter host: the aggregator's name or address
+ * - parameter port: the aggregator's port, e.g. LEASE_DEFAULT_PORT
+ * - parameter group: the budget's group, shorter than LEASE_GROUP_LEN
+ * - returns: the instance, or NULL on failure
+ */
+struct lease_client *lease_client_create(const char *host, const char *port, const char *group) {
+	if(!host || !port || !group) return NULL;
+	size_t len = strnlen(group, LEASE_GROUP_LEN);
+	if(len == 0 || len >= LEASE_GROUP_LEN) return NULL;
+
+	struct addrinfo hints, *res = NULL;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_socktype = SOCK_DGRAM;
+	if(getaddrinfo(host, port, &hints, &res) != 0) return NULL;
+
+	struct lease_client *c = calloc(1, sizeof(struct lease_client));
+	if(!c) {
+		freeaddrinfo(res);
+		return NULL;
+	}
+	c->fd = -1;
+	for(struct addrinfo *ai = res; ai && c->fd < 0; ai = ai->ai_next) {
+		c->fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if(c->fd >= 0 && connect(c->fd, ai->ai_addr, ai->ai_addrlen) < 0) {
+			close(c->fd);
+			c->fd = -1;
+		}
+	}
+	freeaddrinfo(res);
+	if(c->fd < 0) {
+		free(c);
+		return NULL;
+	}
+
+	c->id = ((u_int64_t) arc4random() << 32) | arc4random();
+	memcpy(c->group, group, len);
+	c->slice = LEASE_MIN_SLICE;
+	return c;
+}
+
+/**
+ * - parameter c: instance from `lease_client_create`
+ */
+void lease_client_free(struct lease_client *c) {
+	if(!c) return;
+	if(c->fd >= 0) close(c->fd);
+	free(c);
+}
+
+/**
+ * Sends a request or release for the bytes used so far
+ * - returns: 0 on success, otherwise error
+ */
+static int sendMsg(struct lease_client *c, int type, u_int64_t used) {
+	struct lease_msg m;
+	memset(&m, 0, sizeof(m));
+	m.magic = LEASE_MAGIC;
+	m.version = LEASE_VERSION;
+	m.type = type;
+	m.instance = c->id;
+	m.seq = ++c->seq;
+	memcpy(m.group, c->group, LEASE_GROUP_LEN);
+	m.used = used;
+	m.want = type == LEASE_REQUEST ? c->slice : 0;
+
+	swapMsg(&m);
+	if(send(c->fd, &m, sizeof(m), 0) != sizeof(m)) return ERR_SOCKET;
+	c->sentNsec = nowNsec();
+	c->sentUsed = used;
+	return 0;
+}
+
+/**
+ * Applies the newest grant that has arrived, older ones are dropped
+ * - returns: the number of grants applied
+ */
+static int receive(struct lease_client *c) {
+	int applied = 0;
+	struct lease_msg m;
+	struct sockaddr_storage from;
+	socklen_t fromLen = sizeof(from);
+	while(readMsg(c->fd, &m, &from, &fromLen)) {
+		fromLen = sizeof(from);
+		if(m.type != LEASE_GRANT || m.instance != c->id || m.seq <= c->grantSeq || m.seq > c->seq) continue;
+
+		c->grantSeq = m.seq;
+		c->total = m.total;
+		c->limit = m.limit;
+		c->leaseMsec = m.leaseMsec;
+		c->grantNsec = nowNsec();
+		__atomic_store_n(&c->granted, m.granted, __ATOMIC_RELEASE);
+		__atomic_store_n(&c->final, (m.flags & (LEASE_FINAL | LEASE_FULL)) != 0, __ATOMIC_RELEASE);
+		applied++;
+	}
+	return applied;
+}
+
+/**
+ * Asks for a first grant and waits for it, resending every RESEND_MSEC
+ * - parameter used: bytes used so far
+ * - parameter timeoutMsec: how long to wait
+ * - returns: 0 once granted, otherwise error
+ */
+int lease_client_wait(struct lease_client *c, u_int64_t used, int timeoutMsec) {
+	if(!c) return ERR_NULL;
+
+	for(int waited = 0; waited < timeoutMsec; waited += RESEND_MSEC) {
+		int res = sendMsg(c, LEASE_REQUEST, used);
+		if(res < 0) return res;
+
+		struct pollfd pfd = {c->fd, POLLIN, 0};
+		u_int64_t resent = nowNsec() + RESEND_MSEC * 1000000ull;
+		for(u_int64_t now = nowNsec(); now < resent; now = nowNsec()) {
+			if(poll(&pfd, 1, (int) ((resent - now) / 1000000) + 1) > 0 && receive(c) > 0) return 0;
+		}
+	}
+	return ERR_SOCKET;
+}
+
+/**
+ * Applies grants that arrived and reports the bytes used when due: once half
+ * of the last slice is left, or a quarter of the way through the lease.
+ * A lease that could not be renewed keeps the instance to what was granted
+ * Called every LEASE_REPORT_MSEC
+ * - parameter used: bytes used so far
+ * - returns: 0 on success, otherwise error
+ */
+int lease_client_tick(struct lease_client *c, u_int64_t used) {
+	if(!c) return ERR_NULL;
+
+	receive(c);
+	u_int64_t now = nowNsec();
+	u_int64_t leaseNsec = (u_int64_t) c->leaseMsec * 1000000;
+	if(now - c->grantNsec > leaseNsec) {
+		__atomic_store_n(&c->final, 1, __ATOMIC_RELEASE);
+	}
+
+	// while a request is out, only ask again once it may have been lost
+	u_int64_t granted = __atomic_load_n(&c->granted, __ATOMIC_RELAXED);
+	u_int64_t left = granted > used ? granted - used : 0;
+	int waiting = c->grantSeq != c->seq && now - c->sentNsec < 4 * LEASE_REPORT_MSEC * 1000000ull;
+	int low = !__atomic_load_n(&c->final, __ATOMIC_RELAXED) && left <= c->slice / 2 && !waiting;
+	int renew = now - c->sentNsec >= leaseNsec / 4;
+	if(!low && !renew) return 0;
+
+	// ask for twice what was used since the last request, so busy instances ask less often
+	u_int64_t recent = used > c->sentUsed ? used - c->sentUsed : 0;
+	c->slice = 2 * recent > LEASE_MIN_SLICE ? 2 * recent : LEASE_MIN_SLICE;
+	return sendMsg(c, LEASE_REQUEST, used);
+}
+
+/**
+ * Reports the bytes used in all and gives back the rest of the slice, the instance is done
+ * - parameter used: bytes used in all
+ * - returns: 0 on success, otherwise error
+ */
+int lease_client_release(struct lease_client *c, u_int64_t used) {
+	if(!c) return ERR_NULL;
+	return sendMsg(c, LEASE_RELEASE, used);
+}
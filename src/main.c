@@ -1,5 +1,512 @@
 #include "general.h"
 #include "netinterfaces.h"
+#include "jobs.h"
+#include "watch.h"
+#include <math.h> // exp
+#include <stdint.h> // UINT64_MAX
+
+static int label_flag = 0;      // flag set by --label
+static int hugepages_flag = 0;  // flag set by --hugepages
+static int histogram_flag = 0;  // flag set by --histogram
+
+// prints a report every interval seconds while the command runs
+struct reporter {
+    void (*print)(netman_session *session);
+    netman_session *session;
+    int interval;               // seconds, 0 for no reporter
+    int running;
+    int stop;                   // guarded by reportMutex
+    pthread_t thread;
+};
+static pthread_mutex_t reportMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t reportCond = PTHREAD_COND_INITIALIZER;
+
+// what `printSeries` prints for the history command
+struct seriesFilter {
+    char *name;                 // only print this series, or NULL for all
+    int human;                  // print megabytes
+};
+
+/**
+ * prints the size and inter-arrival histograms of each captured interface
+ * - parameter session: the capture session
+ * - parameter interfaces: the captured interfaces
+ */
+static void printHistograms(netman_session *session, const struct iftable *interfaces) {
+    struct histogram *sizes = malloc(sizeof(struct histogram));
+    struct histogram *gaps = malloc(sizeof(struct histogram));
+    char label[IFNAMSIZ + 16];
+
+    for(int row = 0; sizes && gaps && row < interfaces->count; row++) {
+        const char *name = interfaces->names[row];
+        if(netman_histogram_snapshot(session, name, sizes, gaps) < 0) continue;
+
+        snprintf(label, sizeof(label), "%s size", name);
+        histogram_print(stdout, label, "bytes", sizes);
+        snprintf(label, sizeof(label), "%s gap", name);
+        histogram_print(stdout, label, "usec", gaps);
+        if(netman_latency_snapshot(session, name, sizes) == 0) {
+            snprintf(label, sizeof(label), "%s latency", name);
+            histogram_print(stdout, label, "usec", sizes);
+        }
+    }
+    free(sizes);
+    free(gaps);
+}
+
+/**
+ * Kills the command as soon as the limit is reached, on the capture thread
+ * that reached it, for --busy-poll
+ * - parameter ctx: the command's pid, 0 until it starts
+ */
+static void killOnLimit(netman_session *session, u_int64_t bytes, void *ctx) {
+    (void) session;
+    (void) bytes;
+    pid_t pid = __atomic_load_n((pid_t *) ctx, __ATOMIC_ACQUIRE);
+    // the monitor loop reaps it
+    if(pid > 0) kill(-pid, SIGKILL);
+}
+
+/**
+ * prints the heaviest MAC and IP addresses with their error bound
+ * - parameter session: the capture session, with top tracking on
+ */
+static void printTop(netman_session *session) {
+    static const char *titles[] = {"MAC", "IP"};
+    struct sketch_entry top[SKETCH_MAX_K];
+    char addr[INET6_ADDRSTRLEN];
+
+    for(int by = NETMAN_TOP_MAC; by <= NETMAN_TOP_IP; by++) {
+        u_int64_t error = 0;
+        int n = netman_top(session, by, top, SKETCH_MAX_K, &error);
+        if(n < 0) return;
+
+        printf("Top %s addresses (bytes sent + received, may overcount by %llu with %.1f%% confidence):\n",
+            titles[by], (unsigned long long) error, 100.0 * (1.0 - exp(-(double) SKETCH_DEFAULT_DEPTH)));
+        for(int i = 0; i < n; i++) {
+            printf("  %-40s %llu\n", sketch_key_string(&top[i].key, addr, sizeof(addr)), (unsigned long long) top[i].count);
+        }
+    }
+    fflush(stdout);
+}
+
+/**
+ * prints the bytes each prefix budget used
+ * - parameter session: the capture session
+ */
+static void printBudgets(netman_session *session) {
+    struct prefix_budget budget;
+    for(int i = 0; netman_budget(session, i, &budget) == 0; i++) {
+        printf("%s: %llu", budget.name, (unsigned long long) budget.bytes);
+        if(budget.limit > 0) {
+            printf(" / %llu%s", (unsigned long long) budget.limit, budget.reached ? " (reached)" : "");
+        }
+        if(verbose_flag || label_flag) printf(" bytes");
+        printf("\n");
+    }
+}
+
+/**
+ * prints what a quota used of its limit in the current period
+ * - parameter e: the quota
+ * - parameter human: print megabytes
+ */
+static void printQuotaEntry(const struct quota_entry *e, int human) {
+    if(human) {
+        printf("%s: %0.2f", e->name, e->used / 1000000.0);
+        if(e->limit > 0) printf(" / %0.2f", e->limit / 1000000.0);
+    } else {
+        printf("%s: %llu", e->name, (unsigned long long) e->used);
+        if(e->limit > 0) printf(" / %llu", (unsigned long long) e->limit);
+    }
+    if(e->limit > 0 && e->used >= e->limit) printf(" (used up)");
+    if(verbose_flag || label_flag) printf(human ? " Mb" : " bytes");
+    if(e->period == QUOTA_DAILY) {
+        printf(" today");
+    } else if(e->period > 0) {
+        printf(" in %u seconds", e->period);
+    }
+    printf("\n");
+}
+
+/**
+ * prints every quota in a quota file for the quota command
+ * - parameter path: the quota file
+ * - parameter name: only print this quota, or NULL for all
+ * - parameter human: print megabytes
+ * - returns: 0 on success, otherwise error
+ */
+static int printQuotas(const char *path, const char *name, int human) {
+    struct quota *q = quota_open(path);
+    if(!q) return ERR_OPEN;
+
+    struct quota_entry e;
+    time_t now = time(NULL);
+    for(int i = 0; quota_get(q, i, now, &e) == 0; i++) {
+        if(name && strncmp(name, e.name, QUOTA_NAME_LEN) != 0) continue;
+        printQuotaEntry(&e, human);
+    }
+    quota_close(q);
+    return 0;
+}
+
+/**
+ * Parses --quota, "<name>[,<limit bytes>[,daily|<period seconds>]]"
+ * - parameter spec: the value, cut after the name
+ * - parameter limit: set to the limit if there is one
+ * - parameter period: set to the period if there is one
+ * - returns: true if the value defines the quota, false if it only names it, otherwise error
+ */
+static int parseQuota(char *spec, u_int64_t *limit, u_int32_t *period) {
+    char *field = strchr(spec, ',');
+    size_t nameLen = field ? (size_t) (field - spec) : strlen(spec);
+    if(nameLen == 0 || nameLen >= QUOTA_NAME_LEN) return ERR_OPTIONS;
+    if(!field) return false;
+    *field++ = '\0';
+
+    char *end = NULL;
+    *limit = strtoull(field, &end, 10);
+    *period = 0;
+    if(end == field || (*end != '\0' && *end != ',')) return ERR_OPTIONS;
+    if(*end == '\0') return true;
+
+    field = end + 1;
+    if(strcmp(field, "daily") == 0) {
+        *period = QUOTA_DAILY;
+        return true;
+    }
+    *period = (u_int32_t) strtoul(field, &end, 10);
+    if(end == field || *end != '\0') return ERR_OPTIONS;
+    return true;
+}
+
+/**
+ * Adds a quota to a quota file, or changes its limit and period
+ * - returns: 0 on success, otherwise error
+ */
+static int defineQuota(const char *path, const char *name, u_int64_t limit, u_int32_t period) {
+    struct quota *q = quota_open(path);
+    if(!q) return ERR_OPEN;
+    int res = quota_define(q, name, limit, period);
+    quota_close(q);
+    return res < 0 ? res : 0;
+}
+
+/**
+ * prints what the session's group used of its budget, across every instance
+ * - parameter session: the capture session, reporting to an aggregator
+ * - parameter group: the group's name
+ * - parameter human: print megabytes
+ */
+static void printGroup(netman_session *session, const char *group, int human) {
+    u_int64_t limit = 0;
+    u_int64_t total = netman_group_bytes(session, &limit);
+    if(human) {
+        printf("group %s: %0.2f / %0.2f", group, total / 1000000.0, limit / 1000000.0);
+    } else {
+        printf("group %s: %llu / %llu", group, (unsigned long long) total, (unsigned long long) limit);
+    }
+    if(verbose_flag || label_flag) printf(human ? " Mb" : " bytes");
+    printf("\n");
+}
+
+/**
+ * prints the bytes the session received and sent against their limits
+ * - parameter session: the capture session
+ * - parameter rxLimit: the received byte limit, 0 is unlimited
+ * - parameter txLimit: the sent byte limit, 0 is unlimited
+ * - parameter human: print megabytes
+ */
+static void printDirections(netman_session *session, u_int64_t rxLimit, u_int64_t txLimit, int human) {
+    u_int64_t bytes[2] = {0}, limits[2] = {rxLimit, txLimit};
+    netman_direction_bytes(session, &bytes[0], &bytes[1]);
+
+    for(int i = 0; i < 2; i++) {
+        printf(i == 0 ? "RX: " : "TX: ");
+        if(human) {
+            printf("%0.2f", bytes[i] / 1000000.0);
+            if(limits[i] > 0) printf(" / %0.2f", limits[i] / 1000000.0);
+        } else {
+            printf("%llu", (unsigned long long) bytes[i]);
+            if(limits[i] > 0) printf(" / %llu", (unsigned long long) limits[i]);
+        }
+        if(verbose_flag || label_flag) printf(human ? " Mb" : " bytes");
+        if(limits[i] > 0 && bytes[i] >= limits[i]) printf(" (reached)");
+        printf("\n");
+    }
+}
+
+/**
+ * Splits "host[:port]" for --aggregator, an IPv6 address with a port is "[addr]:port"
+ * - parameter value: the value, cut before the port
+ * - returns: the port, or NULL if there is none
+ */
+static char *splitPort(char *value) {
+    char *colon = strrchr(value, ':');
+    if(value[0] == '[') {
+        char *close = strchr(value, ']');
+        if(!close) return NULL;
+        *close = '\0';
+        memmove(value, value + 1, close - value);
+        return close[1] == ':' ? close + 2 : NULL;
+    }
+    // more than one colon is an IPv6 address without a port
+    if(!colon || strchr(value, ':') != colon) return NULL;
+    *colon = '\0';
+    return colon + 1;
+}
+
+/**
+ * prints what each job counted, how it ended and how long it ran
+ * - parameter session: the capture session the jobs ran under
+ * - parameter jobs: the jobs
+ * - parameter count: the number of jobs
+ * - parameter human: print megabytes
+ */
+static void printJobs(netman_session *session, struct job *jobs, int count, int human) {
+    static const char *states[] = {"not started", "running", "exited", "killed", "failed to start"};
+
+    for(int i = 0; i < count; i++) {
+        struct job *job = &jobs[i];
+        u_int64_t bytes = netman_job_bytes(session, job->id);
+        if(human) {
+            printf("%s: %0.2f", job->name, bytes / 1000000.0);
+            if(job->limit > 0) printf(" / %0.2f", job->limit / 1000000.0);
+        } else {
+            printf("%s: %llu", job->name, (unsigned long long) bytes);
+            if(job->limit > 0) printf(" / %llu", (unsigned long long) job->limit);
+        }
+        if(verbose_flag || label_flag) printf(human ? " Mb" : " bytes");
+        printf(", %s", states[job->state]);
+        if(job->state == JOB_DONE && WIFEXITED(job->status)) printf(" %d", WEXITSTATUS(job->status));
+        if(job->state == JOB_DONE || job->state == JOB_KILLED) printf(" after %.1fs", job->runNsec / 1e9);
+        printf("\n");
+    }
+}
+
+/**
+ * prints one interval of `bytes --watch`: the bytes moved and their rate
+ * - parameter name: the interface, or "total"
+ * - parameter in: RX bytes in the interval
+ * - parameter out: TX bytes in the interval
+ * - parameter nsec: length of the interval
+ * - parameter direction: 'i' for RX, 'o' for TX, otherwise RX + TX
+ * - parameter human: print megabytes
+ */
+static void printDelta(const char *name, u_int64_t in, u_int64_t out, u_int64_t nsec, char direction, int human) {
+    u_int64_t bytes = direction == 'i' ? in : direction == 'o' ? out : in + out;
+    u_int64_t rate = watch_rate(bytes, nsec);
+    const char *label = direction == 'i' ? "RX" : direction == 'o' ? "TX" : "RX+TX";
+
+    printf("%s ", name);
+    if(verbose_flag || label_flag) printf("%s: ", label);
+    if(human) {
+        printf("%0.2f %0.2f", bytes / 1000000.0, rate / 1000000.0);
+    } else {
+        printf("%llu %llu", (unsigned long long) bytes, (unsigned long long) rate);
+    }
+    if(verbose_flag || label_flag) printf(human ? " Mb Mb/s" : " bytes bytes/s");
+    printf("\n");
+}
+
+/**
+ * Prints the bytes each interface moved and its rate every interval until killed,
+ * with a total when there is more than one. Counters are kept between samples
+ * and each interval's lines go out in one write
+ * - parameter w: the interfaces to watch
+ * - parameter intervalNsec: time between samples
+ * - parameter direction: 'i' for RX, 'o' for TX, otherwise RX + TX
+ * - parameter human: print megabytes
+ * - returns: error, it only returns if sampling fails
+ */
+static int watchBytes(struct watch *w, u_int64_t intervalNsec, char direction, int human) {
+    static char buffer[64 * 1024];
+    setvbuf(stdout, buffer, _IOFBF, sizeof(buffer));
+
+    int res = watch_sample(w);
+    // deadlines are kept on the monotonic clock so intervals don't drift
+    u_int64_t next = monotonicNsec();
+    while(res >= 0) {
+        next += intervalNsec;
+        u_int64_t now = monotonicNsec();
+        if(next > now) {
+            struct timespec wait = {(next - now) / 1000000000ull, (next - now) % 1000000000ull};
+            while(nanosleep(&wait, &wait) < 0 && errno == EINTR);
+        }
+        if((res = watch_sample(w)) < 0) break;
+
+        u_int64_t in = 0, out = 0;
+        int shown = 0;
+        for(int i = 0; i < w->count; i++) {
+            struct watch_counter *c = &w->counters[i];
+            if(!c->seen) continue;
+            printDelta(c->name, c->idelta, c->odelta, w->intervalNsec, direction, human);
+            in += c->idelta;
+            out += c->odelta;
+            shown++;
+        }
+        if(shown > 1) printDelta("total", in, out, w->intervalNsec, direction, human);
+        fflush(stdout);
+    }
+    printERR("Unable to read the interface counters.");
+    return res;
+}
+
+/**
+ * prints the sampled estimate of the bytes and packets with its 95% confidence interval
+ * - parameter session: the capture session, with sampling on
+ */
+static void printEstimate(netman_session *session) {
+    struct netman_estimate e;
+    if(netman_estimate(session, &e) < 0 || e.sampleRate == 0) return;
+
+    printf("Estimated RX+TX: %llu bytes (95%% CI %llu-%llu), %llu packets (%llu-%llu), 1 in %u IPv4 packets sampled%s\n",
+        (unsigned long long) e.bytes, (unsigned long long) e.bytesLow, (unsigned long long) e.bytesHigh,
+        (unsigned long long) e.packets, (unsigned long long) e.packetsLow, (unsigned long long) e.packetsHigh,
+        e.sampleRate, e.exact ? ", exact near the limit" : "");
+}
+
+/**
+ * prints each capture thread's counters and costs
+ * - parameter session: the capture session
+ */
+static void printStats(netman_session *session) {
+    struct netman_capture_stats stats[20];
+    int n = netman_stats(session, stats, 20);
+
+    for(int i = 0; i < n; i++) {
+        struct netman_capture_stats *s = &stats[i];
+        double wall = s->wallNsec / 1e9;
+        u_int64_t busy = s->readNsec + s->processNsec;
+
+        printf("%s: %llu packets %llu bytes in %llu reads (%llu per read), %.0f packets/s, "
+               "read %.3fs process %.3fs (%.1f%%), cpu %.3fs (%.1f%%), %llu dropped, %llu duplicates\n",
+            s->name, (unsigned long long) s->packets, (unsigned long long) s->bytes,
+            (unsigned long long) s->batches,
+            (unsigned long long) (s->batches ? s->packets / s->batches : 0),
+            wall > 0 ? s->packets / wall : 0,
+            s->readNsec / 1e9, s->processNsec / 1e9, busy ? 100.0 * s->processNsec / busy : 0,
+            s->cpuNsec / 1e9, s->wallNsec ? 100.0 * s->cpuNsec / s->wallNsec : 0,
+            (unsigned long long) s->drops, (unsigned long long) s->duplicates);
+    }
+    fflush(stdout);
+}
+
+/**
+ * the body of a reporter thread, prints every interval seconds until stopped
+ * - parameter arg: the reporter
+ */
+static void *reportLoop(void *arg) {
+    struct reporter *r = arg;
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+
+    pthread_mutex_lock(&reportMutex);
+    while(!r->stop) {
+        deadline.tv_sec += r->interval;
+        while(!r->stop && pthread_cond_timedwait(&reportCond, &reportMutex, &deadline) == 0);
+        if(!r->stop) r->print(r->session);
+    }
+    pthread_mutex_unlock(&reportMutex);
+    return NULL;
+}
+
+/**
+ * starts a reporter thread if it has an interval
+ * - parameter r: the reporter
+ * - parameter session: passed to its print function
+ */
+static void startReporter(struct reporter *r, netman_session *session) {
+    if(r->interval <= 0) return;
+    r->session = session;
+    r->running = pthread_create(&r->thread, NULL, reportLoop, r) == 0;
+}
+
+/**
+ * stops a reporter thread, if it was started
+ * - parameter r: the reporter
+ */
+static void stopReporter(struct reporter *r) {
+    if(!r->running) return;
+    pthread_mutex_lock(&reportMutex);
+    r->stop = true;
+    pthread_cond_broadcast(&reportCond);
+    pthread_mutex_unlock(&reportMutex);
+    pthread_join(r->thread, NULL);
+    r->running = false;
+}
+
+/**
+ * Prints one series total for the history command
+ * - parameter series: name of the series
+ * - parameter bytes: bytes in the queried range
+ * - parameter ctx: a `struct seriesFilter`
+ */
+static void printSeries(const char *series, u_int64_t bytes, void *ctx) {
+    struct seriesFilter *filter = ctx;
+    if(filter->name && strncmp(filter->name, series, HISTORY_NAME_LEN) != 0) return;
+
+    if(filter->human) {
+        printf("%s: %0.2f", series, bytes / 1000000.0);
+    } else {
+        printf("%s: %llu", series, (unsigned long long) bytes);
+    }
+    if(verbose_flag || label_flag) {
+        printf(filter->human ? " Mb" : " bytes");
+    }
+    printf("\n");
+}
+
+/**
+ * Parses a time for --since and --until
+ * Accepts seconds since the epoch, "YYYY-MM-DD[ HH:MM[:SS]]" or "HH:MM[:SS]" for today, in local time
+ * - parameter str: the time
+ * - parameter out: set to the time
+ * - returns: 0 on success, otherwise error
+ */
+static int parseTime(const char *str, time_t *out) {
+    static const char *formats[] = {
+        "%Y-%m-%d %H:%M:%S", "%Y-%m-%d %H:%M", "%Y-%m-%d", "%H:%M:%S", "%H:%M", NULL
+    };
+    char *end = NULL;
+    long long epoch = strtoll(str, &end, 10);
+    if(end != str && *end == '\0') {
+        *out = (time_t) epoch;
+        return 0;
+    }
+
+    time_t now = time(NULL);
+    for(int i = 0; formats[i] != NULL; i++) {
+        struct tm tm;
+        localtime_r(&now, &tm);
+        tm.tm_hour = tm.tm_min = tm.tm_sec = 0;
+        end = strptime(str, formats[i], &tm);
+        if(end == NULL || *end != '\0') continue;
+
+        tm.tm_isdst = -1;
+        *out = mktime(&tm);
+        return 0;
+    }
+    return ERR_OPTIONS;
+}
+
+/**
+ * - parameter arg: the argument before a non-option argument
+ * - returns: true if `arg` is an option that takes the next argument as its value
+ */
+static int takesValue(char *arg) {
+    static char *valueOptions[] = {
+        "-l", "--limit", "-c", "--command", "-B", "--buffer-max", "-A", "--affinity",
+        "--since", "--until", "--resolution",
+        "--top-interval", "--budgets", "--stats-interval", "--sample",
+        "--quota", "--quota-file", "--aggregator", "--group", "--port", "--lease",
+        "--jobs", "--concurrency", "--watch", "--rx-limit", "--tx-limit", NULL
+    };
+    for(int i = 0; valueOptions[i] != NULL; i++) {
+        if(strcmp(arg, valueOptions[i]) == 0) return true;
+    }
+    return false;
+}
 
 /**
  * - parameter argc: the number of arguments
@@ -24,6 +531,35 @@ int main(int argc, char *argv[]) {
       {"all",       no_argument, NULL, 'a'},
       {"run",       no_argument, NULL, 'r'},
       {"human",     no_argument, NULL, 'H'},
+      {"buffer-max",required_argument, NULL, 'B'},
+      {"affinity",  required_argument, NULL, 'A'},
+      {"hugepages", no_argument, &hugepages_flag, 1},
+      {"shm",       optional_argument, NULL, 'S'},
+      {"histogram", no_argument, &histogram_flag, 1},
+      {"history",   optional_argument, NULL, 'Y'},
+      {"resolution",required_argument, NULL, 'R'},
+      {"top",       optional_argument, NULL, 'K'},
+      {"top-interval",required_argument, NULL, 'N'},
+      {"budgets",   required_argument, NULL, 'P'},
+      {"stats",     no_argument, NULL, 'Q'},
+      {"dedup",     optional_argument, NULL, 'D'},
+      {"stats-interval",required_argument, NULL, 'J'},
+      {"since",     required_argument, NULL, 'F'},
+      {"until",     required_argument, NULL, 'U'},
+      {"sockets",   optional_argument, NULL, 'O'},
+      {"sample",    required_argument, NULL, 'E'},
+      {"quota",     required_argument, NULL, 'G'},
+      {"quota-file",required_argument, NULL, 'W'},
+      {"aggregator",required_argument, NULL, 'X'},
+      {"group",     required_argument, NULL, 'Z'},
+      {"port",      required_argument, NULL, 'T'},
+      {"lease",     required_argument, NULL, 'L'},
+      {"jobs",      required_argument, NULL, 'V'},
+      {"concurrency",required_argument, NULL, 'C'},
+      {"watch",     required_argument, NULL, 'w'},
+      {"rx-limit",  required_argument, NULL, 'x'},
+      {"busy-poll", optional_argument, NULL, 'b'},
+      {"tx-limit",  required_argument, NULL, 'y'},
       {NULL, 0, NULL, 0}
     };
 
@@ -33,15 +569,52 @@ int main(int argc, char *argv[]) {
     int totalFlag = 0;              // flag to be set if the user wants --totalbytes
     int inFlag = 0;                 // flag to be set if the user wants --ibytes
     int outFlag = 0;                // flag to be set if the user wants --obytes
-    int limit=0;                    // flag to be set if the user wants --limit
+    u_int64_t limit = 0;            // byte limit, set by --limit, 0 is unlimited
     int humanFlag = 0;              // flag to be set if the user wants -H
     int option_index = 0;           // an index for options
     int num_options = 0;            // stores the number of correct options used
     int runtilComplete = 0;
+    int affinityTags[20] = {0};     // affinity tag per capture thread, set by --affinity
+    int affinityCount = 0;          // number of tags in affinityTags, -1 for auto
+    char *statsName = NULL;         // shared memory name if --shm is set
+    u_int32_t bufferMax = BPF_MAXBUFSIZE; // set by --buffer-max
+    char *historyPath = NULL;       // history file if --history is set
+    int topK = 0;                   // heavy hitters to print, set by --top
+    struct reporter topReporter = {.print = printTop};      // interval set by --top-interval
+    int statsFlag = 0;              // flag set by --stats
+    int dedupFlag = 0;              // flag set by --dedup
+    u_int64_t dedupWindow = 0;      // usec, set by --dedup, 0 for the default
+    struct reporter statsReporter = {.print = printStats};  // interval set by --stats-interval
+    int captured = 0;               // set once captures are running
+    char *budgetsPath = NULL;       // prefix budget file, set by --budgets
+    u_int32_t sample = 0;           // count 1 in this many IPv4 packets, set by --sample
+    char *quotaName = NULL;         // named quota, set by --quota
+    int quotaDefine = 0;            // --quota gave the quota's limit
+    u_int64_t quotaLimit = 0;       // bytes per period, set by --quota
+    u_int32_t quotaPeriod = 0;      // seconds, set by --quota
+    char *quotaPath = QUOTA_DEFAULT_PATH; // set by --quota-file
+    char *aggregator = NULL;        // aggregator host, set by --aggregator
+    char *aggregatorPort = LEASE_DEFAULT_PORT; // set by --aggregator or --port
+    char *group = LEASE_DEFAULT_GROUP; // the group budget to share, set by --group
+    u_int32_t leaseMsec = 0;        // how long the aggregator's grants hold, set by --lease
+    char *jobsPath = NULL;          // job file, set by --jobs
+    int concurrency = 0;            // jobs to run at once, set by --concurrency, 0 for all
+    struct job *jobs = NULL;        // the job file's jobs
+    int jobCount = 0;
+    u_int32_t busyPollUsec = 0;     // spin on reads before blocking, set by --busy-poll
+    pid_t limitPid = 0;             // the command, killed by `killOnLimit` with --busy-poll
+    u_int64_t rxLimit = 0;          // received byte limit, set by --rx-limit
+    u_int64_t txLimit = 0;          // sent byte limit, set by --tx-limit
+    u_int64_t watchNsec = 0;        // interval of bytes --watch, 0 to print once
+    int socketsFlag = 0;            // count the command's sockets instead of capturing, set by --sockets
+    u_int32_t socketsInterval = 0;  // msec between socket polls, set by --sockets, 0 for the default
+    u_int32_t resolution = 0;       // seconds between history ticks, set by --resolution
+    time_t until = time(NULL);      // end of the history query, set by --until
+    time_t since = until - 86400;   // start of the history query, set by --since
+    netman_session *session = NULL; // capture session for monitor
     COMMAND cmd = BYTES;            // enum for the command to use (deafult BYTES)
-    bytesRead = 0;
 
-    while ((ch = getopt_long(argc, argv, "irHol:vthi:c:", long_options, &option_index)) != -1) {
+    while ((ch = getopt_long(argc, argv, "irHol:vthi:c:B:A:", long_options, &option_index)) != -1) {
         num_options++;
         switch (ch) {
             case 'I':
@@ -57,6 +630,129 @@ int main(int argc, char *argv[]) {
             case 'c':
                 command = optarg;
                 break;
+            case 'B': {
+                u_int64_t kb = 0;
+                if(parseBytes(optarg, &kb) < 0 || kb == 0 || kb > UINT32_MAX / 1024) {
+                    printERR("--buffer-max must be a number of KB from 1 to %u.", UINT32_MAX / 1024);
+                    usage();
+                    return 0;
+                }
+                bufferMax = (u_int32_t) kb * 1024;
+                break;
+            }
+            case 'S':
+                statsName = optarg ? optarg : NETSTATS_DEFAULT_NAME;
+                break;
+            case 'Y':
+                historyPath = optarg ? optarg : HISTORY_DEFAULT_PATH;
+                break;
+            case 'R':
+                resolution = atoi(optarg);
+                break;
+            case 'K':
+                topK = optarg ? atoi(optarg) : SKETCH_DEFAULT_K;
+                break;
+            case 'N':
+                topReporter.interval = atoi(optarg);
+                break;
+            case 'P':
+                budgetsPath = optarg;
+                break;
+            case 'Q':
+                statsFlag = 1;
+                break;
+            case 'D':
+                dedupFlag = 1;
+                dedupWindow = optarg ? (u_int64_t) atoi(optarg) * 1000 : 0;
+                break;
+            case 'E':
+                sample = (u_int32_t) atoi(optarg);
+                break;
+            case 'G':
+                quotaName = optarg;
+                quotaDefine = parseQuota(optarg, &quotaLimit, &quotaPeriod);
+                if(quotaDefine < 0) {
+                    printERR("--quota must be <name>[,<limit>[,daily|<seconds>]] with a name under %d characters.", QUOTA_NAME_LEN);
+                    usage();
+                    return 0;
+                }
+                break;
+            case 'W':
+                quotaPath = optarg;
+                break;
+            case 'X': {
+                aggregator = optarg;
+                char *port = splitPort(optarg);
+                if(port) aggregatorPort = port;
+                break;
+            }
+            case 'V':
+                jobsPath = optarg;
+                break;
+            case 'C':
+                concurrency = atoi(optarg);
+                break;
+            case 'b':
+                busyPollUsec = optarg ? (u_int32_t) atoi(optarg) : BUSY_POLL_DEFAULT_USEC;
+                break;
+            case 'x':
+                if(parseBytes(optarg, &rxLimit) < 0) {
+                    printERR("--rx-limit must be a number of bytes.");
+                    usage();
+                    return 0;
+                }
+                break;
+            case 'y':
+                if(parseBytes(optarg, &txLimit) < 0) {
+                    printERR("--tx-limit must be a number of bytes.");
+                    usage();
+                    return 0;
+                }
+                break;
+            case 'w': {
+                double seconds = atof(optarg);
+                if(seconds * 1e9 < 1) {
+                    printERR("The watch interval must be a positive number of seconds.");
+                    usage();
+                    return 0;
+                }
+                watchNsec = (u_int64_t) (seconds * 1e9);
+                break;
+            }
+            case 'Z':
+                group = optarg;
+                break;
+            case 'T':
+                aggregatorPort = optarg;
+                break;
+            case 'L':
+                leaseMsec = (u_int32_t) atoi(optarg);
+                break;
+            case 'O':
+                socketsFlag = 1;
+                socketsInterval = optarg ? (u_int32_t) atoi(optarg) : 0;
+                break;
+            case 'J':
+                statsFlag = 1;
+                statsReporter.interval = atoi(optarg);
+                break;
+            case 'F':
+            case 'U':
+                if(parseTime(optarg, ch == 'F' ? &since : &until) < 0) {
+                    printERR("Unknown time \'%s\'.", optarg);
+                    usage();
+                    return 0;
+                }
+                break;
+            case 'A':
+                if(strncmp(optarg, "auto", 4) == 0) {
+                    affinityCount = -1;
+                    break;
+                }
+                for(char *tag = strtok(optarg, ","); tag && affinityCount < 20; tag = strtok(NULL, ",")) {
+                    affinityTags[affinityCount++] = atoi(tag);
+                }
+                break;
             case 't':
                 totalFlag = 1;
                 break;
@@ -67,7 +763,11 @@ int main(int argc, char *argv[]) {
                 humanFlag = 1;
                 break;
             case 'l':
-                limit = atoi(optarg);
+                if(parseBytes(optarg, &limit) < 0) {
+                    printERR("--limit must be a number of bytes.");
+                    usage();
+                    return 0;
+                }
             case 'o':
                 outFlag = 1;
                 break;
@@ -94,7 +794,15 @@ int main(int argc, char *argv[]) {
 
     // if human flag set then convert bytes to MB
     if(humanFlag == 1) {
+        if(limit > UINT64_MAX / 1000000 || rxLimit > UINT64_MAX / 1000000 || txLimit > UINT64_MAX / 1000000) {
+            printERR("Limits must be under %llu megabytes.", (unsigned long long) (UINT64_MAX / 1000000));
+            usage();
+            return 0;
+        }
         limit = limit * 1000000;
+        quotaLimit = quotaLimit * 1000000;
+        rxLimit = rxLimit * 1000000;
+        txLimit = txLimit * 1000000;
     }
 
     // figure out what command to use and if the user wants to use a single interface
@@ -108,15 +816,16 @@ int main(int argc, char *argv[]) {
         else if(strncmp(argv[count], "down", 4) == 0) cmd = DOWN;
         else if(strncmp(argv[count], "bytes", 5) == 0) cmd = BYTES;
         else if(strncmp(argv[count], "monitor", 7) == 0) cmd = MONITOR;
+        else if(strncmp(argv[count], "history", 7) == 0) cmd = HISTORY;
+        else if(strncmp(argv[count], "quota", 5) == 0) cmd = QUOTA;
+        else if(strncmp(argv[count], "aggregate", 9) == 0) cmd = AGGREGATE;
         else if((char) *(argv[count]) != '-' && !interface_to_use) {
-            if (strncmp(argv[count-1], "-l", 2) != 0 &&  strncmp(argv[count-1], "--limit", 5) != 0 &&
-                strncmp(argv[count-1], "-c", 2) != 0 &&  strncmp(argv[count-1], "--command", 5) != 0) {
+            if (!takesValue(argv[count-1])) {
 
                 interface_to_use = argv[count];
             }
         } else if((char) *(argv[count]) != '-') {
-            if (strncmp(argv[count-1], "-l", 2) != 0 &&  strncmp(argv[count-1], "--limit", 5) != 0 &&
-                strncmp(argv[count-1], "-c", 2) != 0 &&  strncmp(argv[count-1], "--command", 5) != 0) {
+            if (!takesValue(argv[count-1])) {
 
                 printERR("Unknown command \'%s\'.", argv[count])
                 usage();
@@ -127,84 +836,190 @@ int main(int argc, char *argv[]) {
       }
     }
 
-    list *interfaceList = NULL;
+    struct iftable *interfaceTable = iftable_create();
 
     printVERBOSE("argc %d num_options %d\n", argc, num_options);
 
-    // Create the interface list
-    // put the one interface in a list if specified, otherwise get them all
+    if(!interfaceTable) {
+        printERR("Unable to list interfaces.");
+        return ERR_ALLOC;
+    }
+
+    // Fill the interface table, with just the one interface if specified
     if(interface_to_use) {
         printVERBOSE("using selected interface %s", interface_to_use);
-        interfaceList = calloc(sizeof(struct list), 1);
-        interfaceList->content = calloc(sizeof(struct interface), 1);
-        ((struct interface *)interfaceList->content)->name = malloc(strnlen(interface_to_use, MAXCOMLEN));
-        strncpy(((struct interface *)interfaceList->content)->name, interface_to_use, MAXCOMLEN);
-
-        // get if_addr and byte info
-        list *tmpInterfaceList = NULL;
-        interfaces(&tmpInterfaceList);
-        list *root = tmpInterfaceList;
-        while(root != NULL) {
-            if(strncmp(((struct interface *)root->content)->name, interface_to_use, MAXCOMLEN) == 0) {
-                ((struct interface *)interfaceList->content)->if_addr = malloc(sizeof(struct sockaddr));
-                memcpy(((struct interface *)interfaceList->content)->if_addr, ((struct interface *)root->content)->if_addr, sizeof(struct sockaddr)); 
-                ((struct interface *)interfaceList->content)->obytes = ((struct interface *)root->content)->obytes;
-                ((struct interface *)interfaceList->content)->ibytes = ((struct interface *)root->content)->ibytes;        
-            }
-            root = root->next;
+        if(iftable_only(interfaceTable, interface_to_use) < 0) {
+            printERR("Interface name '%s' is too long.", interface_to_use);
+            iftable_free(interfaceTable);
+            return ERR_OPTIONS;
         }
-        if(tmpInterfaceList) freeInterfaces(&tmpInterfaceList);
-
     } else {
         printVERBOSE("using all interfaces\n");
-        interfaces(&interfaceList);
+    }
+    int listed = iftable_refresh(interfaceTable);
+    if(listed < 0) {
+        iftable_free(interfaceTable);
+        return listed;
     }
 
     if(verbose_flag) {
         printf("=== Selected interfaces ===\n");
-        loopInterfaces(interfaceList, print);
+        iftable_print(stdout, interfaceTable);
         printf("=== end ===\n");
         if(command) printf("Using command: %s\n", command);
         if(cmd == MONITOR) {
             if(limit == 0) {
                 printf("Limit is unlimited.\n");
             } else {
-                printf("Limit is %d\n", limit);
+                printf("Limit is %llu\n", (unsigned long long) limit);
             }
+            if(rxLimit > 0) printf("RX limit is %llu\n", (unsigned long long) rxLimit);
+            if(txLimit > 0) printf("TX limit is %llu\n", (unsigned long long) txLimit);
         }
     }
 
     int ret_status = 0;
     switch(cmd) {
         case UP:
-            ret_status = loopInterfaces(interfaceList, set_up);
+            ret_status = setInterfacesUp(interfaceTable, true);
             if(ret_status != 0) {
                 printERR("Failed to turn on interface, make sure you are sudo.\n");
             }
             break;
         case DOWN:
-            ret_status = loopInterfaces(interfaceList, set_down);
+            ret_status = setInterfacesUp(interfaceTable, false);
             if(ret_status != 0) {
                 printERR("Failed to shutdown interface, make sure you are sudo.\n");
             }
             break;
         case MONITOR: {
+            session = netman_open();
+            if(session == NULL) {
+                printERR("Unable to create a capture session.");
+                ret_status = ERR_ALLOC;
+                break;
+            }
+            netman_set_buffer_max(session, bufferMax);
+            netman_set_hugepages(session, hugepages_flag);
+            if(busyPollUsec > 0) {
+                if(netman_set_busy_poll(session, busyPollUsec) < 0) {
+                    printERR("--busy-poll spins at most %d usec.", BUSY_POLL_MAX_USEC);
+                    ret_status = ERR_OPTIONS;
+                    break;
+                }
+                netman_on_limit(session, killOnLimit, &limitPid);
+                // spinning threads each keep a core, keep them apart
+                if(affinityCount == 0) affinityCount = -1;
+            }
+            netman_set_histograms(session, histogram_flag);
+            if(topK > 0 && netman_set_top(session, topK) < 0) {
+                printERR("--top must be at most %d.", SKETCH_MAX_K);
+                topK = 0;
+            }
+            if(dedupFlag && netman_set_dedup(session, dedupWindow) < 0) {
+                printERR("Unable to create the duplicate filter.");
+            }
+            if(netman_set_sample(session, sample) < 0) {
+                printERR("--sample must be a power of two up to %d.", NETMAN_SAMPLE_MAX);
+                ret_status = ERR_OPTIONS;
+                break;
+            }
+            if(budgetsPath) {
+                int prefixes = netman_set_budgets(session, budgetsPath);
+                if(prefixes < 0) {
+                    printERR("Unable to load budgets from %s.", budgetsPath);
+                    ret_status = prefixes;
+                    break;
+                }
+                printVERBOSE("Loaded %d prefixes in %d budgets", prefixes, netman_budget_count(session));
+            }
+            if(quotaName) {
+                if(quotaDefine && defineQuota(quotaPath, quotaName, quotaLimit, quotaPeriod) < 0) {
+                    printERR("Unable to define quota %s in %s.", quotaName, quotaPath);
+                    ret_status = ERR_OPEN;
+                    break;
+                }
+                ret_status = netman_set_quota(session, quotaPath, quotaName);
+                if(ret_status == ERR_QUOTA) {
+                    printERR("Quota %s is used up, not starting.", quotaName);
+                    break;
+                } else if(ret_status < 0) {
+                    printERR("Unable to use quota %s from %s.", quotaName, quotaPath);
+                    break;
+                }
+            }
+            if(aggregator) {
+                ret_status = netman_set_aggregator(session, aggregator, aggregatorPort, group);
+                if(ret_status == ERR_QUOTA) {
+                    printERR("Group %s's budget is used up, not starting.", group);
+                    break;
+                } else if(ret_status < 0) {
+                    printERR("No grant from the aggregator at %s port %s.", aggregator, aggregatorPort);
+                    break;
+                }
+            }
+            if(jobsPath) {
+                if(command) {
+                    printERR("--jobs runs its own commands, it can't be used with --command.");
+                    ret_status = ERR_OPTIONS;
+                    break;
+                }
+                int line = 0;
+                jobCount = jobs_load(jobsPath, &jobs, &line);
+                if(jobCount < 0) {
+                    if(line > 0) printERR("%s:%d is not '<name> <limit> <rate> <interfaces|all> <command>'.", jobsPath, line);
+                    printERR("Unable to load jobs from %s.", jobsPath);
+                    ret_status = jobCount;
+                    break;
+                }
+                if((ret_status = jobs_add(session, jobs, jobCount)) < 0) {
+                    printERR("Unable to add the jobs.");
+                    break;
+                }
+                printVERBOSE("Loaded %d jobs", jobCount);
+            }
+            netman_set_limit(session, limit);
+            netman_set_direction_limits(session, rxLimit, txLimit);
+            if(historyPath && netman_set_history(session, historyPath, resolution, command ? "command" : "monitor") < 0) {
+                printERR("Unable to open history file %s.", historyPath);
+            }
+
+            // publish live counters before the threads start so each can claim an entry
+            struct netstats_entry *budgetStats = NULL;
+            if(statsName) {
+                if(netman_set_shm(session, statsName) < 0) {
+                    printERR("Unable to create shared memory segment %s.", statsName);
+                } else {
+                    budgetStats = netman_shm_budget(session, command ? "command" : "monitor", limit);
+                }
+            }
+
             // Create a new thread for each interface so they 
             // can each have a bfp
             // Then create an additional fork for the command if present
             // Exit the command fork if the limit is reached,
             // if no command is present, then just exit the application
-            list *root = interfaceList;
+            if(socketsFlag && command == NULL) {
+                printERR("--sockets needs a --command.");
+                ret_status = ERR_OPTIONS;
+                break;
+            }
+
             int threadCounter = 0;
-            while(root != NULL) {
-                pthread_t thread;
-                char * name = (char *) ((struct interface *)root->content)->name;
+            for(int row = 0; !socketsFlag && row < interfaceTable->count; row++) {
+                char *name = interfaceTable->names[row];
+                // every interface is captured once, only if a job counts it
+                if(jobs && !netman_jobs_watch(session, name)) continue;
+                // auto gives every thread its own tag so they spread across caches
+                int tag = THREAD_AFFINITY_TAG_NULL;
+                if(affinityCount < 0) {
+                    tag = threadCounter + 1;
+                } else if(affinityCount > 0) {
+                    tag = affinityTags[threadCounter % affinityCount];
+                }
                 printDEBUG("creating pthread for %s\n", name);
-                ret_status |= pthread_create(&thread, NULL, monitor, (void *) name);
-                pthread_mutex_lock(&thread_mutex);
-                threads[threadCounter++] = thread;
-                pthread_mutex_unlock(&thread_mutex);
-                root = root->next;
+                ret_status |= netman_capture(session, name, tag);
+                threadCounter++;
             }
 
             if(ret_status != 0) {
@@ -217,12 +1032,12 @@ int main(int argc, char *argv[]) {
 
             // wait for threads for about five seocnds
             // this gives the filters time to get setup
-            for(int i = 0; i < 5; i++) {
+            for(int i = 0; i < 5 && !socketsFlag; i++) {
                 sleep(1);
             }
 
-            printDEBUG("thread count: %d\n", threadCount());
-            if(threadCount() <= 0) {
+            printDEBUG("thread count: %d\n", netman_capture_count(session));
+            if(!socketsFlag && netman_capture_count(session) <= 0) {
                 printERR("No threads to monitor.");
                 if(geteuid() != 0) {
                     printERR("Try again with sudo");
@@ -233,12 +1048,37 @@ int main(int argc, char *argv[]) {
                 break;
             }
 
+            captured = true;
+            if(busyPollUsec > 0 && netman_capture_count(session) >= sysconf(_SC_NPROCESSORS_ONLN)) {
+                fprintf(stderr, "[!] --busy-poll spins a core per interface, with no core left over it adds latency.\n");
+            }
+            if(topK > 0) startReporter(&topReporter, session);
+            if(statsFlag) startReporter(&statsReporter, session);
+
+            if(jobs) {
+                ret_status = jobs_run(session, jobs, jobCount, concurrency);
+                printJobs(session, jobs, jobCount, humanFlag);
+                if(netman_drops(session) > 0) {
+                    fprintf(stderr, "[!] The kernel dropped %llu packets, the byte counts are estimates.\n", netman_drops(session));
+                }
+                if(histogram_flag) printHistograms(session, interfaceTable);
+                break;
+            }
+
             pid_t pid = runCmd(command);
             // if command failed, then stop
             if(pid < 0) {
                 printERR("Failed to start command");
                 break;
             }
+            __atomic_store_n(&limitPid, pid, __ATOMIC_RELEASE);
+
+            // the command leads its own process group, its sockets are found by that group
+            if(socketsFlag && (ret_status = netman_poll_sockets(session, pid, socketsInterval)) < 0) {
+                printERR("Unable to poll the command's sockets.");
+                killCmd(pid);
+                break;
+            }
 
             // run the command and output the total bytes
             if(pid > 0 && runtilComplete) {
@@ -249,7 +1089,7 @@ int main(int argc, char *argv[]) {
                 if(verbose_flag || label_flag) {
                     printf("Total RX+TX: ");
                 }
-                u_int64_t rbytes = bytesRead;
+                u_int64_t rbytes = netman_bytes(session);
                 if(humanFlag == 1) {
                     rbytes = rbytes / 1000000.0;
                 }
@@ -262,55 +1102,125 @@ int main(int argc, char *argv[]) {
                     }
                 }
                 printf("\n");
+                if(netman_drops(session) > 0) {
+                    fprintf(stderr, "[!] The kernel dropped %llu packets, RX+TX is an estimate.\n", netman_drops(session));
+                }
+                if(histogram_flag) printHistograms(session, interfaceTable);
                 break;
             }
 
+            // watch the command's exit instead of polling its pid
+            int kq = -1;
+            if(pid > 0) {
+                kq = watchCmd(pid);
+            }
+            struct timespec poll = {0, CMD_POLL_NSEC};
+
             // run the command and kill it if it reaches the byte limit
-            while(limit >= 0) {
+            for(;;) {
+                netstats_publish(budgetStats, netman_bytes(session), 0, netman_drops(session));
+
                 // check if byte limit reached, 0 is unlimited
-                if((int) bytesRead >= limit && limit > 0) {
+                if(netman_limit_reached(session)) {
                         printVERBOSE("Byte limit reached");
                         if(pid > 0) {
                             printVERBOSE("Killing command");
-                            kill(pid, SIGKILL);
+                            killCmd(pid);
                         }
                         break;
                 }
 
                  // check if command is done
                 if(pid > 0) {
-                    if(getpgid(pid) <= 0) {
+                    if(cmdExited(kq, pid, &poll)) {
                         printVERBOSE("Command finished before limit was reached");
+                        // take down anything the command left running in its group,
+                        // the command itself was reaped so its pid may be reused
+                        killGroup(pid);
                         break;
                     }
                 }
             }
+            if(kq >= 0) close(kq);
+            if(netman_drops(session) > 0) {
+                fprintf(stderr, "[!] The kernel dropped %llu packets, the byte count is an estimate.\n", netman_drops(session));
+            }
+            if(histogram_flag) printHistograms(session, interfaceTable);
+            break;
+        }
+        case HISTORY: {
+            struct seriesFilter filter = {interface_to_use, humanFlag};
+            ret_status = history_query(historyPath ? historyPath : HISTORY_DEFAULT_PATH, since, until, printSeries, &filter);
+            if(ret_status < 0) {
+                printERR("Unable to read history file %s.", historyPath ? historyPath : HISTORY_DEFAULT_PATH);
+            }
+            break;
+        }
+        case QUOTA:
+            if(quotaName && quotaDefine) {
+                ret_status = defineQuota(quotaPath, quotaName, quotaLimit, quotaPeriod);
+            }
+            if(ret_status == 0) {
+                ret_status = printQuotas(quotaPath, quotaName, humanFlag);
+            }
+            if(ret_status < 0) {
+                printERR("Unable to read quota file %s.", quotaPath);
+            }
+            break;
+        case AGGREGATE: {
+            if(limit == 0) {
+                printERR("aggregate needs a --limit for each group.");
+                ret_status = ERR_OPTIONS;
+                break;
+            }
+            struct lease_server *server = lease_server_create(aggregatorPort, limit, leaseMsec);
+            if(server == NULL) {
+                printERR("Unable to listen on port %s.", aggregatorPort);
+                ret_status = ERR_SOCKET;
+                break;
+            }
+            printVERBOSE("Serving a budget of %llu bytes per group on port %d", (unsigned long long) limit, lease_server_port(server));
+            while(lease_server_serve(server, -1) >= 0);
+            lease_server_free(server);
             break;
         }
         default: {
-            // print the byte information
-            list *root = interfaceList;
-            float in = 0, out = 0;
-            while(root != NULL) {
-                in += ((struct interface *)root->content)->ibytes;
-                out += ((struct interface *)root->content)->obytes;
-                root = root->next;
+            if(watchNsec > 0) {
+                struct watch *w = watch_create();
+                if(!w) {
+                    printERR("Unable to read the interface counters.");
+                    ret_status = ERR_ALLOC;
+                    break;
+                }
+                if(interface_to_use) ret_status = watch_add(w, interface_to_use);
+                if(ret_status == 0) {
+                    ret_status = watchBytes(w, watchNsec, inFlag ? 'i' : outFlag ? 'o' : 't', humanFlag);
+                }
+                watch_free(w);
+                break;
             }
 
-            if(humanFlag == 1) {
-                in = in / 1000000.0;
-                out = out / 1000000.0;
+            // print the byte information, summed as integers so large counters stay exact
+            u_int64_t in = 0, out = 0;
+            for(int row = 0; row < interfaceTable->count; row++) {
+                in += interfaceTable->ibytes[row];
+                out += interfaceTable->obytes[row];
             }
 
+            u_int64_t bytes = in + out;
             if(inFlag == 1) {
                 if(verbose_flag || label_flag) printf("RX: ");
-                printf("%0.2f", in);
+                bytes = in;
             } else if(outFlag == 1) {
                 if(verbose_flag || label_flag) printf("TX: ");
-                printf("%0.2f", out);
+                bytes = out;
             } else {
                 if(verbose_flag || label_flag) printf("RX+TX: ");
-                printf("%0.2f", in+out);
+            }
+            if(humanFlag == 1) {
+                printf("%0.2f", bytes / 1000000.0);
+            } else {
+                printf("%llu", (unsigned long long) bytes);
             }
             if(verbose_flag || label_flag) {
                 if(humanFlag == 1) {
@@ -324,7 +1234,20 @@ int main(int argc, char *argv[]) {
         }
     }
 
-    if(interfaceList) freeInterfaces(&interfaceList);
+    stopReporter(&topReporter);
+    stopReporter(&statsReporter);
+    if(captured && topK > 0) printTop(session);
+    if(captured && statsFlag) printStats(session);
+    if(captured) printBudgets(session);
+    if(captured && sample > 1) printEstimate(session);
+    struct quota_entry quota;
+    if(captured && netman_quota(session, &quota) == 0) printQuotaEntry(&quota, humanFlag);
+    if(captured && aggregator) printGroup(session, group, humanFlag);
+    if(captured && (rxLimit > 0 || txLimit > 0)) printDirections(session, rxLimit, txLimit, humanFlag);
+
+    iftable_free(interfaceTable);
+    jobs_free(jobs, jobCount);
+    if(session) netman_close(session);
 
     return ret_status;
 }
\ No newline at end of file
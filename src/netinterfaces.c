@@ -3,6 +3,7 @@
 
 /** 
  * http://stackoverflow.com/questions/3055622/howto-check-a-network-devices-status-in-c
+ * Callers checking often can read the flags column of an interface table instead, see `iftable_refresh`
  * - parameter interface: name of the network interface
  * - returns: 0 if up, otherwise 1, negative number on error
  */
@@ -22,6 +23,7 @@ int getInterfaceStatus(char *interface) {
     int res = ioctl(fd, SIOCGIFFLAGS, &ethreq);
     if(res < 0) {
     	printERR("Unable to check %s's status.", interface);
+    	close(fd);
     	return res;
     }
 
@@ -47,8 +49,19 @@ int isInterfaceUp(char *interface) {
  * - parameter interfaces: a linked list of network interfaces of type `struct interface`
  */
 void interfaces(list **interfaces) {
-    struct ifaddrs *ifap, *itmp;
-    getifaddrs(&ifap);
+    struct ifaddrs *ifap;
+    if(getifaddrs(&ifap) < 0) return;
+    interfacesFrom(ifap, interfaces);
+    freeifaddrs(ifap);
+}
+
+/**
+ * sets a list of network interfaces from the link layer entries of an address list
+ * - parameter ifap: addresses from `getifaddrs`, or built by hand
+ * - parameter interfaces: an empty linked list of network interfaces of type `struct interface`
+ */
+void interfacesFrom(struct ifaddrs *ifap, list **interfaces) {
+    struct ifaddrs *itmp;
     list *prev = NULL;
     for(itmp = ifap; itmp; itmp = itmp->ifa_next) {
       
@@ -58,8 +71,9 @@ void interfaces(list **interfaces) {
         tmp->content = calloc(sizeof(struct interface),1);
         struct if_data *data = itmp->ifa_data;
 
-        ((struct interface *)tmp->content)->name = malloc(strnlen(itmp->ifa_name, MAXCOMLEN));
-        strncpy(((struct interface *)tmp->content)->name, itmp->ifa_name, MAXCOMLEN);
+        size_t nameLen = strnlen(itmp->ifa_name, MAXCOMLEN);
+        ((struct interface *)tmp->content)->name = malloc(nameLen + 1);
+        strlcpy(((struct interface *)tmp->content)->name, itmp->ifa_name, nameLen + 1);
 
         ((struct interface *)tmp->content)->if_addr = malloc(sizeof(struct sockaddr));
         memcpy(((struct interface *)tmp->content)->if_addr, itmp->ifa_addr, sizeof(struct sockaddr));
@@ -85,7 +99,66 @@ void interfaces(list **interfaces) {
         }
       }
     }
-    freeifaddrs(ifap);
+}
+
+/**
+ * reads the byte counters of a single interface using `getifaddrs`
+ * - parameter ifname: name of the interface
+ * - parameter ibytes: set to the RX bytes
+ * - parameter obytes: set to the TX bytes
+ * - returns: 0 on success, otherwise error
+ */
+int interfaceBytes(char *ifname, u_long *ibytes, u_long *obytes) {
+	if(!ifname || !ibytes || !obytes) return ERR_NULL;
+
+	struct ifaddrs *ifap, *itmp;
+	if(getifaddrs(&ifap) < 0) {
+		return ERR;
+	}
+
+	int res = ERR_NULL;
+	for(itmp = ifap; itmp; itmp = itmp->ifa_next) {
+		if (itmp->ifa_data != NULL && itmp->ifa_addr->sa_family == AF_LINK &&
+			strncmp(itmp->ifa_name, ifname, IFNAMSIZ) == 0) {
+			struct if_data *data = itmp->ifa_data;
+			*ibytes = data->ifi_ibytes;
+			*obytes = data->ifi_obytes;
+			res = 0;
+			break;
+		}
+	}
+	freeifaddrs(ifap);
+	return res;
+}
+
+/**
+ * reads the link layer address of a single interface using `getifaddrs`
+ * - parameter ifname: name of the interface
+ * - parameter mac: set to the ETHER_ADDR_LEN byte address
+ * - returns: 0 on success, otherwise error
+ */
+int interfaceMAC(char *ifname, u_int8_t *mac) {
+	if(!ifname || !mac) return ERR_NULL;
+
+	struct ifaddrs *ifap, *itmp;
+	if(getifaddrs(&ifap) < 0) {
+		return ERR;
+	}
+
+	int res = ERR_NOIF;
+	for(itmp = ifap; itmp; itmp = itmp->ifa_next) {
+		if (itmp->ifa_addr != NULL && itmp->ifa_addr->sa_family == AF_LINK &&
+			strncmp(itmp->ifa_name, ifname, IFNAMSIZ) == 0) {
+			struct sockaddr_dl *sdl = (struct sockaddr_dl *) itmp->ifa_addr;
+			if(sdl->sdl_alen == ETHER_ADDR_LEN) {
+				memcpy(mac, LLADDR(sdl), ETHER_ADDR_LEN);
+				res = 0;
+			}
+			break;
+		}
+	}
+	freeifaddrs(ifap);
+	return res;
 }
 
 /** 
@@ -179,6 +252,57 @@ int set_if_flags(char *ifname, short flags) {
 	 return res;
  }
 
+/**
+ * turns a table of interfaces up or down back to back over a single socket
+ * Each interface's flags are read first so only IFF_UP changes and
+ * interfaces already in the requested state are skipped
+ * - parameter t: table of interfaces
+ * - parameter up: true to turn the interfaces up, false for down
+ * - returns: the number of interfaces that failed, negative on error
+ */
+int setInterfacesUp(const struct iftable *t, int up) {
+	if(!t) return ERR_NULL;
+	int skfd = socket(AF_INET, SOCK_DGRAM, 0);
+	if(skfd < 0) {
+		printERR("Unable to create socket.");
+		return ERR_SOCKET;
+	}
+
+	int changed = 0, skipped = 0, failed = 0;
+	struct ifreq ifr;
+	for(int i = 0; i < t->count; i++) {
+		const char *ifname = t->names[i];
+
+		memset(&ifr, 0, sizeof(ifr));
+		strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+		if(ioctl(skfd, SIOCGIFFLAGS, &ifr) < 0) {
+			printERR("Interface '%s' SIOCGIFFLAGS failed.", ifname);
+			failed++;
+			continue;
+		}
+
+		short flags = up ? (ifr.ifr_flags | IFF_UP) : (ifr.ifr_flags & ~IFF_UP);
+		if(flags == ifr.ifr_flags) {
+			skipped++;
+			continue;
+		}
+
+		ifr.ifr_flags = flags;
+		if(ioctl(skfd, SIOCSIFFLAGS, &ifr) < 0) {
+			printERR("Interface '%s' SIOCSIFFLAGS failed.", ifname);
+			failed++;
+			continue;
+		}
+		printVERBOSE("Interface '%s': flags set to %04X.", ifname, (u_short) flags);
+		changed++;
+	}
+	close(skfd);
+
+	printVERBOSE("%d interface(s) turned %s, %d already %s, %d failed.",
+		changed, up ? "up" : "down", skipped, up ? "up" : "down", failed);
+	return failed;
+}
+
 int set_if_up(char *ifname, short flags)
 {
     return set_if_flags(ifname, flags | IFF_UP);
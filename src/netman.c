@@ -0,0 +1,1223 @@
+#include "general.h"
+#include "session.h"
+#include "netman.h"
+#include "netinterfaces.h"
+#include <math.h> // sqrt
+
+/**
+ * Frees a capture's counters and the capture, its thread must be stopped
+ */
+void capture_destroy(struct capture *c) {
+    if(!c) return;
+    free(c->sizes);
+    free(c->gaps);
+    free(c->latency);
+    if(c->macs) {
+        sketch_free(c->macs);
+        sketch_free(c->ips);
+        pthread_mutex_destroy(&c->sketchMutex);
+    }
+    free(c->prefixBytes);
+    free(c->touched);
+    free(c->jobs);
+    free(c);
+}
+
+/**
+ * Creates a session with no captures and no limit
+ * - returns: the session, or NULL on failure
+ */
+netman_session *netman_open(void) {
+    netman_session *session = calloc(1, sizeof(struct netman_session));
+    if(!session) return NULL;
+
+    session->bufferMax = BPF_MAXBUFSIZE;
+    session->sample = 1;
+    if(pthread_mutex_init(&session->mutex, NULL) != 0) {
+        free(session);
+        return NULL;
+    }
+    return session;
+}
+
+/**
+ * Stops every capture, removes the shared memory segment and frees the session
+ * - parameter session: session from `netman_open`
+ */
+void netman_close(netman_session *session) {
+    if(!session) return;
+
+    // threads are asked to stop rather than cancelled, so none stops holding
+    // a lock, and are joined without the session's mutex since they take it
+    pthread_mutex_lock(&session->mutex);
+    int captureCount = session->captureCount;
+    for(int i = 0; i < captureCount; i++) {
+        __atomic_store_n(&session->captures[i]->stop, true, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&session->mutex);
+    for(int i = 0; i < captureCount; i++) {
+        pthread_join(session->captures[i]->thread, NULL);
+    }
+
+    // a last poll charges what the sockets moved since the previous one
+    if(session->sockets) {
+        pthread_mutex_lock(&session->socketsMutex);
+        session->socketsStop = true;
+        pthread_cond_signal(&session->socketsCond);
+        pthread_mutex_unlock(&session->socketsMutex);
+        pthread_join(session->socketsThread, NULL);
+        procsock_free(session->sockets);
+        pthread_cond_destroy(&session->socketsCond);
+        pthread_mutex_destroy(&session->socketsMutex);
+    }
+
+    // the flusher charges what was counted since its last flush
+    if(session->quota) {
+        pthread_mutex_lock(&session->quotaMutex);
+        session->quotaStop = true;
+        pthread_cond_signal(&session->quotaCond);
+        pthread_mutex_unlock(&session->quotaMutex);
+        pthread_join(session->quotaThread, NULL);
+        quota_close(session->quota);
+        pthread_cond_destroy(&session->quotaCond);
+        pthread_mutex_destroy(&session->quotaMutex);
+    }
+
+    // the reporter gives back what is left of the slice
+    if(session->lease) {
+        pthread_mutex_lock(&session->leaseMutex);
+        session->leaseStop = true;
+        pthread_cond_signal(&session->leaseCond);
+        pthread_mutex_unlock(&session->leaseMutex);
+        pthread_join(session->leaseThread, NULL);
+        lease_client_free(session->lease);
+        pthread_cond_destroy(&session->leaseCond);
+        pthread_mutex_destroy(&session->leaseMutex);
+    }
+
+    // the recorder writes a last tick with what the captures counted
+    if(session->history) {
+        pthread_mutex_lock(&session->historyMutex);
+        session->historyStop = true;
+        pthread_cond_signal(&session->historyCond);
+        pthread_mutex_unlock(&session->historyMutex);
+        pthread_join(session->historyThread, NULL);
+        history_close(session->history);
+        pthread_cond_destroy(&session->historyCond);
+        pthread_mutex_destroy(&session->historyMutex);
+    }
+
+    for(int i = 0; i < session->captureCount; i++) {
+        capture_destroy(session->captures[i]);
+    }
+    free(session->captures);
+
+    prefix_free(session->prefixes);
+    for(int i = 0; i < session->jobCount; i++) {
+        free(session->jobs[i].interfaces);
+    }
+    free(session->jobs);
+    dedup_free(session->dedup);
+    if(session->stats) netstats_destroy(session->stats, session->statsName);
+    free(session->statsName);
+    pthread_mutex_destroy(&session->mutex);
+    free(session);
+}
+
+/**
+ * Sets the most kernel buffer a bpf may grow to when it drops packets,
+ * only applies to captures started afterwards
+ * - parameter bytes: the ceiling in bytes
+ * - returns: 0 on success, otherwise error
+ */
+int netman_set_buffer_max(netman_session *session, u_int32_t bytes) {
+    if(!session) return ERR_NULL;
+    session->bufferMax = bytes;
+    return 0;
+}
+
+/**
+ * Backs capture buffers with superpages, must be set before any capture starts
+ * - parameter enable: true to use superpages
+ * - returns: 0 on success, otherwise error
+ */
+int netman_set_hugepages(netman_session *session, int enable) {
+    if(!session) return ERR_NULL;
+    if(session->captureCount > 0) return ERR_OPTIONS;
+    session->hugepages = enable;
+    return 0;
+}
+
+/**
+ * Publishes the session's counters in a shared memory segment, see netstats.h,
+ * must be set before any capture starts
+ * - parameter name: `shm_open` name for the segment
+ * - returns: 0 on success, otherwise error
+ */
+int netman_set_shm(netman_session *session, const char *name) {
+    if(!session || !name) return ERR_NULL;
+    if(session->stats || session->captureCount > 0) return ERR_OPTIONS;
+
+    session->stats = netstats_create(name);
+    if(!session->stats) return ERR_OPEN;
+    session->statsName = strdup(name);
+    return 0;
+}
+
+/**
+ * Adds a budget entry to the session's shared memory segment, see `netman_set_shm`
+ * - parameter name: name of the budget
+ * - parameter limit: the budget's byte limit, 0 is unlimited
+ * - returns: the entry to update with `netstats_publish`, or NULL without a segment or room
+ */
+struct netstats_entry *netman_shm_budget(netman_session *session, const char *name, u_int64_t limit) {
+    if(!session || !name || !session->stats) return NULL;
+    return netstats_add_budget(session->stats, name, limit);
+}
+
+/**
+ * Keeps a packet size and an inter-arrival time histogram per capture,
+ * must be set before any capture starts
+ * - parameter enable: true to keep histograms
+ * - returns: 0 on success, otherwise error
+ */
+int netman_set_histograms(netman_session *session, int enable) {
+    if(!session) return ERR_NULL;
+    if(session->captureCount > 0) return ERR_OPTIONS;
+    session->histograms = enable;
+    return 0;
+}
+
+/**
+ * Appends the bytes each capture and the session counted since the last tick
+ * Called with the session's mutex held
+ */
+static void recordHistory(netman_session *session) {
+    int series[HISTORY_MAX_SERIES];
+    u_int64_t bytes[HISTORY_MAX_SERIES];
+    int count = 0;
+
+    // series that moved nothing are left out of the tick
+    for(int i = 0; i < session->captureCount && count < HISTORY_MAX_SERIES; i++) {
+        struct capture *c = session->captures[i];
+        u_int64_t total = __atomic_load_n(&c->bytes, __ATOMIC_RELAXED);
+        if(c->historySeries < 0 || total == c->historyBytes) continue;
+        series[count] = c->historySeries;
+        bytes[count++] = total - c->historyBytes;
+        c->historyBytes = total;
+    }
+    u_int64_t total = __atomic_load_n(&session->bytes, __ATOMIC_RELAXED);
+    if(session->historySeries >= 0 && total != session->historyBytes && count < HISTORY_MAX_SERIES) {
+        series[count] = session->historySeries;
+        bytes[count++] = total - session->historyBytes;
+        session->historyBytes = total;
+    }
+
+    if(count > 0 && history_append(session->history, time(NULL), series, bytes, count) < 0) {
+        printERR("Failed to append to the history file.");
+    }
+}
+
+/**
+ * Records a history tick every resolution seconds until the session closes
+ * - parameter arg: the session
+ */
+static void *historyRecorder(void *arg) {
+    netman_session *session = arg;
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+
+    pthread_mutex_lock(&session->historyMutex);
+    while(!session->historyStop) {
+        deadline.tv_sec += session->historyResolution;
+        while(!session->historyStop &&
+              pthread_cond_timedwait(&session->historyCond, &session->historyMutex, &deadline) == 0);
+
+        pthread_mutex_lock(&session->mutex);
+        recordHistory(session);
+        pthread_mutex_unlock(&session->mutex);
+    }
+    pthread_mutex_unlock(&session->historyMutex);
+    return NULL;
+}
+
+/**
+ * Tracks the heaviest MAC and IP addresses of each capture by bytes sent plus
+ * received, in fixed memory, must be set before any capture starts
+ * - parameter k: how many addresses to track, 0 for none
+ * - returns: 0 on success, otherwise error
+ */
+int netman_set_top(netman_session *session, int k) {
+    if(!session) return ERR_NULL;
+    if(session->captureCount > 0 || k < 0 || k > SKETCH_MAX_K) return ERR_OPTIONS;
+    session->topK = k;
+    return 0;
+}
+
+/**
+ * Counts a packet once when several captured interfaces see it, e.g. a bridge
+ * and its members, see dedup.h, must be set before any capture starts
+ * - parameter windowUsec: how far apart copies may arrive, 0 for the default
+ * - returns: 0 on success, otherwise error
+ */
+int netman_set_dedup(netman_session *session, u_int64_t windowUsec) {
+    if(!session) return ERR_NULL;
+    if(session->dedup || session->captureCount > 0) return ERR_OPTIONS;
+
+    session->dedup = dedup_create(DEDUP_DEFAULT_BITS, windowUsec > 0 ? windowUsec : DEDUP_DEFAULT_WINDOW_USEC);
+    if(!session->dedup) return ERR_ALLOC;
+    return 0;
+}
+
+/**
+ * Counts 1 in n IPv4 packets and scales them by n, to cut the cost of busy
+ * links, must be set before any capture starts
+ * Each bpf filters on the low bits of the IPv4 ID, so the same
+ * packet is picked on every interface it crosses. Other packets count
+ * exactly. With a limit, counting switches to exact once the estimate
+ * nears it, see SAMPLE_EXACT_SHARE
+ * - parameter n: a power of two up to NETMAN_SAMPLE_MAX, 0 or 1 to count every packet
+ * - returns: 0 on success, otherwise error
+ */
+int netman_set_sample(netman_session *session, u_int32_t n) {
+    if(!session) return ERR_NULL;
+    if(session->captureCount > 0 || n > NETMAN_SAMPLE_MAX || (n & (n - 1)) != 0) return ERR_OPTIONS;
+    session->sampleRate = n > 1 ? n : 0;
+    session->sample = n > 1 ? n : 1;
+    return 0;
+}
+
+/**
+ * Loads per-prefix budgets, see prefix.h, must be set before any capture starts
+ * Each packet is charged to the budget of the longest prefix holding its
+ * remote address, the destination of sent packets and the source of received ones.
+ * Reaching any budget's limit fires the limit callback like the session's limit
+ * - parameter path: the budget file
+ * - returns: the number of prefixes loaded, otherwise error
+ */
+int netman_set_budgets(netman_session *session, const char *path) {
+    if(!session || !path) return ERR_NULL;
+    if(session->prefixes || session->captureCount > 0) return ERR_OPTIONS;
+
+    struct prefix_table *table = prefix_create();
+    if(!table) return ERR_ALLOC;
+
+    int line = 0;
+    int res = prefix_load(table, path, &line);
+    if(res < 0) {
+        if(line > 0) printERR("%s:%d is not '<budget> <limit bytes> <cidr>'.", path, line);
+        prefix_free(table);
+        return res;
+    }
+    session->prefixes = table;
+    return res;
+}
+
+/**
+ * - returns: the number of prefix budgets
+ */
+int netman_budget_count(netman_session *session) {
+    if(!session) return ERR_NULL;
+    return session->prefixes ? (int) session->prefixes->budgetCount : 0;
+}
+
+/**
+ * Copies a prefix budget while it is being counted
+ * - parameter index: from 0 to `netman_budget_count`
+ * - parameter out: set to the budget
+ * - returns: 0 on success, otherwise error
+ */
+int netman_budget(netman_session *session, int index, struct prefix_budget *out) {
+    if(!session || !out) return ERR_NULL;
+    if(!session->prefixes || index < 0 || index >= (int) session->prefixes->budgetCount) return ERR_OPTIONS;
+
+    struct prefix_budget *b = &session->prefixes->budgets[index];
+    memcpy(out->name, b->name, sizeof(out->name));
+    out->limit = b->limit;
+    out->bytes = __atomic_load_n(&b->bytes, __ATOMIC_RELAXED);
+    out->reached = __atomic_load_n(&b->reached, __ATOMIC_ACQUIRE);
+    return 0;
+}
+
+/**
+ * Records the bytes of each capture, and the session's total under `name`,
+ * in a history file every `resolution` seconds, see history.h
+ * Must be set before any capture starts
+ * - parameter path: the history file, created if needed
+ * - parameter resolution: seconds between ticks, 0 for the default or the file's own
+ * - parameter name: series name for the session's total, e.g. the budget
+ * - returns: 0 on success, otherwise error
+ */
+int netman_set_history(netman_session *session, const char *path, u_int32_t resolution, const char *name) {
+    if(!session || !path || !name) return ERR_NULL;
+    if(session->history || session->captureCount > 0) return ERR_OPTIONS;
+
+    session->history = history_open(path, resolution);
+    if(!session->history) return ERR_OPEN;
+    session->historyResolution = session->history->header.resolution;
+    session->historySeries = history_series(session->history, name);
+
+    if(pthread_mutex_init(&session->historyMutex, NULL) != 0 ||
+       pthread_cond_init(&session->historyCond, NULL) != 0 ||
+       pthread_create(&session->historyThread, NULL, historyRecorder, session) != 0) {
+        history_close(session->history);
+        session->history = NULL;
+        return ERR_ALLOC;
+    }
+    return 0;
+}
+
+/**
+ * Adds a job that counts the bytes on its interfaces while it runs, apart
+ * from the session's total, must be added before any capture starts
+ * Jobs that share an interface are each charged all of its bytes. Reaching
+ * a job's limit only marks it, see `netman_job_reached`
+ * - parameter name: the job's name, shorter than NETMAN_JOB_NAME_LEN
+ * - parameter limit: the job's limit in bytes, 0 is unlimited
+ * - parameter interfaces: comma separated interface names, NULL for every captured interface
+ * - returns: the job's id, otherwise error
+ */
+int netman_add_job(netman_session *session, const char *name, u_int64_t limit, const char *interfaces) {
+    if(!session || !name) return ERR_NULL;
+    if(session->captureCount > 0 || strnlen(name, NETMAN_JOB_NAME_LEN) >= NETMAN_JOB_NAME_LEN) return ERR_OPTIONS;
+
+    struct job_counter *tmp = realloc(session->jobs, (session->jobCount + 1) * sizeof(struct job_counter));
+    if(!tmp) return ERR_ALLOC;
+    session->jobs = tmp;
+
+    struct job_counter *job = &session->jobs[session->jobCount];
+    memset(job, 0, sizeof(struct job_counter));
+    strlcpy(job->name, name, sizeof(job->name));
+    job->limit = limit;
+    if(interfaces && !(job->interfaces = strdup(interfaces))) return ERR_ALLOC;
+    return session->jobCount++;
+}
+
+/**
+ * - returns: true if a job counts the named interface
+ */
+static int jobWatches(const struct job_counter *job, const char *ifname) {
+    if(!job->interfaces) return true;
+
+    size_t len = strlen(ifname);
+    for(const char *p = job->interfaces; *p != '\0'; p++) {
+        if(strncmp(p, ifname, len) == 0 && (p[len] == ',' || p[len] == '\0')) return true;
+        p = strchr(p, ',');
+        if(!p) break;
+    }
+    return false;
+}
+
+/**
+ * - parameter ifname: interface name
+ * - returns: true if any job counts the interface, so it needs capturing
+ */
+int netman_jobs_watch(netman_session *session, const char *ifname) {
+    if(!session || !ifname) return false;
+    for(int i = 0; i < session->jobCount; i++) {
+        if(jobWatches(&session->jobs[i], ifname)) return true;
+    }
+    return false;
+}
+
+/**
+ * Starts or stops counting a job's bytes, what it counted is kept
+ * - parameter job: id from `netman_add_job`
+ * - parameter running: true to count
+ * - returns: 0 on success, otherwise error
+ */
+int netman_job_running(netman_session *session, int job, int running) {
+    if(!session) return ERR_NULL;
+    if(job < 0 || job >= session->jobCount) return ERR_OPTIONS;
+    __atomic_store_n(&session->jobs[job].running, running, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/**
+ * - returns: the bytes counted for a job, 0 for an unknown job
+ */
+u_int64_t netman_job_bytes(netman_session *session, int job) {
+    if(!session || job < 0 || job >= session->jobCount) return 0;
+    return __atomic_load_n(&session->jobs[job].bytes, __ATOMIC_RELAXED);
+}
+
+/**
+ * - returns: true once a job's bytes have reached its limit
+ */
+int netman_job_reached(netman_session *session, int job) {
+    if(!session || job < 0 || job >= session->jobCount) return false;
+    return __atomic_load_n(&session->jobs[job].reached, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Polls the group's sockets and counts what they moved since the last poll
+ * - returns: 0 on success, otherwise error
+ */
+static int pollSockets(netman_session *session) {
+    struct procsock *p = session->sockets;
+    u_int64_t beforeRx = p->rxbytes, beforeTx = p->txbytes;
+    u_int64_t rx = 0, tx = 0;
+
+    int res = procsock_poll(p, &rx, &tx);
+    if(res < 0) return res;
+    rx = rx > beforeRx ? rx - beforeRx : 0;
+    tx = tx > beforeTx ? tx - beforeTx : 0;
+    if(rx + tx > 0) {
+        session_count(session, rx + tx);
+        direction_count(session, NULL, rx, tx);
+    }
+    return 0;
+}
+
+/**
+ * Polls the command's sockets every interval until the session closes
+ * - parameter arg: the session
+ */
+static void *socketPoller(void *arg) {
+    netman_session *session = arg;
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+
+    pthread_mutex_lock(&session->socketsMutex);
+    while(!session->socketsStop) {
+        deadline.tv_nsec += (long) session->socketsInterval * 1000000;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000;
+        deadline.tv_nsec %= 1000000000;
+        while(!session->socketsStop &&
+              pthread_cond_timedwait(&session->socketsCond, &session->socketsMutex, &deadline) == 0);
+
+        if(pollSockets(session) < 0) {
+            printDEBUG("Failed to poll the sockets of group %d\n", session->sockets->pgid);
+        }
+    }
+    pthread_mutex_unlock(&session->socketsMutex);
+    return NULL;
+}
+
+/**
+ * Counts the bytes moved by a process group's TCP and UDP sockets toward the
+ * session's total and limit, polled every interval without a bpf, see procsock.h
+ * Captures count toward the same total, so a session normally does one or the other
+ * - parameter pgid: the process group, e.g. the command's
+ * - parameter intervalMsec: milliseconds between polls, 0 for the default
+ * - returns: 0 on success, otherwise error
+ */
+int netman_poll_sockets(netman_session *session, pid_t pgid, u_int32_t intervalMsec) {
+    if(!session) return ERR_NULL;
+    if(session->sockets) return ERR_OPTIONS;
+
+    session->sockets = procsock_create(pgid);
+    if(!session->sockets) return ERR_ALLOC;
+    session->socketsInterval = intervalMsec ? intervalMsec : PROCSOCK_DEFAULT_INTERVAL_MSEC;
+
+    // the first poll runs here so a failure is reported to the caller
+    int res = pollSockets(session);
+    if(res == 0 && (pthread_mutex_init(&session->socketsMutex, NULL) != 0 ||
+                    pthread_cond_init(&session->socketsCond, NULL) != 0 ||
+                    pthread_create(&session->socketsThread, NULL, socketPoller, session) != 0)) {
+        res = ERR_ALLOC;
+    }
+    if(res < 0) {
+        procsock_free(session->sockets);
+        session->sockets = NULL;
+    }
+    return res;
+}
+
+/**
+ * Creates a capture with the counters the session's settings ask for,
+ * no bpf is opened and no thread started
+ * - parameter ifname: interface name
+ * - returns: the capture, or NULL on failure
+ */
+struct capture *capture_create(netman_session *session, const char *ifname) {
+    struct capture *c = calloc(1, sizeof(struct capture));
+    if(!c) return NULL;
+    c->session = session;
+    c->fd = -1;
+    c->bufferMax = session->bufferMax;
+    c->sample = 1;
+    strlcpy(c->name, ifname, sizeof(c->name));
+    if(session->histograms) {
+        c->sizes = calloc(1, sizeof(struct histogram));
+        c->gaps = calloc(1, sizeof(struct histogram));
+        c->latency = calloc(1, sizeof(struct histogram));
+        if(!c->sizes || !c->gaps || !c->latency) {
+            capture_destroy(c);
+            return NULL;
+        }
+    }
+    if(session->topK > 0) {
+        c->macs = sketch_create(SKETCH_DEFAULT_WIDTH, SKETCH_DEFAULT_DEPTH, session->topK);
+        c->ips = sketch_create(SKETCH_DEFAULT_WIDTH, SKETCH_DEFAULT_DEPTH, session->topK);
+        if(!c->macs || !c->ips || pthread_mutex_init(&c->sketchMutex, NULL) != 0) {
+            sketch_free(c->macs);
+            sketch_free(c->ips);
+            c->macs = NULL;
+            capture_destroy(c);
+            return NULL;
+        }
+    }
+    if(session->prefixes) {
+        c->prefixBytes = calloc(session->prefixes->budgetCount, sizeof(u_int64_t));
+        c->touched = calloc(session->prefixes->budgetCount, sizeof(u_int32_t));
+        if(!c->prefixBytes || !c->touched) {
+            capture_destroy(c);
+            return NULL;
+        }
+    }
+    // budgets and direction limits both tell sent from received by the MAC
+    if(session->prefixes || __atomic_load_n(&session->directions, __ATOMIC_RELAXED)) {
+        c->hasMac = interfaceMAC(c->name, c->mac) == 0;
+    }
+    if(session->jobCount > 0) {
+        c->jobs = calloc(session->jobCount, sizeof(u_int32_t));
+        if(!c->jobs) {
+            capture_destroy(c);
+            return NULL;
+        }
+        for(int i = 0; i < session->jobCount; i++) {
+            if(jobWatches(&session->jobs[i], c->name)) c->jobs[c->jobCount++] = i;
+        }
+    }
+    if(session->stats) {
+        c->stats = netstats_add_interface(session->stats, c->name);
+    }
+
+    return c;
+}
+
+/**
+ * Starts capturing an interface on its own thread
+ * - parameter ifname: interface name
+ * - parameter affinityTag: affinity tag for the thread, 0 for none
+ * - returns: 0 on success, otherwise error
+ */
+int netman_capture(netman_session *session, const char *ifname, int affinityTag) {
+    if(!session || !ifname) return ERR_NULL;
+
+    struct capture *c = capture_create(session, ifname);
+    if(!c) return ERR_ALLOC;
+
+    pthread_mutex_lock(&session->mutex);
+    if(session->captureCount == session->captureCap) {
+        int cap = session->captureCap ? session->captureCap * 2 : 8;
+        struct capture **tmp = realloc(session->captures, cap * sizeof(struct capture *));
+        if(!tmp) {
+            pthread_mutex_unlock(&session->mutex);
+            capture_destroy(c);
+            return ERR_ALLOC;
+        }
+        session->captures = tmp;
+        session->captureCap = cap;
+    }
+
+    c->historySeries = session->history ? history_series(session->history, c->name) : -1;
+    c->startNsec = monotonicNsec();
+    c->running = 1;
+    int res = start_monitor(c, affinityTag);
+    if(res == 0) {
+        session->captures[session->captureCount++] = c;
+    }
+    pthread_mutex_unlock(&session->mutex);
+
+    if(res != 0) {
+        printERR("Failed to create a thread for %s.", c->name);
+        capture_destroy(c);
+    }
+    return res;
+}
+
+/**
+ * - returns: the number of captures still running
+ */
+int netman_capture_count(netman_session *session) {
+    if(!session) return ERR_NULL;
+
+    int count = 0;
+    pthread_mutex_lock(&session->mutex);
+    for(int i = 0; i < session->captureCount; i++) {
+        count += __atomic_load_n(&session->captures[i]->running, __ATOMIC_ACQUIRE);
+    }
+    pthread_mutex_unlock(&session->mutex);
+    return count;
+}
+
+/**
+ * - returns: the bytes captured so far, including estimates for drops
+ */
+u_int64_t netman_bytes(netman_session *session) {
+    if(!session) return 0;
+    return __atomic_load_n(&session->bytes, __ATOMIC_RELAXED);
+}
+
+/**
+ * Directions are only told apart, and counted, while a direction limit is set
+ * - parameter rx: set to the bytes received so far, may be NULL
+ * - parameter tx: set to the bytes sent so far, may be NULL
+ * - returns: 0 on success, otherwise error
+ */
+int netman_direction_bytes(netman_session *session, u_int64_t *rx, u_int64_t *tx) {
+    if(!session) return ERR_NULL;
+    if(rx) *rx = __atomic_load_n(&session->rxBytes, __ATOMIC_RELAXED);
+    if(tx) *tx = __atomic_load_n(&session->txBytes, __ATOMIC_RELAXED);
+    return 0;
+}
+
+/**
+ * Has the capture threads spin on non-blocking reads while packets keep
+ * coming, and only block once the bpf has been quiet for `spinUsec`, so a
+ * packet is seen without waiting for the thread to be woken. Each spinning
+ * thread keeps a core busy. Must be set before any capture starts
+ * - parameter spinUsec: how long to spin after the last packet, 0 to always block
+ * - returns: 0 on success, otherwise error
+ */
+int netman_set_busy_poll(netman_session *session, u_int32_t spinUsec) {
+    if(!session) return ERR_NULL;
+    if(session->captureCount > 0 || spinUsec > BUSY_POLL_MAX_USEC) return ERR_OPTIONS;
+    session->busyPollUsec = spinUsec;
+    return 0;
+}
+
+/**
+ * - returns: the packets the kernel dropped so far
+ */
+u_int64_t netman_drops(netman_session *session) {
+    if(!session) return 0;
+    return __atomic_load_n(&session->drops, __ATOMIC_RELAXED);
+}
+
+/**
+ * Takes a snapshot of an interface's histograms while it is being captured
+ * - parameter ifname: interface name
+ * - parameter sizes: set to the packet sizes in bytes, or NULL
+ * - parameter gaps: set to the packet inter-arrival times in usec, or NULL
+ * - returns: 0 on success, ERR_NOIF if the interface isn't captured with histograms
+ */
+int netman_histogram_snapshot(netman_session *session, const char *ifname,
+                              struct histogram *sizes, struct histogram *gaps) {
+    if(!session || !ifname) return ERR_NULL;
+
+    int res = ERR_NOIF;
+    pthread_mutex_lock(&session->mutex);
+    for(int i = 0; i < session->captureCount; i++) {
+        struct capture *c = session->captures[i];
+        if(c->sizes == NULL || strncmp(c->name, ifname, sizeof(c->name)) != 0) continue;
+
+        if(sizes) histogram_snapshot(c->sizes, sizes);
+        if(gaps) histogram_snapshot(c->gaps, gaps);
+        res = 0;
+        break;
+    }
+    pthread_mutex_unlock(&session->mutex);
+    return res;
+}
+
+/**
+ * Takes a snapshot of how long an interface's packets waited between the
+ * kernel's timestamp and their read, in usec, while it is being captured
+ * - parameter ifname: interface name
+ * - parameter latency: set to the latencies
+ * - returns: 0 on success, ERR_NOIF if the interface isn't captured with histograms
+ */
+int netman_latency_snapshot(netman_session *session, const char *ifname, struct histogram *latency) {
+    if(!session || !ifname || !latency) return ERR_NULL;
+
+    int res = ERR_NOIF;
+    pthread_mutex_lock(&session->mutex);
+    for(int i = 0; i < session->captureCount; i++) {
+        struct capture *c = session->captures[i];
+        if(c->latency == NULL || strncmp(c->name, ifname, sizeof(c->name)) != 0) continue;
+
+        histogram_snapshot(c->latency, latency);
+        res = 0;
+        break;
+    }
+    pthread_mutex_unlock(&session->mutex);
+    return res;
+}
+
+/**
+ * Copies each capture's counters and costs, cheap enough to call often
+ * - parameter out: set to one entry per capture
+ * - parameter max: size of `out`
+ * - returns: the number of entries set, otherwise error
+ */
+int netman_stats(netman_session *session, struct netman_capture_stats *out, int max) {
+    if(!session || !out) return ERR_NULL;
+
+    u_int64_t now = monotonicNsec();
+    pthread_mutex_lock(&session->mutex);
+    int n = session->captureCount < max ? session->captureCount : max;
+    for(int i = 0; i < n; i++) {
+        struct capture *c = session->captures[i];
+        struct capture_metrics *m = &c->metrics;
+        struct netman_capture_stats *s = &out[i];
+
+        strlcpy(s->name, c->name, sizeof(s->name));
+        s->packets = __atomic_load_n(&m->packets, __ATOMIC_RELAXED);
+        s->bytes = __atomic_load_n(&m->bytes, __ATOMIC_RELAXED);
+        s->batches = __atomic_load_n(&m->batches, __ATOMIC_RELAXED);
+        s->readNsec = __atomic_load_n(&m->readNsec, __ATOMIC_RELAXED);
+        s->processNsec = __atomic_load_n(&m->processNsec, __ATOMIC_RELAXED);
+        s->cpuNsec = __atomic_load_n(&m->cpuNsec, __ATOMIC_RELAXED);
+        s->drops = __atomic_load_n(&m->drops, __ATOMIC_RELAXED);
+        s->duplicates = __atomic_load_n(&m->duplicates, __ATOMIC_RELAXED);
+        s->wallNsec = now - c->startNsec;
+    }
+    pthread_mutex_unlock(&session->mutex);
+    return n;
+}
+
+/**
+ * - returns: the standard deviation of a total scaled up from 1 in n samples,
+ *   given the sum of the squared sample values
+ */
+static double sampleDeviation(u_int32_t n, u_int64_t squares) {
+    return sqrt((double) n * (n - 1) * (double) squares);
+}
+
+/**
+ * Estimates the session's bytes and packets with 95% confidence intervals,
+ * only sampled packets add uncertainty
+ * - parameter out: set to the estimate
+ * - returns: 0 on success, otherwise error
+ */
+int netman_estimate(netman_session *session, struct netman_estimate *out) {
+    if(!session || !out) return ERR_NULL;
+
+    u_int32_t rate = session->sampleRate;
+    u_int64_t sampled = __atomic_load_n(&session->samplePackets, __ATOMIC_RELAXED);
+    u_int64_t squares = __atomic_load_n(&session->sampleSquares, __ATOMIC_RELAXED);
+
+    // each capture counted a sampled packet once, it stands for `rate`
+    u_int64_t packets = 0;
+    pthread_mutex_lock(&session->mutex);
+    for(int i = 0; i < session->captureCount; i++) {
+        packets += __atomic_load_n(&session->captures[i]->metrics.packets, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&session->mutex);
+    if(rate > 1) packets += sampled * (rate - 1);
+
+    memset(out, 0, sizeof(struct netman_estimate));
+    out->sampleRate = rate;
+    out->exact = rate > 1 && __atomic_load_n(&session->sample, __ATOMIC_RELAXED) == 1;
+    out->bytes = __atomic_load_n(&session->bytes, __ATOMIC_RELAXED);
+    out->packets = packets;
+
+    double bytesError = rate > 1 ? 1.96 * sampleDeviation(rate, squares) : 0;
+    double packetsError = rate > 1 ? 1.96 * sampleDeviation(rate, sampled) : 0;
+    out->bytesLow = bytesError < out->bytes ? out->bytes - (u_int64_t) bytesError : 0;
+    out->bytesHigh = out->bytes + (u_int64_t) bytesError;
+    out->packetsLow = packetsError < out->packets ? out->packets - (u_int64_t) packetsError : 0;
+    out->packetsHigh = out->packets + (u_int64_t) packetsError;
+    return 0;
+}
+
+/**
+ * Ranks the heaviest addresses across every capture so far
+ * Each capture's sketch is merged into one, then every capture's top keys
+ * are estimated against the merge
+ * - parameter by: NETMAN_TOP_MAC or NETMAN_TOP_IP
+ * - parameter out: set to the addresses and their bytes, largest first
+ * - parameter max: size of `out`
+ * - parameter error: set to how many bytes an estimate may overcount, or NULL
+ * - returns: the number of entries set, otherwise error
+ */
+int netman_top(netman_session *session, int by, struct sketch_entry *out, int max, u_int64_t *error) {
+    if(!session || !out) return ERR_NULL;
+    if(session->topK == 0) return ERR_OPTIONS;
+
+    struct sketch *merged = sketch_create(SKETCH_DEFAULT_WIDTH, SKETCH_DEFAULT_DEPTH, session->topK);
+    if(!merged) return ERR_ALLOC;
+
+    pthread_mutex_lock(&session->mutex);
+    for(int i = 0; i < session->captureCount; i++) {
+        struct capture *c = session->captures[i];
+        pthread_mutex_lock(&c->sketchMutex);
+        sketch_merge(merged, by == NETMAN_TOP_IP ? c->ips : c->macs);
+        pthread_mutex_unlock(&c->sketchMutex);
+    }
+    for(int i = 0; i < session->captureCount; i++) {
+        struct capture *c = session->captures[i];
+        struct sketch *s = by == NETMAN_TOP_IP ? c->ips : c->macs;
+        pthread_mutex_lock(&c->sketchMutex);
+        for(u_int32_t j = 0; j < s->size; j++) {
+            sketch_offer(merged, &s->top[j].key);
+        }
+        pthread_mutex_unlock(&c->sketchMutex);
+    }
+    pthread_mutex_unlock(&session->mutex);
+
+    int n = sketch_top(merged, out, max);
+    if(error) *error = sketch_error(merged);
+    sketch_free(merged);
+    return n;
+}
+
+/**
+ * Sets the session's byte limit, the limit callback fires once it is reached
+ * - parameter limit: the limit in bytes, 0 is unlimited
+ * - returns: 0 on success, otherwise error
+ */
+int netman_set_limit(netman_session *session, u_int64_t limit) {
+    if(!session) return ERR_NULL;
+    __atomic_store_n(&session->limit, limit, __ATOMIC_RELAXED);
+    return 0;
+}
+
+/**
+ * Sets separate limits on the bytes the session receives and sends, the
+ * limit callback fires once either is reached
+ * Direction comes from the interface's MAC address, looked up by
+ * `netman_capture`, so set the limits before capturing. Frames on an
+ * interface without one count as received
+ * - parameter rx: the received byte limit, 0 is unlimited
+ * - parameter tx: the sent byte limit, 0 is unlimited
+ * - returns: 0 on success, otherwise error
+ */
+int netman_set_direction_limits(netman_session *session, u_int64_t rx, u_int64_t tx) {
+    if(!session) return ERR_NULL;
+    __atomic_store_n(&session->rxLimit, rx, __ATOMIC_RELAXED);
+    __atomic_store_n(&session->txLimit, tx, __ATOMIC_RELAXED);
+    __atomic_store_n(&session->directions, rx > 0 || tx > 0, __ATOMIC_RELAXED);
+    return 0;
+}
+
+/**
+ * - returns: true once the session's bytes have reached its limit
+ */
+int netman_limit_reached(netman_session *session) {
+    if(!session) return false;
+    return __atomic_load_n(&session->limitReached, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Registers a callback for when the limit is reached, it runs on a capture
+ * thread so it should be quick and thread safe
+ * - parameter cb: the callback, NULL to remove it
+ * - parameter ctx: passed to the callback
+ * - returns: 0 on success, otherwise error
+ */
+int netman_on_limit(netman_session *session, netman_limit_cb cb, void *ctx) {
+    if(!session) return ERR_NULL;
+    session->onLimitCtx = ctx;
+    session->onLimit = cb;
+    return 0;
+}
+
+/**
+ * Marks the session's limit reached and fires the callback, once
+ * - parameter bytes: passed to the callback
+ * - returns: true if this call fired it
+ */
+static int fireLimit(netman_session *session, u_int64_t bytes) {
+    if(__atomic_exchange_n(&session->limitReached, 1, __ATOMIC_ACQ_REL)) return false;
+    if(session->onLimit) {
+        session->onLimit(session, bytes, session->onLimitCtx);
+    }
+    return true;
+}
+
+/**
+ * Charges the bytes the session counted since the last flush to its quota,
+ * and fires the limit callback once the quota is used up, by this run or any other
+ * Only the flusher calls this
+ */
+static void flushQuota(netman_session *session) {
+    u_int64_t total = __atomic_load_n(&session->bytes, __ATOMIC_RELAXED);
+    u_int64_t pending = total - session->quotaBytes;
+    time_t now = time(NULL);
+
+    // moved before charging so `netman_quota` never counts the bytes twice
+    __atomic_store_n(&session->quotaBytes, total, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    if(pending > 0) quota_charge(session->quota, session->quotaIndex, pending, now);
+
+    struct quota_entry e;
+    if(quota_get(session->quota, session->quotaIndex, now, &e) == 0 &&
+       e.limit > 0 && e.used >= e.limit && fireLimit(session, total)) {
+        printVERBOSE("Quota %s used up", e.name);
+    }
+}
+
+/**
+ * Flushes the session's bytes to its quota every QUOTA_FLUSH_MSEC, and writes
+ * the quota file to disk every QUOTA_SYNC_SEC, until the session closes
+ * - parameter arg: the session
+ */
+static void *quotaFlusher(void *arg) {
+    netman_session *session = arg;
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+
+    pthread_mutex_lock(&session->quotaMutex);
+    for(u_int32_t flushes = 1; !session->quotaStop; flushes++) {
+        deadline.tv_nsec += QUOTA_FLUSH_MSEC * 1000000L;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000;
+        deadline.tv_nsec %= 1000000000;
+        while(!session->quotaStop &&
+              pthread_cond_timedwait(&session->quotaCond, &session->quotaMutex, &deadline) == 0);
+
+        flushQuota(session);
+        if(flushes % (QUOTA_SYNC_SEC * 1000 / QUOTA_FLUSH_MSEC) == 0 && quota_sync(session->quota) < 0) {
+            printERR("Failed to write the quota file.");
+        }
+    }
+    // the session may close before the first flush
+    flushQuota(session);
+    pthread_mutex_unlock(&session->quotaMutex);
+    return NULL;
+}
+
+/**
+ * Charges the session's bytes to a named quota that persists across runs, see quota.h,
+ * must be set before any capture starts
+ * The bytes are flushed to the quota file in batches off the capture threads,
+ * so the quota may be overrun by up to QUOTA_FLUSH_MSEC of traffic.
+ * Once the quota is used up, by this run or any other, the limit callback fires
+ * - parameter path: the quota file, created if needed
+ * - parameter name: a quota defined with `quota_define`
+ * - returns: 0 on success, ERR_QUOTA if the quota is already used up, otherwise error
+ */
+int netman_set_quota(netman_session *session, const char *path, const char *name) {
+    if(!session || !path || !name) return ERR_NULL;
+    if(session->quota || session->sockets || session->captureCount > 0) return ERR_OPTIONS;
+
+    struct quota *q = quota_open(path);
+    if(!q) return ERR_OPEN;
+
+    struct quota_entry e;
+    int index = quota_find(q, name);
+    int res = index < 0 ? index : quota_get(q, index, time(NULL), &e);
+    if(res == 0 && e.limit > 0 && e.used >= e.limit) res = ERR_QUOTA;
+
+    if(res == 0) {
+        session->quota = q;
+        session->quotaIndex = index;
+        session->quotaBytes = __atomic_load_n(&session->bytes, __ATOMIC_RELAXED);
+        if(pthread_mutex_init(&session->quotaMutex, NULL) != 0 ||
+           pthread_cond_init(&session->quotaCond, NULL) != 0 ||
+           pthread_create(&session->quotaThread, NULL, quotaFlusher, session) != 0) {
+            session->quota = NULL;
+            res = ERR_ALLOC;
+        }
+    }
+    if(res < 0) quota_close(q);
+    return res;
+}
+
+/**
+ * Copies the session's quota, including the bytes not flushed to it yet
+ * - parameter out: set to the quota
+ * - returns: 0 on success, otherwise error
+ */
+int netman_quota(netman_session *session, struct quota_entry *out) {
+    if(!session || !out) return ERR_NULL;
+    if(!session->quota) return ERR_OPTIONS;
+
+    int res = quota_get(session->quota, session->quotaIndex, time(NULL), out);
+    if(res < 0) return res;
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    u_int64_t flushed = __atomic_load_n(&session->quotaBytes, __ATOMIC_RELAXED);
+    u_int64_t total = __atomic_load_n(&session->bytes, __ATOMIC_RELAXED);
+    if(total > flushed) out->used += total - flushed;
+    return 0;
+}
+
+/**
+ * Reports the session's bytes to the aggregator and applies its grants every
+ * LEASE_REPORT_MSEC until the session closes, then releases the slice
+ * - parameter arg: the session
+ */
+static void *leaseReporter(void *arg) {
+    netman_session *session = arg;
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+
+    pthread_mutex_lock(&session->leaseMutex);
+    while(!session->leaseStop) {
+        deadline.tv_nsec += LEASE_REPORT_MSEC * 1000000L;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000;
+        deadline.tv_nsec %= 1000000000;
+        while(!session->leaseStop &&
+              pthread_cond_timedwait(&session->leaseCond, &session->leaseMutex, &deadline) == 0);
+
+        if(lease_client_tick(session->lease, __atomic_load_n(&session->bytes, __ATOMIC_RELAXED)) < 0) {
+            printDEBUG("Failed to report to the aggregator\n");
+        }
+    }
+    lease_client_release(session->lease, __atomic_load_n(&session->bytes, __ATOMIC_RELAXED));
+    pthread_mutex_unlock(&session->leaseMutex);
+    return NULL;
+}
+
+/**
+ * Shares a byte budget with the other instances in a group through an
+ * aggregator, see lease.h, must be set before any capture starts
+ * The session is granted slices of the group's budget and enforces them on
+ * the capture threads, once the group's last slice is used up the limit
+ * callback fires
+ * - parameter host: the aggregator's name or address
+ * - parameter port: the aggregator's port, NULL for LEASE_DEFAULT_PORT
+ * - parameter group: the group, NULL for LEASE_DEFAULT_GROUP
+ * - returns: 0 on success, ERR_QUOTA if the group's budget is already used up, otherwise error
+ */
+int netman_set_aggregator(netman_session *session, const char *host, const char *port, const char *group) {
+    if(!session || !host) return ERR_NULL;
+    if(session->lease || session->sockets || session->captureCount > 0) return ERR_OPTIONS;
+
+    struct lease_client *lease = lease_client_create(host, port ? port : LEASE_DEFAULT_PORT,
+                                                     group ? group : LEASE_DEFAULT_GROUP);
+    if(!lease) return ERR_SOCKET;
+
+    u_int64_t used = __atomic_load_n(&session->bytes, __ATOMIC_RELAXED);
+    int res = lease_client_wait(lease, used, LEASE_WAIT_MSEC);
+    if(res == 0 && lease->final && lease->granted <= used) res = ERR_QUOTA;
+
+    if(res == 0) {
+        session->lease = lease;
+        if(pthread_mutex_init(&session->leaseMutex, NULL) != 0 ||
+           pthread_cond_init(&session->leaseCond, NULL) != 0 ||
+           pthread_create(&session->leaseThread, NULL, leaseReporter, session) != 0) {
+            session->lease = NULL;
+            res = ERR_ALLOC;
+        }
+    }
+    if(res < 0) {
+        // the aggregator has nothing to keep for an instance that never ran
+        lease_client_release(lease, used);
+        lease_client_free(lease);
+    }
+    return res;
+}
+
+/**
+ * - parameter limit: set to the group's budget, may be NULL
+ * - returns: the bytes the session's group had used at the last grant, 0 without an aggregator
+ */
+u_int64_t netman_group_bytes(netman_session *session, u_int64_t *limit) {
+    if(!session || !session->lease) return 0;
+    pthread_mutex_lock(&session->leaseMutex);
+    u_int64_t total = session->lease->total;
+    if(limit) *limit = session->lease->limit;
+    pthread_mutex_unlock(&session->leaseMutex);
+    return total;
+}
+
+/**
+ * Adds bytes to a capture and its session
+ * - parameter bytes: bytes to add
+ */
+void capture_count(struct capture *c, u_int64_t bytes) {
+    __atomic_add_fetch(&c->bytes, bytes, __ATOMIC_RELAXED);
+    session_count(c->session, bytes);
+
+    // the jobs counting this interface, marked once they reach their limits
+    for(u_int32_t i = 0; i < c->jobCount; i++) {
+        struct job_counter *job = &c->session->jobs[c->jobs[i]];
+        if(!__atomic_load_n(&job->running, __ATOMIC_ACQUIRE)) continue;
+
+        u_int64_t total = __atomic_add_fetch(&job->bytes, bytes, __ATOMIC_RELAXED);
+        if(job->limit > 0 && total >= job->limit && !__atomic_exchange_n(&job->reached, 1, __ATOMIC_ACQ_REL)) {
+            printVERBOSE("Job %s reached its limit", job->name);
+        }
+    }
+}
+
+/**
+ * Adds bytes to a session and fires the limit callback once the limit is reached
+ * Called by the capture threads once per batch
+ * - parameter bytes: bytes to add
+ */
+void session_count(netman_session *session, u_int64_t bytes) {
+    u_int64_t total = __atomic_add_fetch(&session->bytes, bytes, __ATOMIC_RELAXED);
+    u_int64_t limit = __atomic_load_n(&session->limit, __ATOMIC_RELAXED);
+
+    if(limit > 0 && total >= limit && fireLimit(session, total)) {
+        printVERBOSE("Byte limit reached");
+    }
+
+    // the aggregator reserved only what it granted, so running out before a newer
+    // grant arrives stops the instance whether or not the slice was the group's last
+    struct lease_client *lease = session->lease;
+    if(lease && total >= __atomic_load_n(&lease->granted, __ATOMIC_ACQUIRE) && fireLimit(session, total)) {
+        printVERBOSE("Group budget reached");
+    }
+}
+
+/**
+ * Adds bytes received and sent to a session, and to a capture's share of
+ * them, and fires the limit callback once either direction's limit is reached
+ * Called once per batch, after `capture_count` or `session_count` took the total
+ * - parameter c: the capture the bytes came from, or NULL
+ * - parameter rx: bytes received
+ * - parameter tx: bytes sent
+ */
+void direction_count(netman_session *session, struct capture *c, u_int64_t rx, u_int64_t tx) {
+    if(!__atomic_load_n(&session->directions, __ATOMIC_RELAXED)) return;
+    if(c) {
+        metricAdd(&c->rxBytes, rx);
+        metricAdd(&c->txBytes, tx);
+    }
+
+    if(rx > 0) {
+        u_int64_t total = __atomic_add_fetch(&session->rxBytes, rx, __ATOMIC_RELAXED);
+        u_int64_t limit = __atomic_load_n(&session->rxLimit, __ATOMIC_RELAXED);
+        if(limit > 0 && total >= limit && fireLimit(session, total)) {
+            printVERBOSE("RX limit reached");
+        }
+    }
+    if(tx > 0) {
+        u_int64_t total = __atomic_add_fetch(&session->txBytes, tx, __ATOMIC_RELAXED);
+        u_int64_t limit = __atomic_load_n(&session->txLimit, __ATOMIC_RELAXED);
+        if(limit > 0 && total >= limit && fireLimit(session, total)) {
+            printVERBOSE("TX limit reached");
+        }
+    }
+}
+
+/**
+ * Adds a read's bytes per prefix budget to the budgets and fires the limit
+ * callback once any budget reaches its limit, then clears them for the next read
+ * - parameter c: the capture
+ */
+void prefix_count(struct capture *c) {
+    struct prefix_budget *budgets = c->session->prefixes->budgets;
+
+    for(u_int32_t i = 0; i < c->touchedCount; i++) {
+        u_int32_t b = c->touched[i];
+        u_int64_t total = __atomic_add_fetch(&budgets[b].bytes, c->prefixBytes[b], __ATOMIC_RELAXED);
+        c->prefixBytes[b] = 0;
+
+        if(budgets[b].limit > 0 && total >= budgets[b].limit &&
+           !__atomic_exchange_n(&budgets[b].reached, 1, __ATOMIC_ACQ_REL)) {
+            printVERBOSE("Budget %s reached", budgets[b].name);
+            fireLimit(c->session, total);
+        }
+    }
+    c->touchedCount = 0;
+}
+
+/**
+ * Adds a read's sampled IPv4 packets to the session, and switches every
+ * capture to exact counting once the estimate could be near the limit
+ * Called by the capture threads once per batch while sampling
+ * - parameter c: the capture
+ * - parameter packets: sampled packets in the read
+ * - parameter squares: the sum of their squared sizes
+ */
+void sample_count(struct capture *c, u_int64_t packets, u_int64_t squares) {
+    netman_session *session = c->session;
+    u_int64_t sampled = __atomic_add_fetch(&session->samplePackets, packets, __ATOMIC_RELAXED);
+    u_int64_t total = __atomic_add_fetch(&session->sampleSquares, squares, __ATOMIC_RELAXED);
+    u_int64_t limit = __atomic_load_n(&session->limit, __ATOMIC_RELAXED);
+    if(limit == 0) return;
+
+    double high = __atomic_load_n(&session->bytes, __ATOMIC_RELAXED) +
+                  SAMPLE_EXACT_Z * sampleDeviation(session->sampleRate, total);
+    if(high >= SAMPLE_EXACT_SHARE * limit && __atomic_exchange_n(&session->sample, 1, __ATOMIC_ACQ_REL) > 1) {
+        printVERBOSE("Counting exactly after %llu sampled packets, the limit is near", (unsigned long long) sampled);
+    }
+}
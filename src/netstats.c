@@ -0,0 +1,249 @@
+#include "errorcodes.h"
+#include "netstats.h"
+
+#include <fcntl.h> // O_RDWR
+#include <string.h> // memset
+#include <time.h> // clock_gettime
+#include <unistd.h> // ftruncate
+#include <sys/mman.h> // shm_open, mmap
+#include <sys/stat.h> // fstat
+
+/*
+ * Seqlock: the writer makes `seq` odd, stores the fields and makes it even
+ * again. A reader copies the fields between two loads of `seq` and retries
+ * if they differ or are odd. Fields are accessed with relaxed atomics so
+ * the copy is never torn, and the fences order them against `seq`.
+ */
+
+/**
+ * - returns: the wall clock in nanoseconds
+ */
+static u_int64_t now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (u_int64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void writeBegin(struct netstats_entry *e) {
+	__atomic_store_n(&e->seq, e->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void writeEnd(struct netstats_entry *e) {
+	__atomic_store_n(&e->updated, now(), __ATOMIC_RELAXED);
+	__atomic_store_n(&e->seq, e->seq + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Creates (or replaces) the shared memory segment and maps it
+ * - parameter name: `shm_open` name, e.g. NETSTATS_DEFAULT_NAME
+ * - returns: the segment, or NULL on failure
+ */
+struct netstats_segment *netstats_create(const char *name) {
+	if(!name) return NULL;
+
+	// start clean so readers never see a previous run's layout
+	shm_unlink(name);
+	int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+	if(fd < 0) return NULL;
+
+	if(ftruncate(fd, sizeof(struct netstats_segment)) < 0) {
+		close(fd);
+		shm_unlink(name);
+		return NULL;
+	}
+
+	struct netstats_segment *seg = mmap(NULL, sizeof(struct netstats_segment),
+		PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if(seg == MAP_FAILED) {
+		shm_unlink(name);
+		return NULL;
+	}
+
+	memset(seg, 0, sizeof(struct netstats_segment));
+	seg->header.version = NETSTATS_VERSION;
+	seg->header.entrySize = sizeof(struct netstats_entry);
+	seg->header.pid = getpid();
+	seg->header.started = now();
+	// the magic goes last so readers only accept a complete header
+	__atomic_store_n(&seg->header.magic, NETSTATS_MAGIC, __ATOMIC_RELEASE);
+	return seg;
+}
+
+/**
+ * Unmaps and removes the segment
+ * - parameter seg: segment from `netstats_create`
+ * - parameter name: name the segment was created with
+ */
+void netstats_destroy(struct netstats_segment *seg, const char *name) {
+	if(!seg) return;
+	munmap(seg, sizeof(struct netstats_segment));
+	if(name) shm_unlink(name);
+}
+
+/**
+ * Claims an entry for a name, safe to call from several threads
+ * - returns: the entry, or NULL if there are none left
+ */
+static struct netstats_entry *claim(struct netstats_entry *entries, u_int32_t *count, u_int32_t max,
+                                    const char *name, u_int64_t limit) {
+	u_int32_t slot = __atomic_fetch_add(count, 1, __ATOMIC_RELAXED);
+	if(slot >= max) {
+		__atomic_fetch_sub(count, 1, __ATOMIC_RELAXED);
+		return NULL;
+	}
+
+	struct netstats_entry *e = &entries[slot];
+	writeBegin(e);
+	strncpy(e->name, name, NETSTATS_NAME_LEN - 1);
+	__atomic_store_n(&e->limit, limit, __ATOMIC_RELAXED);
+	__atomic_store_n(&e->active, 1, __ATOMIC_RELAXED);
+	writeEnd(e);
+	return e;
+}
+
+/**
+ * - parameter seg: segment from `netstats_create`
+ * - parameter name: interface name
+ * - returns: the interface's entry, or NULL if all NETSTATS_MAX_INTERFACES are used
+ */
+struct netstats_entry *netstats_add_interface(struct netstats_segment *seg, const char *name) {
+	if(!seg || !name) return NULL;
+	return claim(seg->interfaces, &seg->header.interfaceCount, NETSTATS_MAX_INTERFACES, name, 0);
+}
+
+/**
+ * - parameter seg: segment from `netstats_create`
+ * - parameter name: budget name
+ * - parameter limit: the budget's limit in bytes, 0 for unlimited
+ * - returns: the budget's entry, or NULL if all NETSTATS_MAX_BUDGETS are used
+ */
+struct netstats_entry *netstats_add_budget(struct netstats_segment *seg, const char *name, u_int64_t limit) {
+	if(!seg || !name) return NULL;
+	return claim(seg->budgets, &seg->header.budgetCount, NETSTATS_MAX_BUDGETS, name, limit);
+}
+
+/**
+ * Sets an entry's counters. Each entry must only be written by one thread.
+ * - parameter e: entry to write, ignored if NULL
+ */
+void netstats_publish(struct netstats_entry *e, u_int64_t bytes, u_int64_t packets, u_int64_t drops) {
+	if(!e) return;
+	writeBegin(e);
+	__atomic_store_n(&e->bytes, bytes, __ATOMIC_RELAXED);
+	__atomic_store_n(&e->packets, packets, __ATOMIC_RELAXED);
+	__atomic_store_n(&e->drops, drops, __ATOMIC_RELAXED);
+	writeEnd(e);
+}
+
+/**
+ * Adds to an entry's counters. Each entry must only be written by one thread.
+ * - parameter e: entry to write, ignored if NULL
+ */
+void netstats_add(struct netstats_entry *e, u_int64_t bytes, u_int64_t packets, u_int64_t drops) {
+	if(!e) return;
+	netstats_publish(e, e->bytes + bytes, e->packets + packets, e->drops + drops);
+}
+
+/**
+ * Maps an existing segment read only
+ * - parameter name: name the segment was created with
+ * - returns: the segment, or NULL if it doesn't exist or has another layout
+ */
+const struct netstats_segment *netstats_open(const char *name) {
+	if(!name) return NULL;
+
+	int fd = shm_open(name, O_RDONLY, 0);
+	if(fd < 0) return NULL;
+
+	struct stat st;
+	if(fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(struct netstats_segment)) {
+		close(fd);
+		return NULL;
+	}
+
+	const struct netstats_segment *seg = mmap(NULL, sizeof(struct netstats_segment),
+		PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(seg == MAP_FAILED) return NULL;
+
+	if(__atomic_load_n(&seg->header.magic, __ATOMIC_ACQUIRE) != NETSTATS_MAGIC ||
+	   seg->header.version != NETSTATS_VERSION ||
+	   seg->header.entrySize != sizeof(struct netstats_entry)) {
+		munmap((void *) seg, sizeof(struct netstats_segment));
+		return NULL;
+	}
+	return seg;
+}
+
+/**
+ * - parameter seg: segment from `netstats_open`
+ */
+void netstats_close(const struct netstats_segment *seg) {
+	if(!seg) return;
+	munmap((void *) seg, sizeof(struct netstats_segment));
+}
+
+/**
+ * Takes a consistent copy of one entry without syscalls or locks
+ * - parameter e: entry in a mapped segment
+ * - parameter copy: set to the entry
+ * - returns: 0 on success, ERR_READ if the writer never finished (e.g. it died mid-write)
+ */
+int netstats_read(const struct netstats_entry *e, struct netstats_entry *copy) {
+	if(!e || !copy) return ERR_NULL;
+
+	for(int tries = 0; tries < 10000; tries++) {
+		u_int32_t seq = __atomic_load_n(&e->seq, __ATOMIC_ACQUIRE);
+		if(seq & 1) continue;
+
+		for(int i = 0; i < NETSTATS_NAME_LEN; i++) {
+			copy->name[i] = __atomic_load_n(&e->name[i], __ATOMIC_RELAXED);
+		}
+		copy->active = __atomic_load_n(&e->active, __ATOMIC_RELAXED);
+		copy->bytes = __atomic_load_n(&e->bytes, __ATOMIC_RELAXED);
+		copy->packets = __atomic_load_n(&e->packets, __ATOMIC_RELAXED);
+		copy->drops = __atomic_load_n(&e->drops, __ATOMIC_RELAXED);
+		copy->limit = __atomic_load_n(&e->limit, __ATOMIC_RELAXED);
+		copy->updated = __atomic_load_n(&e->updated, __ATOMIC_RELAXED);
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if(__atomic_load_n(&e->seq, __ATOMIC_RELAXED) == seq) {
+			copy->seq = seq;
+			return 0;
+		}
+	}
+	return ERR_READ;
+}
+
+/**
+ * Takes a consistent copy of every active entry, each entry is consistent
+ * on its own but entries may be from slightly different moments
+ * - parameter seg: segment from `netstats_open`
+ * - parameter snap: set to the entries
+ * - returns: 0 on success, otherwise error
+ */
+int netstats_snapshot(const struct netstats_segment *seg, struct netstats_snapshot *snap) {
+	if(!seg || !snap) return ERR_NULL;
+
+	u_int32_t interfaces = __atomic_load_n(&seg->header.interfaceCount, __ATOMIC_ACQUIRE);
+	u_int32_t budgets = __atomic_load_n(&seg->header.budgetCount, __ATOMIC_ACQUIRE);
+	if(interfaces > NETSTATS_MAX_INTERFACES) interfaces = NETSTATS_MAX_INTERFACES;
+	if(budgets > NETSTATS_MAX_BUDGETS) budgets = NETSTATS_MAX_BUDGETS;
+
+	snap->interfaceCount = 0;
+	for(u_int32_t i = 0; i < interfaces; i++) {
+		struct netstats_entry *copy = &snap->interfaces[snap->interfaceCount];
+		if(netstats_read(&seg->interfaces[i], copy) < 0) return ERR_READ;
+		if(copy->active) snap->interfaceCount++;
+	}
+
+	snap->budgetCount = 0;
+	for(u_int32_t i = 0; i < budgets; i++) {
+		struct netstats_entry *copy = &snap->budgets[snap->budgetCount];
+		if(netstats_read(&seg->budgets[i], copy) < 0) return ERR_READ;
+		if(copy->active) snap->budgetCount++;
+	}
+	return 0;
+}
@@ -0,0 +1,210 @@
+#include "errorcodes.h"
+#include "prefix.h"
+
+#include <stdlib.h> // calloc
+#include <string.h> // strncmp
+#include <stdio.h> // fopen
+#include <arpa/inet.h> // inet_pton
+
+/**
+ * - returns: a new node with every entry set to `fill`, or -1 on failure
+ */
+static int64_t newNode(struct prefix_trie *t, u_int32_t fill) {
+	if(t->count == t->cap) {
+		u_int32_t cap = t->cap ? t->cap * 2 : 16;
+		if(cap >= PREFIX_CHILD) return -1;
+		u_int32_t (*tmp)[256] = realloc(t->nodes, cap * sizeof(*t->nodes));
+		if(!tmp) return -1;
+		t->nodes = tmp;
+		t->cap = cap;
+	}
+	for(int i = 0; i < 256; i++) {
+		t->nodes[t->count][i] = fill;
+	}
+	return t->count++;
+}
+
+/**
+ * Inserts a prefix, prefixes must come shortest first so this one
+ * overwrites any shorter prefix it overlaps
+ * - returns: 0 on success, otherwise error
+ */
+static int insert(struct prefix_trie *t, const u_int8_t *addr, u_int32_t len, u_int32_t value) {
+	if(t->count == 0 && newNode(t, 0) < 0) return ERR_ALLOC;
+
+	u_int32_t node = 0;
+	int depth = 0;
+	for(; len > 8; len -= 8, depth++) {
+		u_int32_t entry = t->nodes[node][addr[depth]];
+		if((entry & PREFIX_CHILD) == 0) {
+			// push the shorter prefix's budget down into the new node
+			int64_t child = newNode(t, entry);
+			if(child < 0) return ERR_ALLOC;
+			entry = PREFIX_CHILD | (u_int32_t) child;
+			t->nodes[node][addr[depth]] = entry;
+		}
+		node = entry & ~PREFIX_CHILD;
+	}
+
+	// the last byte covers 2^(8 - len) entries
+	u_int32_t span = 1u << (8 - len);
+	u_int32_t first = addr[depth] & ~(span - 1);
+	for(u_int32_t i = first; i < first + span; i++) {
+		t->nodes[node][i] = value;
+	}
+	return 0;
+}
+
+static int byLength(const void *a, const void *b) {
+	const struct prefix_pending *x = a, *y = b;
+	if(x->family != y->family) return x->family - y->family;
+	return x->len - y->len;
+}
+
+/**
+ * - returns: an empty table, or NULL on failure
+ */
+struct prefix_table *prefix_create(void) {
+	return calloc(1, sizeof(struct prefix_table));
+}
+
+/**
+ * - parameter table: table from `prefix_create`
+ */
+void prefix_free(struct prefix_table *table) {
+	if(!table) return;
+	free(table->v4.nodes);
+	free(table->v6.nodes);
+	free(table->budgets);
+	free(table->pending);
+	free(table);
+}
+
+/**
+ * Adds a prefix to a budget, creating the budget the first time it is named
+ * Takes effect once `prefix_build` is called
+ * - parameter budget: name of the budget
+ * - parameter limit: the budget's limit in bytes if it is new, 0 is unlimited
+ * - parameter cidr: an IPv4 or IPv6 prefix, e.g. "10.0.0.0/8", a bare address is a host
+ * - returns: the budget index, otherwise error
+ */
+int prefix_add(struct prefix_table *table, const char *budget, u_int64_t limit, const char *cidr) {
+	if(!table || !budget || !cidr) return ERR_NULL;
+
+	struct prefix_pending p = {{0}, 0, 0, 0};
+	char addr[64];
+	strncpy(addr, cidr, sizeof(addr) - 1);
+	addr[sizeof(addr) - 1] = '\0';
+
+	long len = -1;
+	char *slash = strchr(addr, '/');
+	if(slash) {
+		*slash = '\0';
+		char *end = NULL;
+		len = strtol(slash + 1, &end, 10);
+		if(end == slash + 1 || *end != '\0') return ERR_OPTIONS;
+	}
+
+	if(inet_pton(AF_INET, addr, p.addr) == 1) {
+		p.family = 4;
+		if(len < 0) len = 32;
+		if(len > 32) return ERR_OPTIONS;
+	} else if(inet_pton(AF_INET6, addr, p.addr) == 1) {
+		p.family = 6;
+		if(len < 0) len = 128;
+		if(len > 128) return ERR_OPTIONS;
+	} else {
+		return ERR_OPTIONS;
+	}
+	p.len = (u_int8_t) len;
+
+	// clear the host bits so the prefix covers exactly its own range
+	for(int bit = len; bit < 128; bit++) {
+		p.addr[bit / 8] &= ~(0x80 >> (bit % 8));
+	}
+
+	u_int32_t b = 0;
+	while(b < table->budgetCount && strncmp(table->budgets[b].name, budget, PREFIX_NAME_LEN) != 0) b++;
+	if(b == table->budgetCount) {
+		if(table->budgetCount == table->budgetCap) {
+			u_int32_t cap = table->budgetCap ? table->budgetCap * 2 : 8;
+			struct prefix_budget *tmp = realloc(table->budgets, cap * sizeof(struct prefix_budget));
+			if(!tmp) return ERR_ALLOC;
+			table->budgets = tmp;
+			table->budgetCap = cap;
+		}
+		memset(&table->budgets[b], 0, sizeof(struct prefix_budget));
+		strncpy(table->budgets[b].name, budget, PREFIX_NAME_LEN - 1);
+		table->budgets[b].limit = limit;
+		table->budgetCount++;
+	}
+	p.budget = b;
+
+	if(table->pendingCount == table->pendingCap) {
+		u_int32_t cap = table->pendingCap ? table->pendingCap * 2 : 64;
+		struct prefix_pending *tmp = realloc(table->pending, cap * sizeof(struct prefix_pending));
+		if(!tmp) return ERR_ALLOC;
+		table->pending = tmp;
+		table->pendingCap = cap;
+	}
+	table->pending[table->pendingCount++] = p;
+	return b;
+}
+
+/**
+ * Builds the tries from every prefix added so far, lookups must not run
+ * while this does
+ * - returns: 0 on success, otherwise error
+ */
+int prefix_build(struct prefix_table *table) {
+	if(!table) return ERR_NULL;
+
+	table->v4.count = 0;
+	table->v6.count = 0;
+	table->prefixCount = 0;
+	qsort(table->pending, table->pendingCount, sizeof(struct prefix_pending), byLength);
+
+	for(u_int32_t i = 0; i < table->pendingCount; i++) {
+		struct prefix_pending *p = &table->pending[i];
+		struct prefix_trie *t = p->family == 4 ? &table->v4 : &table->v6;
+		if(insert(t, p->addr, p->len, p->budget + 1) < 0) return ERR_ALLOC;
+		table->prefixCount++;
+	}
+	return 0;
+}
+
+/**
+ * Reads a budget file, see prefix.h, and builds the tries
+ * - parameter path: the file
+ * - parameter line: set to the line that failed to parse, or 0
+ * - returns: the number of prefixes, otherwise error
+ */
+int prefix_load(struct prefix_table *table, const char *path, int *line) {
+	if(!table || !path) return ERR_NULL;
+	if(line) *line = 0;
+
+	FILE *f = fopen(path, "r");
+	if(!f) return ERR_OPEN;
+
+	char buf[256];
+	int number = 0;
+	while(fgets(buf, sizeof(buf), f)) {
+		number++;
+		char *comment = strchr(buf, '#');
+		if(comment) *comment = '\0';
+
+		char name[PREFIX_NAME_LEN], cidr[64];
+		unsigned long long limit = 0;
+		int fields = sscanf(buf, "%31s %llu %63s", name, &limit, cidr);
+		if(fields <= 0) continue;
+		if(fields != 3 || prefix_add(table, name, limit, cidr) < 0) {
+			if(line) *line = number;
+			fclose(f);
+			return ERR_OPTIONS;
+		}
+	}
+	fclose(f);
+
+	if(prefix_build(table) < 0) return ERR_ALLOC;
+	return table->prefixCount;
+}
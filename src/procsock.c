@@ -0,0 +1,285 @@
+#include "errorcodes.h"
+#include "procsock.h"
+
+#include <stdlib.h> // calloc
+#include <string.h> // memset
+#include <errno.h>
+#include <stdbool.h>
+#include <sys/sysctl.h> // sysctlbyname
+#include <libproc.h> // proc_listpgrppids
+
+/*
+ * The pcblist_n records mirror xnu's bsd/sys/socketvar.h, which the SDK
+ * leaves out. Every record starts with its length and kind and is padded to
+ * 8 bytes, so records of other kinds are skipped by length alone.
+ */
+#define XSO_SOCKET	0x001
+#define XSO_STATS	0x008
+#define SO_TC_STATS_MAX 4
+#define ROUNDUP64(x) (((x) + 7) & ~(size_t) 7)
+
+#pragma pack(push, 4)
+struct xrecord {
+	u_int32_t len;
+	u_int32_t kind;
+};
+
+struct xsocket_n {
+	u_int32_t xso_len;
+	u_int32_t xso_kind;			// XSO_SOCKET
+	u_int64_t xso_so;
+	short so_type;
+	u_int32_t so_options;
+	short so_linger;
+	short so_state;
+	u_int64_t so_pcb;
+	int xso_protocol;
+	int xso_family;
+	short so_qlen;
+	short so_incqlen;
+	short so_qlimit;
+	short so_timeo;
+	u_short so_error;
+	pid_t so_pgid;
+	u_int32_t so_oobmark;
+	uid_t so_uid;
+	pid_t so_last_pid;
+	pid_t so_e_pid;				// the pid a delegated socket acts for
+	u_int64_t so_gencnt;
+};
+
+struct xdata_stats {
+	u_int64_t rxpackets;
+	u_int64_t rxbytes;
+	u_int64_t txpackets;
+	u_int64_t txbytes;
+};
+
+struct xsockstat_n {
+	u_int32_t xst_len;
+	u_int32_t xst_kind;			// XSO_STATS
+	struct xdata_stats xst_tc_stats[SO_TC_STATS_MAX];	// per traffic class
+};
+#pragma pack(pop)
+
+static const char *lists[] = {"net.inet.tcp.pcblist_n", "net.inet.udp.pcblist_n"};
+
+/**
+ * Creates a tracker for a process group, nothing is counted until the first poll
+ * - parameter pgid: the process group, e.g. a command started as its group's leader
+ * - returns: the tracker, or NULL on failure
+ */
+struct procsock *procsock_create(pid_t pgid) {
+	if(pgid <= 0) return NULL;
+
+	struct procsock *p = calloc(1, sizeof(struct procsock));
+	if(!p) return NULL;
+	p->pgid = pgid;
+	p->socketCap = 64;
+	p->sockets = calloc(p->socketCap, sizeof(struct procsock_entry));
+	if(!p->sockets) {
+		free(p);
+		return NULL;
+	}
+	return p;
+}
+
+/**
+ * - parameter p: tracker from `procsock_create`
+ */
+void procsock_free(struct procsock *p) {
+	if(!p) return;
+	free(p->pids);
+	free(p->sockets);
+	free(p->buf);
+	free(p);
+}
+
+static int byPid(const void *a, const void *b) {
+	pid_t x = *(const pid_t *) a, y = *(const pid_t *) b;
+	return (x > y) - (x < y);
+}
+
+/**
+ * Reloads the group's pids
+ * - returns: 0 on success, otherwise error
+ */
+static int loadPids(struct procsock *p) {
+	for(;;) {
+		if(p->pidCap > 0) {
+			int count = proc_listpgrppids(p->pgid, p->pids, p->pidCap * (int) sizeof(pid_t));
+			if(count < 0) return ERR_PROC;
+			// a full buffer may have been cut short
+			if(count < p->pidCap) {
+				p->pidCount = count;
+				qsort(p->pids, count, sizeof(pid_t), byPid);
+				return 0;
+			}
+		}
+		int cap = p->pidCap ? p->pidCap * 2 : 64;
+		pid_t *tmp = realloc(p->pids, cap * sizeof(pid_t));
+		if(!tmp) return ERR_ALLOC;
+		p->pids = tmp;
+		p->pidCap = cap;
+	}
+}
+
+static int inGroup(const struct procsock *p, pid_t pid) {
+	return pid > 0 && bsearch(&pid, p->pids, p->pidCount, sizeof(pid_t), byPid) != NULL;
+}
+
+static u_int32_t hashSocket(u_int64_t so, u_int64_t gen) {
+	u_int64_t h = (so ^ (gen * 0x9e3779b97f4a7c15ull)) * 0xff51afd7ed558ccdull;
+	return (u_int32_t) (h >> 32);
+}
+
+/**
+ * Moves the sockets into a table of `cap` slots
+ * - parameter sweep: drop the sockets the current poll did not see, they closed
+ * - returns: 0 on success, otherwise error
+ */
+static int rehash(struct procsock *p, u_int32_t cap, int sweep) {
+	struct procsock_entry *table = calloc(cap, sizeof(struct procsock_entry));
+	if(!table) return ERR_ALLOC;
+
+	u_int32_t count = 0;
+	for(u_int32_t i = 0; i < p->socketCap; i++) {
+		struct procsock_entry *e = &p->sockets[i];
+		if(e->so == 0 || (sweep && e->seen != p->polls)) continue;
+		u_int32_t h = hashSocket(e->so, e->gen) & (cap - 1);
+		while(table[h].so != 0) h = (h + 1) & (cap - 1);
+		table[h] = *e;
+		count++;
+	}
+	free(p->sockets);
+	p->sockets = table;
+	p->socketCap = cap;
+	p->socketCount = count;
+	return 0;
+}
+
+/**
+ * Adds a socket's growth since the last poll to the totals, a socket seen
+ * for the first time is charged everything it moved
+ * - returns: 0 on success, otherwise error
+ */
+static int charge(struct procsock *p, u_int64_t so, u_int64_t gen, u_int64_t rx, u_int64_t tx) {
+	if(so == 0) return 0;
+	if((p->socketCount + 1) * 2 > p->socketCap && rehash(p, p->socketCap * 2, false) < 0) return ERR_ALLOC;
+
+	u_int32_t mask = p->socketCap - 1;
+	u_int32_t h = hashSocket(so, gen) & mask;
+	while(p->sockets[h].so != 0 && (p->sockets[h].so != so || p->sockets[h].gen != gen)) {
+		h = (h + 1) & mask;
+	}
+	struct procsock_entry *e = &p->sockets[h];
+	if(e->so == 0) {
+		e->so = so;
+		e->gen = gen;
+		p->socketCount++;
+	} else if(e->seen == p->polls) {
+		// a socket listed twice is only charged once
+		return 0;
+	}
+	if(rx > e->rxbytes) p->rxbytes += rx - e->rxbytes;
+	if(tx > e->txbytes) p->txbytes += tx - e->txbytes;
+	e->rxbytes = rx;
+	e->txbytes = tx;
+	e->seen = p->polls;
+	return 0;
+}
+
+/**
+ * Reads one pcblist_n sysctl into the reusable buffer
+ * - returns: the bytes read, otherwise error
+ */
+static ssize_t readList(struct procsock *p, const char *name) {
+	for(int tries = 0; tries < 4; tries++) {
+		size_t len = 0;
+		if(sysctlbyname(name, NULL, &len, NULL, 0) < 0) return ERR_SOCKET;
+		// room for sockets opened between the two calls
+		len += len / 4 + 4096;
+		if(len > p->bufLen) {
+			char *tmp = realloc(p->buf, len);
+			if(!tmp) return ERR_ALLOC;
+			p->buf = tmp;
+			p->bufLen = len;
+		}
+		len = p->bufLen;
+		if(sysctlbyname(name, p->buf, &len, NULL, 0) == 0) return (ssize_t) len;
+		if(errno != ENOMEM) return ERR_SOCKET;
+	}
+	return ERR_SOCKET;
+}
+
+/**
+ * Walks a pcblist_n buffer and charges every socket the group used
+ * - returns: 0 on success, otherwise error
+ */
+static int chargeList(struct procsock *p, size_t len) {
+	if(len < sizeof(struct xrecord)) return 0;
+
+	// the list starts and ends with a generation record, the end is found by its length
+	u_int32_t genLen = ((struct xrecord *) p->buf)->len;
+	size_t offset = ROUNDUP64(genLen);
+	u_int64_t so = 0, gen = 0;
+	int owned = false;
+
+	while(offset + sizeof(struct xrecord) <= len) {
+		struct xrecord *r = (struct xrecord *) (p->buf + offset);
+		if(r->len <= genLen || offset + r->len > len) break;
+
+		if(r->kind == XSO_SOCKET && r->len >= sizeof(struct xsocket_n)) {
+			struct xsocket_n *xso = (struct xsocket_n *) r;
+			so = xso->xso_so;
+			gen = xso->so_gencnt;
+			owned = inGroup(p, xso->so_last_pid) || inGroup(p, xso->so_e_pid);
+		} else if(r->kind == XSO_STATS && r->len >= sizeof(struct xsockstat_n) && owned) {
+			struct xsockstat_n *xst = (struct xsockstat_n *) r;
+			u_int64_t rx = 0, tx = 0;
+			for(int tc = 0; tc < SO_TC_STATS_MAX; tc++) {
+				rx += xst->xst_tc_stats[tc].rxbytes;
+				tx += xst->xst_tc_stats[tc].txbytes;
+			}
+			if(charge(p, so, gen, rx, tx) < 0) return ERR_ALLOC;
+			owned = false;
+		}
+		offset += ROUNDUP64(r->len);
+	}
+	return 0;
+}
+
+/**
+ * Charges the bytes the group's TCP and UDP sockets moved since the last poll
+ * - parameter rx: set to the total bytes received over every poll, may be NULL
+ * - parameter tx: set to the total bytes sent over every poll, may be NULL
+ * - returns: the number of the group's open sockets, otherwise error
+ */
+int procsock_poll(struct procsock *p, u_int64_t *rx, u_int64_t *tx) {
+	if(!p) return ERR_NULL;
+
+	p->polls++;
+	int res = loadPids(p);
+	if(res < 0) return res;
+
+	for(size_t i = 0; i < sizeof(lists) / sizeof(lists[0]) && p->pidCount > 0; i++) {
+		ssize_t len = readList(p, lists[i]);
+		if(len < 0) return (int) len;
+		if((res = chargeList(p, (size_t) len)) < 0) return res;
+	}
+
+	// forget closed sockets so the table only holds open ones
+	u_int32_t open = 0;
+	for(u_int32_t i = 0; i < p->socketCap; i++) {
+		if(p->sockets[i].so != 0 && p->sockets[i].seen == p->polls) open++;
+	}
+	if(open != p->socketCount) {
+		u_int32_t cap = 64;
+		while(cap < open * 2) cap <<= 1;
+		if(rehash(p, cap, true) < 0) return ERR_ALLOC;
+	}
+
+	if(rx) *rx = p->rxbytes;
+	if(tx) *tx = p->txbytes;
+	return (int) p->socketCount;
+}
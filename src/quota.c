@@ -0,0 +1,191 @@
+#include "errorcodes.h"
+#include "quota.h"
+
+#include <fcntl.h> // open
+#include <stdlib.h> // calloc
+#include <string.h> // strncmp
+#include <stdbool.h>
+#include <unistd.h> // ftruncate
+#include <sys/file.h> // flock
+#include <sys/mman.h> // mmap, msync
+#include <sys/stat.h> // fstat
+
+/**
+ * Opens a quota file, creating it if needed
+ * - parameter path: path of the file
+ * - returns: the quotas, or NULL on failure
+ */
+struct quota *quota_open(const char *path) {
+	if(!path) return NULL;
+
+	struct quota *q = calloc(1, sizeof(struct quota));
+	if(!q) return NULL;
+	q->fd = open(path, O_RDWR | O_CREAT, 0644);
+
+	// the lock keeps two runs from setting up a new file at once
+	struct stat st;
+	if(q->fd < 0 || flock(q->fd, LOCK_EX) < 0 || fstat(q->fd, &st) < 0 ||
+	   (st.st_size != 0 && st.st_size != sizeof(struct quota_file)) ||
+	   (st.st_size == 0 && ftruncate(q->fd, sizeof(struct quota_file)) < 0)) {
+		quota_close(q);
+		return NULL;
+	}
+
+	struct quota_file *file = mmap(NULL, sizeof(struct quota_file), PROT_READ | PROT_WRITE, MAP_SHARED, q->fd, 0);
+	if(file == MAP_FAILED) {
+		quota_close(q);
+		return NULL;
+	}
+	q->file = file;
+
+	if(st.st_size == 0) {
+		file->header.version = QUOTA_VERSION;
+		file->header.entrySize = sizeof(struct quota_entry);
+		__atomic_store_n(&file->header.magic, QUOTA_MAGIC, __ATOMIC_RELEASE);
+	} else if(file->header.magic != QUOTA_MAGIC || file->header.version != QUOTA_VERSION ||
+	          file->header.entrySize != sizeof(struct quota_entry) || file->header.count > QUOTA_MAX_ENTRIES) {
+		quota_close(q);
+		return NULL;
+	}
+	flock(q->fd, LOCK_UN);
+	return q;
+}
+
+/**
+ * Writes the quotas to disk and closes the file
+ * - parameter q: quotas from `quota_open`
+ */
+void quota_close(struct quota *q) {
+	if(!q) return;
+	if(q->file) {
+		msync(q->file, sizeof(struct quota_file), MS_SYNC);
+		munmap(q->file, sizeof(struct quota_file));
+	}
+	if(q->fd >= 0) close(q->fd);
+	free(q);
+}
+
+/**
+ * Writes the quotas to disk, a crash or power loss afterwards keeps what was charged so far
+ * - returns: 0 on success, otherwise error
+ */
+int quota_sync(struct quota *q) {
+	if(!q) return ERR_NULL;
+	if(msync(q->file, sizeof(struct quota_file), MS_SYNC) < 0) return ERR_OPEN;
+	return 0;
+}
+
+/**
+ * - returns: the start of the period holding `now`
+ */
+static u_int64_t periodOf(time_t now, u_int32_t period) {
+	return (u_int64_t) now - (u_int64_t) now % period;
+}
+
+/**
+ * Starts the quota over if `now` is in a later period
+ * Only one run wins the switch, bytes another run charges in between are
+ * dropped with the old period
+ */
+static void startPeriod(struct quota_entry *e, time_t now) {
+	u_int32_t period = __atomic_load_n(&e->period, __ATOMIC_RELAXED);
+	if(period == 0) return;
+
+	u_int64_t start = periodOf(now, period);
+	u_int64_t current = __atomic_load_n(&e->periodStart, __ATOMIC_RELAXED);
+	if(start > current &&
+	   __atomic_compare_exchange_n(&e->periodStart, &current, start, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+		__atomic_store_n(&e->used, 0, __ATOMIC_RELAXED);
+	}
+}
+
+/**
+ * - parameter name: name of the quota
+ * - returns: the quota's index, otherwise error
+ */
+int quota_find(struct quota *q, const char *name) {
+	if(!q || !name) return ERR_NULL;
+
+	u_int32_t count = __atomic_load_n(&q->file->header.count, __ATOMIC_ACQUIRE);
+	for(u_int32_t i = 0; i < count && i < QUOTA_MAX_ENTRIES; i++) {
+		if(strncmp(q->file->entries[i].name, name, QUOTA_NAME_LEN) == 0) return i;
+	}
+	return ERR_OPTIONS;
+}
+
+/**
+ * Adds a quota, or changes the limit and period of an existing one and keeps what it used
+ * - parameter name: name of the quota, shorter than QUOTA_NAME_LEN
+ * - parameter limit: bytes per period, 0 is unlimited
+ * - parameter period: seconds, e.g. QUOTA_DAILY, 0 never starts over
+ * - returns: the quota's index, otherwise error
+ */
+int quota_define(struct quota *q, const char *name, u_int64_t limit, u_int32_t period) {
+	if(!q || !name) return ERR_NULL;
+	size_t len = strnlen(name, QUOTA_NAME_LEN);
+	if(len == 0 || len >= QUOTA_NAME_LEN) return ERR_OPTIONS;
+	if(flock(q->fd, LOCK_EX) < 0) return ERR_OPEN;
+
+	int index = quota_find(q, name);
+	struct quota_entry *e = NULL;
+	if(index >= 0) {
+		e = &q->file->entries[index];
+	} else if(q->file->header.count < QUOTA_MAX_ENTRIES) {
+		index = q->file->header.count;
+		e = &q->file->entries[index];
+		// the first charge starts its period
+		memset(e, 0, sizeof(struct quota_entry));
+		memcpy(e->name, name, len);
+	}
+
+	if(e) {
+		__atomic_store_n(&e->limit, limit, __ATOMIC_RELAXED);
+		__atomic_store_n(&e->period, period, __ATOMIC_RELAXED);
+		// the entry is complete before other runs can find it
+		if(index == (int) q->file->header.count) {
+			__atomic_store_n(&q->file->header.count, index + 1, __ATOMIC_RELEASE);
+		}
+	} else {
+		index = ERR_ALLOC;
+	}
+	flock(q->fd, LOCK_UN);
+	return index;
+}
+
+/**
+ * Charges bytes to a quota, safe to call from several threads and runs at once
+ * - parameter index: from `quota_find` or `quota_define`
+ * - parameter bytes: bytes to add
+ * - parameter now: the time, starts a new period if it is in one
+ * - returns: the bytes used in the current period, 0 for an unknown quota
+ */
+u_int64_t quota_charge(struct quota *q, int index, u_int64_t bytes, time_t now) {
+	if(!q || index < 0 || index >= (int) __atomic_load_n(&q->file->header.count, __ATOMIC_ACQUIRE)) return 0;
+
+	struct quota_entry *e = &q->file->entries[index];
+	startPeriod(e, now);
+	return __atomic_add_fetch(&e->used, bytes, __ATOMIC_RELAXED);
+}
+
+/**
+ * Copies a quota
+ * - parameter index: from `quota_find` or `quota_define`
+ * - parameter now: the time, starts a new period if it is in one
+ * - parameter out: set to the quota
+ * - returns: 0 on success, otherwise error
+ */
+int quota_get(struct quota *q, int index, time_t now, struct quota_entry *out) {
+	if(!q || !out) return ERR_NULL;
+	if(index < 0 || index >= (int) __atomic_load_n(&q->file->header.count, __ATOMIC_ACQUIRE)) return ERR_OPTIONS;
+
+	struct quota_entry *e = &q->file->entries[index];
+	startPeriod(e, now);
+	memcpy(out->name, e->name, QUOTA_NAME_LEN);
+	out->name[QUOTA_NAME_LEN - 1] = '\0';
+	out->limit = __atomic_load_n(&e->limit, __ATOMIC_RELAXED);
+	out->used = __atomic_load_n(&e->used, __ATOMIC_RELAXED);
+	out->periodStart = __atomic_load_n(&e->periodStart, __ATOMIC_RELAXED);
+	out->period = __atomic_load_n(&e->period, __ATOMIC_RELAXED);
+	out->reserved = 0;
+	return 0;
+}
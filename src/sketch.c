@@ -0,0 +1,242 @@
+#include "sketch.h"
+
+#include <stdlib.h> // calloc
+#include <string.h> // memcmp
+#include <stdio.h> // snprintf
+#include <math.h> // exp
+#include <stdbool.h>
+#include <arpa/inet.h> // inet_ntop
+
+/**
+ * - returns: a 64 bit hash of a key, FNV-1a with a final mix so every bit is used
+ */
+static u_int64_t hashKey(const struct sketch_key *key) {
+	u_int64_t h = 0xcbf29ce484222325ull;
+	h = (h ^ key->type) * 0x100000001b3ull;
+	for(u_int8_t i = 0; i < key->len; i++) {
+		h = (h ^ key->addr[i]) * 0x100000001b3ull;
+	}
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdull;
+	h ^= h >> 33;
+	return h;
+}
+
+/**
+ * - returns: the counter for a key in a row, rows use h1 + row * h2 so one hash serves them all
+ */
+static u_int64_t *counter(const struct sketch *s, u_int64_t hash, u_int32_t row) {
+	u_int32_t h1 = (u_int32_t) hash;
+	u_int32_t h2 = (u_int32_t) (hash >> 32) | 1;
+	return &s->counts[(u_int64_t) row * s->width + ((h1 + row * h2) & (s->width - 1))];
+}
+
+static int sameKey(const struct sketch_key *a, const struct sketch_key *b) {
+	return a->type == b->type && a->len == b->len && memcmp(a->addr, b->addr, a->len) == 0;
+}
+
+/**
+ * restores the heap below an entry whose count grew
+ */
+static void siftDown(struct sketch *s, u_int32_t i) {
+	while(true) {
+		u_int32_t smallest = i;
+		u_int32_t left = 2 * i + 1, right = 2 * i + 2;
+		if(left < s->size && s->top[left].count < s->top[smallest].count) smallest = left;
+		if(right < s->size && s->top[right].count < s->top[smallest].count) smallest = right;
+		if(smallest == i) return;
+
+		struct sketch_entry tmp = s->top[i];
+		s->top[i] = s->top[smallest];
+		s->top[smallest] = tmp;
+		i = smallest;
+	}
+}
+
+/**
+ * restores the heap above a new entry
+ */
+static void siftUp(struct sketch *s, u_int32_t i) {
+	while(i > 0 && s->top[(i - 1) / 2].count > s->top[i].count) {
+		struct sketch_entry tmp = s->top[i];
+		s->top[i] = s->top[(i - 1) / 2];
+		s->top[(i - 1) / 2] = tmp;
+		i = (i - 1) / 2;
+	}
+}
+
+/**
+ * Puts a key in the heap if its estimate is among the k largest
+ */
+static void updateTop(struct sketch *s, const struct sketch_key *key, u_int64_t estimate) {
+	// a key in the heap counts at least the minimum, so this skips most keys
+	if(s->size == s->k && estimate <= s->top[0].count) return;
+
+	for(u_int32_t i = 0; i < s->size; i++) {
+		if(sameKey(&s->top[i].key, key)) {
+			s->top[i].count = estimate;
+			siftDown(s, i);
+			return;
+		}
+	}
+
+	if(s->size < s->k) {
+		s->top[s->size].key = *key;
+		s->top[s->size].count = estimate;
+		siftUp(s, s->size++);
+	} else {
+		s->top[0].key = *key;
+		s->top[0].count = estimate;
+		siftDown(s, 0);
+	}
+}
+
+/**
+ * Creates an empty sketch
+ * - parameter width: counters per row, rounded up to a power of two
+ * - parameter depth: rows
+ * - parameter k: how many of the largest keys to track, at most SKETCH_MAX_K
+ * - returns: the sketch, or NULL on failure
+ */
+struct sketch *sketch_create(u_int32_t width, u_int32_t depth, u_int32_t k) {
+	if(width == 0 || depth == 0 || k == 0 || k > SKETCH_MAX_K || width > (1u << 31)) return NULL;
+
+	struct sketch *s = calloc(1, sizeof(struct sketch));
+	if(!s) return NULL;
+	s->width = 1;
+	while(s->width < width) s->width <<= 1;
+	s->depth = depth;
+	s->k = k;
+	s->counts = calloc((size_t) s->width * depth, sizeof(u_int64_t));
+	s->top = calloc(k, sizeof(struct sketch_entry));
+	if(!s->counts || !s->top) {
+		sketch_free(s);
+		return NULL;
+	}
+	return s;
+}
+
+/**
+ * - parameter s: sketch from `sketch_create`
+ */
+void sketch_free(struct sketch *s) {
+	if(!s) return;
+	free(s->counts);
+	free(s->top);
+	free(s);
+}
+
+/**
+ * Adds to a key's count and keeps the heap current
+ * - parameter key: the key
+ * - parameter count: amount to add, e.g. bytes
+ */
+void sketch_add(struct sketch *s, const struct sketch_key *key, u_int64_t count) {
+	u_int64_t hash = hashKey(key);
+	u_int64_t estimate = ~0ull;
+	for(u_int32_t row = 0; row < s->depth; row++) {
+		u_int64_t *c = counter(s, hash, row);
+		*c += count;
+		if(*c < estimate) estimate = *c;
+	}
+	s->total += count;
+	updateTop(s, key, estimate);
+}
+
+/**
+ * - returns: the key's count, never less than the true count
+ */
+u_int64_t sketch_estimate(const struct sketch *s, const struct sketch_key *key) {
+	u_int64_t hash = hashKey(key);
+	u_int64_t estimate = ~0ull;
+	for(u_int32_t row = 0; row < s->depth; row++) {
+		u_int64_t c = *counter(s, hash, row);
+		if(c < estimate) estimate = c;
+	}
+	return estimate;
+}
+
+/**
+ * Considers a key for the heap at its current estimate, used after merging
+ * - parameter key: the key
+ */
+void sketch_offer(struct sketch *s, const struct sketch_key *key) {
+	updateTop(s, key, sketch_estimate(s, key));
+}
+
+/**
+ * Adds another sketch's counters, the heap is left as is, so offer the
+ * other sketch's top keys once every merge is done
+ * - parameter dst: sketch to add to
+ * - parameter src: sketch with the same width and depth
+ * - returns: 0 on success, -1 if the sketches differ in shape
+ */
+int sketch_merge(struct sketch *dst, const struct sketch *src) {
+	if(dst->width != src->width || dst->depth != src->depth) return -1;
+
+	size_t n = (size_t) dst->width * dst->depth;
+	for(size_t i = 0; i < n; i++) {
+		dst->counts[i] += src->counts[i];
+	}
+	dst->total += src->total;
+	return 0;
+}
+
+static int byCount(const void *a, const void *b) {
+	u_int64_t x = ((const struct sketch_entry *) a)->count;
+	u_int64_t y = ((const struct sketch_entry *) b)->count;
+	return x < y ? 1 : (x > y ? -1 : 0);
+}
+
+/**
+ * Copies the largest keys, largest first
+ * - parameter out: set to the entries
+ * - parameter max: size of `out`
+ * - returns: the number of entries copied
+ */
+int sketch_top(const struct sketch *s, struct sketch_entry *out, int max) {
+	int n = (int) s->size < max ? (int) s->size : max;
+	struct sketch_entry all[SKETCH_MAX_K];
+	memcpy(all, s->top, s->size * sizeof(struct sketch_entry));
+	qsort(all, s->size, sizeof(struct sketch_entry), byCount);
+	memcpy(out, all, n * sizeof(struct sketch_entry));
+	return n;
+}
+
+/**
+ * - returns: how much an estimate may overcount, e / width * total
+ */
+u_int64_t sketch_error(const struct sketch *s) {
+	return (u_int64_t) ceil(M_E / s->width * s->total);
+}
+
+/**
+ * - returns: the probability an estimate is within `sketch_error`, 1 - e^-depth
+ */
+double sketch_confidence(const struct sketch *s) {
+	return 1.0 - exp(-(double) s->depth);
+}
+
+/**
+ * Formats a key as a MAC or IP address
+ * - parameter buf: set to the address
+ * - parameter len: size of buf, INET6_ADDRSTRLEN is enough for any key
+ * - returns: buf
+ */
+char *sketch_key_string(const struct sketch_key *key, char *buf, size_t len) {
+	const u_int8_t *a = key->addr;
+	switch(key->type) {
+		case SKETCH_MAC:
+			snprintf(buf, len, "%02x:%02x:%02x:%02x:%02x:%02x", a[0], a[1], a[2], a[3], a[4], a[5]);
+			break;
+		case SKETCH_IPV4:
+			inet_ntop(AF_INET, a, buf, len);
+			break;
+		case SKETCH_IPV6:
+			inet_ntop(AF_INET6, a, buf, len);
+			break;
+		default:
+			snprintf(buf, len, "?");
+	}
+	return buf;
+}
@@ -1,5 +1,10 @@
 #include "general.h"
+#include "session.h"
 #include "netinterfaces.h"
+#include "iftable.h"
+#include "jobs.h"
+#include "watch.h"
+#include <net/if_types.h> // IFT_ETHER
 
 char *interfaceToTest = "en4";
 int tests_run = 0;
@@ -35,37 +40,1136 @@ static char *interface_tests() {
 	}
 	mu_soft_assert("probably have some data...", totalBytes > 0);
 	mu_soft_assert("and probably have a loopback interface...", hasLoopback);
+	freeInterfaces(&interfaceList);
 
+	// only link layer entries become interfaces
+	struct sockaddr_dl link = {0};
+	struct sockaddr inet = {0};
+	struct if_data data = {0};
+	link.sdl_family = AF_LINK;
+	inet.sa_family = AF_INET;
+	data.ifi_ibytes = 7;
+	struct ifaddrs fake[2];
+	memset(fake, 0, sizeof(fake));
+	fake[0].ifa_name = fake[1].ifa_name = "fake0";
+	fake[0].ifa_addr = (struct sockaddr *) &link;
+	fake[0].ifa_data = &data;
+	fake[0].ifa_next = &fake[1];
+	fake[1].ifa_addr = &inet;
+	interfacesFrom(fake, &interfaceList);
+	mu_assert("one interface per link", itemsInList(interfaceList) == 1);
+	mu_assert("keeps the name", strcmp(((struct interface *)(interfaceList->content))->name, "fake0") == 0);
+	mu_assert("keeps the counters", ((struct interface *)(interfaceList->content))->ibytes == 7);
 	freeInterfaces(&interfaceList);
 	return 0;
 }
 
+// a `NET_RT_IFLIST2` message for one interface
+struct tableMessage {
+	struct if_msghdr2 ifm;
+	struct sockaddr_dl sdl;
+};
+
+/**
+ * fills a message as the kernel lists an interface
+ */
+static void tableMessage(struct tableMessage *m, const char *name, u_short index, u_int64_t ibytes, u_int64_t obytes) {
+	memset(m, 0, sizeof(*m));
+	m->ifm.ifm_msglen = sizeof(*m);
+	m->ifm.ifm_type = RTM_IFINFO2;
+	m->ifm.ifm_index = index;
+	m->ifm.ifm_flags = IFF_UP;
+	m->ifm.ifm_data.ifi_mtu = 1500;
+	m->ifm.ifm_data.ifi_type = IFT_ETHER;
+	m->ifm.ifm_data.ifi_ibytes = ibytes;
+	m->ifm.ifm_data.ifi_obytes = obytes;
+	m->sdl.sdl_family = AF_LINK;
+	m->sdl.sdl_nlen = strlen(name);
+	memcpy(m->sdl.sdl_data, name, m->sdl.sdl_nlen);
+}
+
+static char *iftable_tests() {
+	struct tableMessage msgs[40];
+	tableMessage(&msgs[0], "lo0", 1, 7, 7);
+	tableMessage(&msgs[1], "en0", 4, 1ull << 40, 10);
+	// address messages are skipped
+	tableMessage(&msgs[2], "en0", 4, 0, 0);
+	msgs[2].ifm.ifm_type = RTM_NEWADDR;
+	tableMessage(&msgs[3], "en1", 5, 0, 0);
+
+	struct iftable *t = iftable_create();
+	mu_assert("can create an interface table", t != NULL);
+	mu_assert("one row per interface", iftable_load(t, (char *) msgs, 4 * sizeof(struct tableMessage)) == 3);
+	mu_assert("rows are in the kernel's order", strcmp(t->names[0], "lo0") == 0 && strcmp(t->names[2], "en1") == 0);
+	mu_assert("keeps the index and flags", t->indices[1] == 4 && (t->flags[1] & IFF_UP));
+	mu_assert("counters are 64 bits", t->ibytes[1] == 1ull << 40 && t->obytes[1] == 10);
+	mu_assert("finds an interface's row", iftable_find(t, "en0") == 1 && iftable_find(t, "abcd") == -1);
+	mu_assert("keeps the MTU and type", t->mtus[1] == 1500 && t->types[1] == IFT_ETHER);
+
+	void *arena = t->arena;
+	msgs[1].ifm.ifm_data.ifi_ibytes += 100;
+	mu_assert("refreshes in place", iftable_load(t, (char *) msgs, 4 * sizeof(struct tableMessage)) == 3 &&
+		t->arena == arena && t->ibytes[1] == (1ull << 40) + 100);
+	mu_assert("a truncated message is skipped", iftable_load(t, (char *) msgs, 4 * sizeof(struct tableMessage) - 1) == 2);
+
+	char name[IFNAMSIZ];
+	for(int i = 0; i < 40; i++) {
+		snprintf(name, sizeof(name), "feth%d", i);
+		tableMessage(&msgs[i], name, i + 1, i, 0);
+	}
+	mu_assert("grows past its rows", iftable_load(t, (char *) msgs, sizeof(msgs)) == 40 &&
+		t->cap >= 40 && t->ibytes[39] == 39 && strcmp(t->names[39], "feth39") == 0);
+
+	mu_assert("can keep one interface", iftable_only(t, "feth7") == 0);
+	mu_assert("keeps only that interface", iftable_load(t, (char *) msgs, sizeof(msgs)) == 1 &&
+		strcmp(t->names[0], "feth7") == 0 && t->ibytes[0] == 7);
+	iftable_only(t, "abcd");
+	mu_assert("a missing interface still has a row", iftable_load(t, (char *) msgs, sizeof(msgs)) == 1 &&
+		strcmp(t->names[0], "abcd") == 0 && t->ibytes[0] == 0);
+	mu_assert("a name too long is refused", iftable_only(t, "abcdefghijklmnopq") == ERR_NOIF);
+
+	iftable_only(t, NULL);
+	mu_soft_assert("probably have an interface...", iftable_refresh(t) > 0);
+	mu_soft_assert("and probably have a loopback interface...", iftable_find(t, "lo0") >= 0);
+	mu_soft_assert("loopback should be up", getInterfaceStatus("lo0") == 0);
+	int row = iftable_find(t, "lo0");
+	mu_soft_assert("the table agrees loopback is up", row >= 0 && (t->flags[row] & IFF_UP));
+	iftable_free(t);
+	return 0;
+}
+
+static char *netstats_tests() {
+	char *name = "/netman.test";
+	struct netstats_segment *seg = netstats_create(name);
+	mu_assert("can create shared memory stats", seg != NULL);
+
+	struct netstats_entry *en = netstats_add_interface(seg, "en0");
+	struct netstats_entry *budget = netstats_add_budget(seg, "command", 1000);
+	mu_assert("can add stats entries", en != NULL && budget != NULL);
+	netstats_add(en, 100, 2, 0);
+	netstats_add(en, 50, 1, 1);
+	netstats_publish(budget, 150, 0, 0);
+
+	const struct netstats_segment *reader = netstats_open(name);
+	mu_assert("can open shared memory stats", reader != NULL);
+
+	struct netstats_snapshot snap;
+	mu_assert("can snapshot shared memory stats", netstats_snapshot(reader, &snap) == 0);
+	mu_assert("snapshot has one interface", snap.interfaceCount == 1);
+	mu_assert("snapshot has the interface's counters", strncmp(snap.interfaces[0].name, "en0", 3) == 0 &&
+		snap.interfaces[0].bytes == 150 && snap.interfaces[0].packets == 3 && snap.interfaces[0].drops == 1);
+	mu_assert("snapshot has the budget", snap.budgetCount == 1 &&
+		snap.budgets[0].bytes == 150 && snap.budgets[0].limit == 1000);
+	mu_assert("seqlock is even after writes", (snap.interfaces[0].seq & 1) == 0);
+
+	for(int i = 1; i < NETSTATS_MAX_INTERFACES; i++) {
+		netstats_add_interface(seg, "lo0");
+	}
+	mu_assert("interface entries are bounded", netstats_add_interface(seg, "lo0") == NULL);
+
+	netstats_close(reader);
+	netstats_destroy(seg, name);
+	mu_assert("segment is removed", netstats_open(name) == NULL);
+
+	netman_session *session = netman_open();
+	mu_assert("no budget entry without a segment", netman_shm_budget(session, "command", 1000) == NULL);
+	mu_assert("can publish through a session", netman_set_shm(session, name) == 0);
+	budget = netman_shm_budget(session, "command", 1000);
+	mu_assert("a session adds budget entries", budget != NULL && budget->limit == 1000);
+	netman_close(session);
+	return 0;
+}
+
+/**
+ * limit callback for the session tests
+ */
+static void onLimit(netman_session *session, u_int64_t bytes, void *ctx) {
+	(void) session;
+	*(u_int64_t *) ctx = bytes;
+}
+
+static char *histogram_tests() {
+	mu_assert("small values get their own bucket", histogram_bucket(0) == 0 && histogram_bucket(63) == 63);
+	mu_assert("largest value fits", histogram_bucket(~0ull) == HIST_BUCKETS - 1);
+
+	u_int64_t values[] = {0, 1, 31, 64, 65, 100, 1500, 9000, 65535, 1000000, 1ull << 40, ~0ull};
+	for(u_int32_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+		u_int32_t b = histogram_bucket(values[i]);
+		mu_assert("bucket bounds hold the value", histogram_lower(b) <= values[i] && values[i] <= histogram_upper(b));
+		mu_assert("buckets are at most 1/32 wide", histogram_upper(b) - histogram_lower(b) <= histogram_lower(b) / 32);
+	}
+	for(u_int32_t b = 1; b < HIST_BUCKETS; b++) {
+		mu_assert("buckets are contiguous", histogram_lower(b) == histogram_upper(b - 1) + 1);
+	}
+
+	struct histogram *h = calloc(1, sizeof(struct histogram));
+	struct histogram *copy = calloc(1, sizeof(struct histogram));
+	for(u_int64_t v = 1; v <= 1000; v++) {
+		histogram_record(h, v);
+	}
+	histogram_snapshot(h, copy);
+	mu_assert("snapshot has every value", copy->count == 1000 && copy->sum == 500500);
+	u_int64_t p50 = histogram_percentile(copy, 50);
+	mu_assert("median is within a bucket", p50 >= 500 && p50 <= 516);
+	mu_assert("max is within a bucket", histogram_percentile(copy, 100) >= 1000 && histogram_percentile(copy, 100) <= 1023);
+	free(h);
+	free(copy);
+	return 0;
+}
+
+static char *sketch_tests() {
+	mu_assert("k is bounded", sketch_create(SKETCH_DEFAULT_WIDTH, SKETCH_DEFAULT_DEPTH, SKETCH_MAX_K + 1) == NULL);
+	struct sketch *a = sketch_create(1000, SKETCH_DEFAULT_DEPTH, 4);
+	struct sketch *b = sketch_create(SKETCH_DEFAULT_WIDTH, SKETCH_DEFAULT_DEPTH, 4);
+	struct sketch *merged = sketch_create(1024, SKETCH_DEFAULT_DEPTH, 4);
+	mu_assert("can create sketches", a && b && merged);
+	mu_assert("width is a power of two", a->width == 1024);
+	mu_assert("shapes must match to merge", sketch_merge(merged, b) < 0);
+
+	// four heavy addresses among many light ones
+	struct sketch_key key = {SKETCH_IPV4, 4, {10, 0, 0, 0}};
+	for(u_int32_t i = 0; i < 20000; i++) {
+		key.addr[2] = i % 8 == 0 ? 0 : (u_int8_t) (i >> 8);
+		key.addr[3] = i % 8 == 0 ? (u_int8_t) (i / 8 % 4) : (u_int8_t) i;
+		sketch_add(a, &key, 1500);
+	}
+	key.addr[2] = 0;
+	key.addr[3] = 1;
+	mu_assert("estimates never undercount", sketch_estimate(a, &key) >= 625 * 1500);
+	mu_assert("estimates are within the error", sketch_estimate(a, &key) <= 625 * 1500 + sketch_error(a));
+
+	mu_assert("can merge", sketch_merge(merged, a) == 0 && sketch_merge(merged, a) == 0);
+	for(u_int32_t i = 0; i < a->size; i++) {
+		sketch_offer(merged, &a->top[i].key);
+	}
+	struct sketch_entry top[4];
+	int n = sketch_top(merged, top, 4);
+	mu_assert("finds the heavy addresses", n == 4);
+	for(int i = 0; i < n; i++) {
+		mu_assert("top addresses are the heavy ones", top[i].key.addr[2] == 0 && top[i].key.addr[3] < 4);
+		mu_assert("merged counts add", top[i].count >= 2 * 625 * 1500);
+		mu_assert("top is sorted", i == 0 || top[i - 1].count >= top[i].count);
+	}
+
+	char addr[INET6_ADDRSTRLEN];
+	mu_assert("formats IPv4", strcmp(sketch_key_string(&key, addr, sizeof(addr)), "10.0.0.1") == 0);
+	struct sketch_key mac = {SKETCH_MAC, 6, {0xde, 0xad, 0xbe, 0xef, 0, 1}};
+	mu_assert("formats MACs", strcmp(sketch_key_string(&mac, addr, sizeof(addr)), "de:ad:be:ef:00:01") == 0);
+
+	sketch_free(a);
+	sketch_free(b);
+	sketch_free(merged);
+	return 0;
+}
+
+/**
+ * - returns: the budget of the longest prefix holding an IPv4 or IPv6 address
+ */
+static int lookupAddress(struct prefix_table *table, const char *address) {
+	u_int8_t addr[16];
+	if(inet_pton(AF_INET, address, addr) == 1) return prefix_lookup(&table->v4, addr, 4);
+	if(inet_pton(AF_INET6, address, addr) == 1) return prefix_lookup(&table->v6, addr, 16);
+	return -2;
+}
+
+static char *prefix_tests() {
+	struct prefix_table *table = prefix_create();
+	mu_assert("can create a prefix table", table != NULL);
+	mu_assert("empty table matches nothing", lookupAddress(table, "10.0.0.1") == -1);
+
+	// added longest first to check the build sorts them
+	int host = prefix_add(table, "host", 0, "10.1.3.7");
+	int lab = prefix_add(table, "lab", 0, "10.1.2.0/23");
+	int internal = prefix_add(table, "internal", 0, "10.0.0.0/8");
+	int internet = prefix_add(table, "internet", 1000000, "0.0.0.0/0");
+	int v6 = prefix_add(table, "v6", 0, "2001:db8::/32");
+	mu_assert("budgets get indexes", host == 0 && lab == 1 && internal == 2 && internet == 3 && v6 == 4);
+	mu_assert("host bits are ignored", prefix_add(table, "lab", 0, "10.1.2.99/23") == lab);
+	mu_assert("bad prefixes are rejected", prefix_add(table, "bad", 0, "10.1.2/8") < 0 &&
+	                                       prefix_add(table, "bad", 0, "10.0.0.0/33") < 0);
+	mu_assert("can build", prefix_build(table) == 0 && table->prefixCount == 6);
+
+	mu_assert("default route catches the rest", lookupAddress(table, "8.8.8.8") == internet);
+	mu_assert("matches a /8", lookupAddress(table, "10.9.9.9") == internal);
+	mu_assert("matches a /23", lookupAddress(table, "10.1.3.200") == lab);
+	mu_assert("host beats its /23", lookupAddress(table, "10.1.3.7") == host);
+	mu_assert("next to the /23 is the /8", lookupAddress(table, "10.1.4.1") == internal);
+	mu_assert("matches IPv6", lookupAddress(table, "2001:db8::5") == v6);
+	mu_assert("IPv6 has no default route", lookupAddress(table, "2001:db9::1") == -1);
+	mu_assert("keeps the first limit", table->budgets[internet].limit == 1000000);
+	prefix_free(table);
+
+	char path[] = "/tmp/netman.budgets.XXXXXX";
+	int fd = mkstemp(path);
+	mu_assert("can create a budget file", fd >= 0);
+	dprintf(fd, "# metered\ninternet 5000 0.0.0.0/0\n\ninternal 0 10.0.0.0/8 # free\nbroken 10.0.0.0/8\n");
+	close(fd);
+
+	int line = 0;
+	table = prefix_create();
+	mu_assert("bad lines are reported", prefix_load(table, path, &line) == ERR_OPTIONS && line == 5);
+	prefix_free(table);
+	unlink(path);
+	return 0;
+}
+
+static char *dedup_tests() {
+	mu_assert("window can't be 0", dedup_create(DEDUP_DEFAULT_BITS, 0) == NULL);
+	struct dedup *d = dedup_create(DEDUP_DEFAULT_BITS, DEDUP_DEFAULT_WINDOW_USEC);
+	mu_assert("can create a filter", d != NULL);
+
+	// an IPv4 frame and the same packet with a VLAN tag, as seen on a VLAN's parent
+	u_char frame[128] = {0}, tagged[132] = {0};
+	frame[12] = 0x08;
+	for(int i = ETHER_HDR_LEN; i < 128; i++) frame[i] = (u_char) i;
+	memcpy(tagged, frame, 12);
+	tagged[12] = 0x81;
+	tagged[15] = 5;
+	memcpy(tagged + 16, frame + 12, 116);
+
+	u_int64_t t = 1000000000;
+	mu_assert("first copy counts", !dedup_seen(d, frame, 128, 128, t));
+	mu_assert("second copy is a duplicate", dedup_seen(d, frame, 128, 128, t + 10));
+	mu_assert("tagged copy is a duplicate", dedup_seen(d, tagged, 132, 132, t + 20));
+	frame[40]++;
+	mu_assert("other packets count", !dedup_seen(d, frame, 128, 128, t + 30));
+	mu_assert("copies in the next window are duplicates", dedup_seen(d, frame, 128, 128, t + DEDUP_DEFAULT_WINDOW_USEC));
+	mu_assert("copies windows later count", !dedup_seen(d, frame, 128, 128, t + 5 * DEDUP_DEFAULT_WINDOW_USEC));
+	mu_assert("runt frames count", !dedup_seen(d, frame, 10, 10, t + 5 * DEDUP_DEFAULT_WINDOW_USEC));
+
+	// unique packets should almost never look like duplicates
+	int falsePositives = 0;
+	for(u_int32_t i = 0; i < 100000; i++) {
+		memcpy(frame + ETHER_HDR_LEN, &i, sizeof(i));
+		falsePositives += dedup_seen(d, frame, 128, 128, t + 10 * DEDUP_DEFAULT_WINDOW_USEC);
+	}
+	mu_assert("few false positives", falsePositives < 100);
+	dedup_free(d);
+	return 0;
+}
+
+static char *procsock_tests() {
+	mu_assert("group must be valid", procsock_create(0) == NULL);
+	mu_assert("can't poll nothing", procsock_poll(NULL, NULL, NULL) == ERR_NULL);
+	struct procsock *p = procsock_create(getpgrp());
+	mu_assert("can create a tracker", p != NULL);
+
+	u_int64_t rx = 0, tx = 0;
+	mu_assert("can poll our own group", procsock_poll(p, &rx, &tx) >= 0);
+
+	// a socket that sends itself 10 datagrams over loopback
+	int fd = socket(AF_INET, SOCK_DGRAM, 0);
+	mu_assert("can open a socket", fd >= 0);
+	struct sockaddr_in addr = {0};
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t addrLen = sizeof(addr);
+	mu_assert("can bind the socket", bind(fd, (struct sockaddr *) &addr, addrLen) == 0);
+	getsockname(fd, (struct sockaddr *) &addr, &addrLen);
+	char payload[1000] = {0};
+	for(int i = 0; i < 10; i++) {
+		sendto(fd, payload, sizeof(payload), 0, (struct sockaddr *) &addr, addrLen);
+		recv(fd, payload, sizeof(payload), 0);
+	}
+
+	u_int64_t rx2 = 0, tx2 = 0;
+	int sockets = procsock_poll(p, &rx2, &tx2);
+	mu_soft_assert("should find our socket", sockets >= 1);
+	mu_soft_assert("should count what it received", rx2 - rx >= 10000);
+	mu_soft_assert("should count what it sent", tx2 - tx >= 10000);
+	mu_soft_assert("a second poll counts nothing new", procsock_poll(p, &rx, &tx) >= 0 && rx == rx2 && tx == tx2);
+
+	close(fd);
+	mu_soft_assert("closed sockets are forgotten", procsock_poll(p, NULL, NULL) == sockets - 1 || sockets < 1);
+	procsock_free(p);
+	return 0;
+}
+
+/**
+ * appends a bpf record holding an ethernet frame to a read buffer
+ * - returns: the offset after the record
+ */
+static size_t addRecord(char *buf, size_t offset, u_int16_t type, u_int32_t len) {
+	struct bpf_hdr *bh = (struct bpf_hdr *) (buf + offset);
+	u_short hdrlen = BPF_WORDALIGN(sizeof(struct bpf_hdr) + ETHER_HDR_LEN) - ETHER_HDR_LEN;
+	memset(bh, 0, hdrlen + len);
+	bh->bh_hdrlen = hdrlen;
+	bh->bh_caplen = len;
+	bh->bh_datalen = len;
+	struct ether_header *eh = (struct ether_header *) (buf + offset + hdrlen);
+	eh->ether_type = htons(type);
+	return offset + BPF_WORDALIGN(hdrlen + len);
+}
+
+/**
+ * runs a program from `sample_program` on a frame, as the kernel would
+ * - parameter insns: the program, using only absolute loads, ANDs, equality jumps and returns
+ * - parameter count: instructions in the program
+ * - parameter frame: the frame
+ * - parameter len: bytes in the frame
+ * - returns: the program's result, nonzero if the frame passes
+ */
+static u_int runSampleProgram(const struct bpf_insn *insns, u_int count, const u_char *frame, u_int len) {
+	u_int32_t a = 0;
+	for(u_int pc = 0; pc < count; pc++) {
+		const struct bpf_insn *i = &insns[pc];
+		switch(i->code) {
+			case BPF_LD + BPF_H + BPF_ABS:
+				if(i->k + 2 > len) return 0;
+				a = (frame[i->k] << 8) | frame[i->k + 1];
+				break;
+			case BPF_ALU + BPF_AND + BPF_K:
+				a &= i->k;
+				break;
+			case BPF_JMP + BPF_JEQ + BPF_K:
+				pc += a == i->k ? i->jt : i->jf;
+				break;
+			case BPF_RET + BPF_K:
+				return i->k;
+			default:
+				return 0;
+		}
+	}
+	return 0;
+}
+
+/**
+ * counts the IPv4 frames, with the given ID and checksums, a sample program passes
+ * - parameter insns: the program from `sample_program`
+ * - parameter n: instructions in the program
+ * - parameter id: the IPv4 ID of every frame, or -1 for 1 through `count`
+ * - parameter checksum: the checksum of every frame, or -1 for 1 through `count`
+ * - returns: how many frames passed
+ */
+static int samplePasses(const struct bpf_insn *insns, u_int n, int id, int checksum, int count) {
+	u_char frame[ETHER_HDR_LEN + 20] = {0};
+	struct ether_header *eh = (struct ether_header *) frame;
+	eh->ether_type = htons(ETHERTYPE_IP);
+	int passed = 0;
+	for(int i = 1; i <= count; i++) {
+		u_int16_t fields[2] = {htons(id < 0 ? i : id), htons(checksum < 0 ? i : checksum)};
+		memcpy(frame + ETHER_HDR_LEN + 4, &fields[0], 2);
+		memcpy(frame + ETHER_HDR_LEN + 10, &fields[1], 2);
+		passed += runSampleProgram(insns, n, frame, sizeof(frame)) != 0;
+	}
+	return passed;
+}
+
+static char *sample_tests() {
+	netman_session *session = netman_open();
+	mu_assert("can open a session", session != NULL);
+	mu_assert("rate must be a power of two", netman_set_sample(session, 12) == ERR_OPTIONS);
+	mu_assert("rate must be at most the max", netman_set_sample(session, NETMAN_SAMPLE_MAX * 2) == ERR_OPTIONS);
+	mu_assert("can sample", netman_set_sample(session, 8) == 0);
+
+	struct capture *c = capture_create(session, "test0");
+	mu_assert("can create a capture", c != NULL);
+	c->sample = 8;
+
+	// two sampled IPv4 packets stand for 8 each, ARP counts once
+	char buf[1024];
+	size_t len = addRecord(buf, 0, ETHERTYPE_IP, 100);
+	len = addRecord(buf, len, ETHERTYPE_IP, 200);
+	len = addRecord(buf, len, ETHERTYPE_ARP, 60);
+	u_int64_t packets = 0, bytes = 0, lastStamp = 0;
+	process_packets(c, buf, (ssize_t) len, &packets, &bytes, &lastStamp);
+	mu_assert("handled every packet", packets == 3);
+	mu_assert("scaled up the sampled packets", netman_bytes(session) == 8 * 300 + 60);
+
+	struct netman_estimate e;
+	mu_assert("can estimate", netman_estimate(session, &e) == 0);
+	mu_assert("reports the rate", e.sampleRate == 8 && !e.exact);
+	mu_assert("interval holds the estimate", e.bytesLow < e.bytes && e.bytes < e.bytesHigh);
+	// the capture was never started so the session only sees the scaled up share
+	mu_assert("sampled packets are scaled", e.packets == 2 * 7);
+
+	// a limit near the estimate switches to exact counting
+	netman_set_limit(session, 4000);
+	process_packets(c, buf, (ssize_t) len, &packets, &bytes, &lastStamp);
+	mu_assert("switches to exact near the limit", netman_estimate(session, &e) == 0 && e.exact);
+
+	capture_destroy(c);
+	netman_close(session);
+
+	// checksum offload leaves sent packets with a 0 checksum, they must still be sampled
+	struct bpf_insn insns[SAMPLE_FILTER_LEN];
+	u_int n = sample_program(8, insns);
+	mu_assert("sampling has a program", n == SAMPLE_FILTER_LEN);
+	mu_assert("offloaded packets are sampled by ID", samplePasses(insns, n, -1, 0, 64) == 8);
+	mu_assert("packets without an ID are sampled by checksum", samplePasses(insns, n, 0, -1, 64) == 8);
+	u_char arp[ETHER_HDR_LEN + 28] = {0};
+	((struct ether_header *) arp)->ether_type = htons(ETHERTYPE_ARP);
+	mu_assert("anything else passes", runSampleProgram(insns, n, arp, sizeof(arp)) != 0);
+	n = sample_program(1, insns);
+	mu_assert("not sampling passes everything", samplePasses(insns, n, -1, 0, 64) == 64);
+	return 0;
+}
+
+/**
+ * finds an interface with a link layer address, so captures on it know direction
+ * - parameter mac: set to the interface's address
+ * - returns: the interface's name, otherwise NULL
+ */
+static const char *macInterface(u_int8_t *mac) {
+	static char name[IFNAMSIZ];
+	struct iftable *t = iftable_create();
+	int found = false;
+	if(t && iftable_refresh(t) > 0) {
+		for(int i = 0; i < t->count && !found; i++) {
+			found = interfaceMAC(t->names[i], mac) == 0;
+			if(found) strlcpy(name, t->names[i], sizeof(name));
+		}
+	}
+	iftable_free(t);
+	return found ? name : NULL;
+}
+
+static char *direction_tests() {
+	// frames from the interface's own address were sent
+	u_int8_t mac[ETHER_ADDR_LEN];
+	const char *ifname = macInterface(mac);
+	char buf[1024];
+	size_t len = addRecord(buf, 0, ETHERTYPE_IP, 100);
+	size_t sent = len;
+	len = addRecord(buf, len, ETHERTYPE_IP, 200);
+	len = addRecord(buf, len, ETHERTYPE_ARP, 60);
+	struct bpf_hdr *bh = (struct bpf_hdr *) (buf + sent);
+	u_int64_t packets = 0, bytes = 0, lastStamp = 0, rx = 0, tx = 0;
+
+	netman_session *session = netman_open();
+	mu_assert("can set direction limits", netman_set_direction_limits(session, 0, 250) == 0);
+	mu_soft_assert("probably have an interface with a MAC address...", ifname != NULL);
+	if(ifname) {
+		memcpy(((struct ether_header *) (buf + sent + bh->bh_hdrlen))->ether_shost, mac, ETHER_ADDR_LEN);
+		struct capture *c = capture_create(session, ifname);
+		mu_assert("can create a capture", c != NULL);
+		mu_assert("a direction limit looks up the MAC", c->hasMac && memcmp(c->mac, mac, ETHER_ADDR_LEN) == 0);
+		mu_assert("a direction limit picks the direction stage", pipeline_stages(c) & PIPELINE_DIRECTION);
+
+		process_packets(c, buf, (ssize_t) len, &packets, &bytes, &lastStamp);
+		mu_assert("can read the directions", netman_direction_bytes(session, &rx, &tx) == 0);
+		mu_assert("received and sent are split", rx == 160 && tx == 200 && netman_bytes(session) == 360);
+		mu_assert("the capture keeps its share", c->rxBytes == 160 && c->txBytes == 200);
+		mu_assert("under the sent limit", !netman_limit_reached(session));
+		process_packets(c, buf, (ssize_t) len, &packets, &bytes, &lastStamp);
+		mu_assert("the sent limit is reached on its own", netman_limit_reached(session));
+		capture_destroy(c);
+	}
+	netman_close(session);
+
+	// without the interface's address every frame counts as received
+	session = netman_open();
+	netman_set_direction_limits(session, 0, 250);
+	struct capture *c = capture_create(session, "abcd");
+	mu_assert("can create a capture", c != NULL);
+	mu_assert("an interface without a MAC has no direction", !c->hasMac && !(pipeline_stages(c) & PIPELINE_DIRECTION));
+	process_packets(c, buf, (ssize_t) len, &packets, &bytes, &lastStamp);
+	netman_direction_bytes(session, &rx, &tx);
+	mu_assert("unknown direction is received", rx == 360 && tx == 0);
+	capture_destroy(c);
+	netman_close(session);
+
+	session = netman_open();
+	netman_set_direction_limits(session, 1000, 0);
+	direction_count(session, NULL, 999, 5000);
+	mu_assert("a direction without a limit has none", !netman_limit_reached(session));
+	direction_count(session, NULL, 1, 0);
+	mu_assert("the received limit is reached", netman_limit_reached(session));
+	netman_close(session);
+	return 0;
+}
+
+static char *pipeline_tests() {
+	netman_session *session = netman_open();
+	struct capture *c = capture_create(session, "test0");
+	mu_assert("can create a capture", c != NULL);
+	mu_assert("counting needs no stages", pipeline_stages(c) == 0);
+
+	char buf[1024];
+	size_t len = addRecord(buf, 0, ETHERTYPE_IP, 100);
+	len = addRecord(buf, len, ETHERTYPE_IPV6, 200);
+	len = addRecord(buf, len, ETHERTYPE_ARP, 60);
+	u_int64_t packets = 0, bytes = 0, lastStamp = 0;
+	mu_assert("returns the last record", process_packets(c, buf, (ssize_t) len, &packets, &bytes, &lastStamp) != NULL);
+	mu_assert("counting sums the lengths", packets == 3 && bytes == 360 && netman_bytes(session) == 360);
+	mu_assert("directions aren't counted without a limit", netman_direction_bytes(session, &packets, &bytes) == 0 && packets == 0);
+
+	// the verbose dump runs every stage in one loop and counts the same
+	int verbose = verbose_flag;
+	verbose_flag = true;
+	mu_assert("verbose dumps", pipeline_stages(c) == PIPELINE_DUMP);
+	packets = bytes = 0;
+	process_packets(c, buf, (ssize_t) len, &packets, &bytes, &lastStamp);
+	verbose_flag = verbose;
+	mu_assert("dumping counts the same", packets == 3 && bytes == 360 && netman_bytes(session) == 720);
+	capture_destroy(c);
+	netman_close(session);
+
+	// each feature adds its stage
+	session = netman_open();
+	netman_set_histograms(session, true);
+	netman_set_top(session, 4);
+	netman_set_dedup(session, 0);
+	netman_set_direction_limits(session, 0, 1000000);
+	u_int8_t mac[ETHER_ADDR_LEN];
+	const char *ifname = macInterface(mac);
+	c = capture_create(session, ifname ? ifname : "test0");
+	mu_assert("can create a capture", c != NULL);
+	c->sample = 8;
+	// direction needs the interface's MAC address
+	u_int32_t stages = PIPELINE_SPECIALIZED & ~PIPELINE_BUDGETS & ~(ifname ? 0 : PIPELINE_DIRECTION);
+	mu_assert("features pick their stages", pipeline_stages(c) == stages);
+	c->sample = 1;
+	mu_assert("exact counting stops sampling", !(pipeline_stages(c) & PIPELINE_SAMPLE));
+	packets = bytes = 0;
+	process_packets(c, buf, (ssize_t) len, &packets, &bytes, &lastStamp);
+	mu_assert("every stage counts the same", packets == 3 && bytes == 360 && c->sizes->count == 3);
+	capture_destroy(c);
+	netman_close(session);
+	return 0;
+}
+
+/**
+ * writes a byte into a pipe after a pause, so a reader has to wait for it
+ */
+static void *writeLater(void *arg) {
+	usleep(20 * 1000);
+	char byte = 'x';
+	if(write((int) (intptr_t) arg, &byte, 1) != 1) return arg;
+	return NULL;
+}
+
+static char *busy_poll_tests() {
+	netman_session *session = netman_open();
+	mu_assert("spinning is bounded", netman_set_busy_poll(session, BUSY_POLL_MAX_USEC + 1) == ERR_OPTIONS);
+	mu_assert("can busy poll", netman_set_busy_poll(session, BUSY_POLL_DEFAULT_USEC) == 0);
+	netman_close(session);
+
+	// reads spin, then block until data arrives
+	int fds[2], enable = 1;
+	mu_assert("can open a pipe", pipe(fds) == 0 && ioctl(fds[0], FIONBIO, &enable) == 0);
+	char buf[8];
+	pthread_t writer;
+	for(u_int32_t spin = 1; spin <= 100000; spin *= 100) {
+		pthread_create(&writer, NULL, writeLater, (void *) (intptr_t) fds[1]);
+		mu_assert("a spinning read gets the data", spin_read(fds[0], buf, sizeof(buf), spin) == 1 && buf[0] == 'x');
+		pthread_join(writer, NULL);
+	}
+	close(fds[1]);
+	mu_assert("a closed pipe ends the read", spin_read(fds[0], buf, sizeof(buf), 10) == 0);
+	close(fds[0]);
+
+	// with histograms each packet's wait from its timestamp to the read is kept
+	session = netman_open();
+	netman_set_histograms(session, true);
+	struct capture *c = capture_create(session, "test0");
+	mu_assert("captures with histograms measure latency", c != NULL && c->latency != NULL);
+	char records[256];
+	size_t len = addRecord(records, 0, ETHERTYPE_IP, 100);
+	((struct bpf_hdr *) records)->bh_tstamp.tv_sec = 1000;
+	c->readUsec = 1000 * 1000000ull + 250;
+	u_int64_t packets = 0, bytes = 0, lastStamp = 0;
+	process_packets(c, records, (ssize_t) len, &packets, &bytes, &lastStamp);
+	mu_assert("latency is from the timestamp to the read", c->latency->count == 1 && histogram_percentile(c->latency, 100) >= 250);
+	capture_destroy(c);
+	netman_close(session);
+	return 0;
+}
+
+/**
+ * totals callback for the history tests
+ */
+static void sumSeries(const char *series, u_int64_t bytes, void *ctx) {
+	u_int64_t *totals = ctx;
+	if(strcmp(series, "en0") == 0) totals[0] += bytes;
+	if(strcmp(series, "command") == 0) totals[1] += bytes;
+}
+
+static char *history_tests() {
+	char path[] = "/tmp/netman.history.XXXXXX";
+	int fd = mkstemp(path);
+	mu_assert("can create a history file", fd >= 0);
+	close(fd);
+
+	struct history *h = history_open(path, 60);
+	mu_assert("can open an empty history file", h != NULL);
+	int series[] = {history_series(h, "en0"), history_series(h, "command")};
+	mu_assert("series get ids", series[0] == 0 && series[1] == 1);
+	mu_assert("series are found again", history_series(h, "en0") == 0);
+
+	// enough ticks to fill several blocks
+	u_int64_t bytes[2];
+	for(u_int64_t i = 1; i <= 5000; i++) {
+		bytes[0] = i * 1000;
+		bytes[1] = 7;
+		mu_assert("can append a tick", history_append(h, 1000 + i * 60, series, bytes, 2) == 0);
+	}
+	mu_assert("ticks span blocks", h->blockIndex > 1);
+	history_close(h);
+
+	// reopening continues the last block
+	h = history_open(path, 0);
+	mu_assert("can reopen a history file", h != NULL && h->lastTick == 1000 + 5000 * 60);
+	mu_assert("keeps the file's resolution", h->header.resolution == 60);
+	bytes[0] = 1;
+	mu_assert("can append after reopening", history_append(h, 1000 + 5001 * 60, series, bytes, 1) == 0);
+	history_close(h);
+
+	u_int64_t totals[2] = {0};
+	mu_assert("can query a range", history_query(path, 1000 + 100 * 60, 1000 + 200 * 60, sumSeries, totals) == 0);
+	mu_assert("range sums its ticks", totals[0] == 15050000 && totals[1] == 700);
+
+	totals[0] = totals[1] = 0;
+	history_query(path, 0, 1000 + 5001 * 60, sumSeries, totals);
+	mu_assert("whole file sums every tick", totals[0] == 12502500001ull && totals[1] == 35000);
+
+	totals[0] = totals[1] = 0;
+	history_query(path, 0, 999, sumSeries, totals);
+	mu_assert("range before the file is empty", totals[0] == 0 && totals[1] == 0);
+
+	unlink(path);
+	mu_assert("missing file is an error", history_query(path, 0, 1, sumSeries, totals) == ERR_OPEN);
+	return 0;
+}
+
+static char *quota_tests() {
+	char path[] = "/tmp/netman.quota.XXXXXX";
+	int fd = mkstemp(path);
+	mu_assert("can create a quota file", fd >= 0);
+	close(fd);
+
+	struct quota *q = quota_open(path);
+	mu_assert("can open an empty quota file", q != NULL);
+	mu_assert("unknown quotas aren't found", quota_find(q, "backup") == ERR_OPTIONS);
+	mu_assert("names must fit", quota_define(q, "a name much longer than thirty one characters", 1, 0) == ERR_OPTIONS);
+	int daily = quota_define(q, "backup", 1000, QUOTA_DAILY);
+	int forever = quota_define(q, "forever", 0, 0);
+	mu_assert("quotas get indexes", daily == 0 && forever == 1);
+
+	time_t day = 1714521600; // a midnight UTC
+	mu_assert("charges add up", quota_charge(q, daily, 600, day + 10) == 600 && quota_charge(q, daily, 600, day + 20) == 1200);
+	mu_assert("unknown indexes charge nothing", quota_charge(q, 5, 600, day) == 0);
+	quota_charge(q, forever, 7, day);
+
+	struct quota_entry e;
+	mu_assert("redefining keeps the usage", quota_define(q, "backup", 2000, QUOTA_DAILY) == daily);
+	mu_assert("can read a quota", quota_get(q, daily, day + 30, &e) == 0);
+	mu_assert("quota has its limit and usage", e.limit == 2000 && e.used == 1200 && strcmp(e.name, "backup") == 0);
+	mu_assert("can write the file", quota_sync(q) == 0);
+	quota_close(q);
+
+	// another run sees the same usage, and the next day starts over
+	q = quota_open(path);
+	mu_assert("can reopen a quota file", q != NULL && quota_find(q, "forever") == forever);
+	quota_get(q, daily, day + QUOTA_DAILY - 1, &e);
+	mu_assert("usage persists", e.used == 1200);
+	mu_assert("the next day starts over", quota_charge(q, daily, 5, day + QUOTA_DAILY + 1) == 5);
+	quota_get(q, daily, day + QUOTA_DAILY + 2, &e);
+	mu_assert("the period moves on", e.periodStart == (u_int64_t) day + QUOTA_DAILY && e.used == 5);
+	quota_get(q, forever, day + 10 * QUOTA_DAILY, &e);
+	mu_assert("quotas without a period never start over", e.used == 7);
+
+	// a session refuses a used up quota
+	quota_define(q, "spent", 100, 0);
+	quota_charge(q, quota_find(q, "spent"), 100, time(NULL));
+	quota_close(q);
+	netman_session *session = netman_open();
+	mu_assert("a used up quota is refused", netman_set_quota(session, path, "spent") == ERR_QUOTA);
+	mu_assert("an unknown quota is refused", netman_set_quota(session, path, "missing") == ERR_OPTIONS);
+	mu_assert("can charge a quota", netman_set_quota(session, path, "forever") == 0);
+	session_count(session, 50);
+	mu_assert("unflushed bytes are counted", netman_quota(session, &e) == 0 && e.used == 57);
+	netman_close(session);
+
+	q = quota_open(path);
+	quota_get(q, forever, time(NULL), &e);
+	mu_assert("closing flushes the session's bytes", e.used == 57);
+	quota_close(q);
+
+	unlink(path);
+	return 0;
+}
+
+static int leaseServing = 0;
+
+/**
+ * serves the aggregator for the lease tests until leaseServing is cleared
+ */
+static void *serveLeases(void *arg) {
+	while(__atomic_load_n(&leaseServing, __ATOMIC_ACQUIRE)) {
+		lease_server_serve(arg, 10);
+	}
+	return NULL;
+}
+
+static char *lease_tests() {
+	mu_assert("an aggregator needs a budget", lease_server_create("0", 0, 0) == NULL);
+	u_int64_t budget = 10 * LEASE_MIN_SLICE;
+	struct lease_server *s = lease_server_create("0", budget, 500);
+	mu_assert("can listen on a free port", s != NULL && lease_server_port(s) > 0);
+	char port[8];
+	snprintf(port, sizeof(port), "%d", lease_server_port(s));
+	pthread_t thread;
+	leaseServing = 1;
+	mu_assert("can serve", pthread_create(&thread, NULL, serveLeases, s) == 0);
+
+	// two instances of a group on localhost
+	netman_session *a = netman_open(), *b = netman_open();
+	mu_assert("needs an aggregator", netman_set_aggregator(a, NULL, port, "job") == ERR_NULL);
+	mu_assert("first instance gets a slice", netman_set_aggregator(a, "127.0.0.1", port, "job") == 0);
+	mu_assert("second instance gets a slice", netman_set_aggregator(b, "localhost", port, "job") == 0);
+	mu_assert("a slice is granted up front", a->lease->granted >= LEASE_MIN_SLICE && !a->lease->final);
+
+	// slices are renewed before they run out, far from the budget nothing is a limit
+	for(int i = 0; i < 8; i++) {
+		session_count(a, LEASE_MIN_SLICE / 2);
+		session_count(b, LEASE_MIN_SLICE / 2);
+		usleep(3 * LEASE_REPORT_MSEC * 1000);
+	}
+	mu_assert("early slices aren't limits", !netman_limit_reached(a) && !netman_limit_reached(b));
+	mu_assert("the group's bytes are reported", netman_group_bytes(a, NULL) > 4 * LEASE_MIN_SLICE);
+
+	// the last slices split what is left, each instance stops at its own
+	for(int i = 0; i < 500 && !(netman_limit_reached(a) && netman_limit_reached(b)); i++) {
+		if(!netman_limit_reached(a)) session_count(a, 65536);
+		if(!netman_limit_reached(b)) session_count(b, 65536);
+		usleep(10000);
+	}
+	mu_assert("the group's budget stops both instances", netman_limit_reached(a) && netman_limit_reached(b));
+	u_int64_t used = netman_bytes(a) + netman_bytes(b);
+	mu_assert("the instances stop near the budget", used >= budget && used <= budget + 2 * 65536);
+	netman_close(a);
+	netman_close(b);
+
+	netman_session *c = netman_open();
+	mu_assert("a used up group refuses new instances", netman_set_aggregator(c, "127.0.0.1", port, "job") == ERR_QUOTA);
+	mu_assert("other groups have their own budget", netman_set_aggregator(c, "127.0.0.1", port, "other") == 0);
+	netman_session *d = netman_open();
+	mu_assert("another instance of that group", netman_set_aggregator(d, "127.0.0.1", port, "other") == 0);
+
+	// without the aggregator no renewal comes, traffic stops at the slice while the lease still holds
+	__atomic_store_n(&leaseServing, 0, __ATOMIC_RELEASE);
+	pthread_join(thread, NULL);
+	u_int64_t granted = d->lease->granted;
+	for(u_int64_t sent = 0; sent < 2 * granted && !netman_limit_reached(d); sent += 65536) {
+		session_count(d, 65536);
+		usleep(1000);
+	}
+	mu_assert("a slice that isn't renewed is a limit", netman_limit_reached(d) && !d->lease->final);
+	mu_assert("it stops at what was granted", netman_bytes(d) >= granted && netman_bytes(d) < granted + 65536);
+	netman_close(d);
+
+	// and once the lease runs out the slice still is
+	usleep(700 * 1000);
+	mu_assert("a lost lease keeps what was granted", c->lease->final && !netman_limit_reached(c));
+	session_count(c, c->lease->granted);
+	mu_assert("a lost lease stops at its slice", netman_limit_reached(c));
+	netman_close(c);
+
+	// releases are counted once they arrive
+	lease_server_serve(s, 100);
+	mu_assert("the aggregator counted every instance", lease_server_total(s, "job") == used);
+	lease_server_free(s);
+	return 0;
+}
+
+static char *watch_tests() {
+	mu_assert("a delta is the difference", watch_delta(1000, 1500) == 500);
+	mu_assert("64 bit counters stay exact", watch_delta(1ull << 40, (1ull << 40) + 1) == 1);
+	mu_assert("a reset counter moved what it holds", watch_delta(5000, 20) == 20);
+	mu_assert("a rate is per second", watch_rate(500, 500000000) == 1000);
+	mu_assert("a rate of no time is 0", watch_rate(500, 0) == 0);
+	mu_assert("large rates don't overflow", watch_rate(1ull << 62, 1000000000ull * 4) == 1ull << 60);
+
+	struct tableMessage msgs[3];
+	tableMessage(&msgs[0], "en0", 4, 100, 10);
+	tableMessage(&msgs[1], "en1", 5, 1ull << 33, 0);
+	tableMessage(&msgs[2], "lo0", 1, 7, 7);
+	struct iftable *t = iftable_create();
+	struct watch *w = watch_create();
+	mu_assert("can create a watch", t != NULL && w != NULL);
+	iftable_load(t, (char *) msgs, 2 * sizeof(struct tableMessage));
+	mu_assert("follows every interface", watch_update_table(w, t, 1000) == 2);
+	mu_assert("the first sample moved nothing", w->counters[0].idelta == 0 && w->intervalNsec == 0);
+	msgs[0].ifm.ifm_data.ifi_ibytes += 300;
+	msgs[0].ifm.ifm_data.ifi_obytes += 100;
+	msgs[1].ifm.ifm_data.ifi_ibytes += 1ull << 32;
+	iftable_load(t, (char *) msgs, sizeof(msgs));
+	mu_assert("new interfaces are followed", watch_update_table(w, t, 1000 + 2000000000ull) == 3);
+	mu_assert("deltas are since the last sample", w->counters[0].idelta == 300 && w->counters[0].odelta == 100);
+	mu_assert("deltas past 32 bits are exact", w->counters[1].idelta == 1ull << 32);
+	mu_assert("a new interface starts from its counters", w->counters[2].seen && w->counters[2].idelta == 0);
+	mu_assert("the interval is kept", w->intervalNsec == 2000000000ull);
+	iftable_load(t, (char *) &msgs[1], sizeof(struct tableMessage));
+	mu_assert("an interface missing from a sample moved nothing",
+		watch_update_table(w, t, 3000000000ull) == 3 && !w->counters[0].seen && w->counters[0].idelta == 0);
+	watch_free(w);
+
+	w = watch_create();
+	mu_assert("can watch one interface", watch_add(w, "en1") == 0 && watch_add(w, "en1") == 0);
+	iftable_load(t, (char *) msgs, sizeof(msgs));
+	mu_assert("only added interfaces are followed", watch_update_table(w, t, 1000) == 1);
+	msgs[1].ifm.ifm_data.ifi_obytes = 42;
+	iftable_load(t, (char *) msgs, sizeof(msgs));
+	watch_update_table(w, t, 2000);
+	mu_assert("the added interface counts", w->counters[0].odelta == 42);
+	iftable_free(t);
+	mu_soft_assert("can sample the interfaces", watch_sample(w) == 1);
+	watch_free(w);
+	return 0;
+}
+
+/**
+ * counts bytes on a capture after a pause, so a job is running when they arrive
+ */
+static void *countLater(void *arg) {
+	usleep(200 * 1000);
+	capture_count(arg, 1000);
+	return NULL;
+}
+
+static char *jobs_tests() {
+	char path[] = "/tmp/netman.jobs.XXXXXX";
+	int fd = mkstemp(path);
+	mu_assert("can create a job file", fd >= 0);
+	const char *file =
+		"# name  limit  rate  interfaces  command\n"
+		"quick   0      0     en0,en1     exit 3\n"
+		"\n"
+		"capped  500    0     en1         sleep 5\n"
+		"other   0      1000  all         true # not a comment\n";
+	mu_assert("can write a job file", write(fd, file, strlen(file)) == (ssize_t) strlen(file));
+	close(fd);
+
+	struct job *jobs = NULL;
+	int line = 0;
+	int count = jobs_load(path, &jobs, &line);
+	mu_assert("loads every job", count == 3 && line == 0);
+	mu_assert("jobs keep their fields", strcmp(jobs[1].name, "capped") == 0 && jobs[1].limit == 500 &&
+		strcmp(jobs[1].interfaces, "en1") == 0 && strcmp(jobs[1].command, "sleep 5") == 0);
+	mu_assert("all is every interface", jobs[2].interfaces == NULL && jobs[2].rate == 1000);
+	mu_assert("the command is the rest of the line", strcmp(jobs[2].command, "true # not a comment") == 0);
+
+	// one capture feeds every job counting its interface
+	netman_session *session = netman_open();
+	mu_assert("can add the jobs", jobs_add(session, jobs, count) == 0 && jobs[2].id == 2);
+	mu_assert("interfaces of a job are captured", netman_jobs_watch(session, "en1") && netman_jobs_watch(session, "lo0"));
+	struct capture *en0 = capture_create(session, "en0");
+	struct capture *en1 = capture_create(session, "en1");
+	mu_assert("captures know their jobs", en0->jobCount == 2 && en1->jobCount == 3);
+	capture_count(en0, 100);
+	mu_assert("stopped jobs count nothing", netman_job_bytes(session, 0) == 0);
+	netman_job_running(session, 0, true);
+	netman_job_running(session, 1, true);
+	capture_count(en0, 100);
+	capture_count(en1, 400);
+	mu_assert("jobs count their interfaces", netman_job_bytes(session, 0) == 500 && netman_job_bytes(session, 1) == 400);
+	mu_assert("the session counts everything once", netman_bytes(session) == 600);
+	mu_assert("below the limit isn't reached", !netman_job_reached(session, 1));
+	capture_count(en1, 100);
+	mu_assert("a job's limit is reached on its own", netman_job_reached(session, 1) && !netman_limit_reached(session));
+	capture_destroy(en0);
+	netman_close(session);
+
+	// a session limit past 32 bits, as in `--jobs=jobs.txt -l 8000000000`, still covers the jobs
+	u_int64_t limit = 0;
+	mu_assert("the limit parses", parseBytes("8000000000", &limit) == 0);
+	session = netman_open();
+	jobs_add(session, jobs, count);
+	mu_assert("can set the limit", netman_set_limit(session, limit) == 0);
+	en1 = capture_create(session, "en1");
+	netman_job_running(session, 2, true);
+	capture_count(en1, 5000000000ull);
+	mu_assert("below the limit isn't reached", !netman_limit_reached(session) && netman_job_bytes(session, 2) == 5000000000ull);
+	capture_count(en1, 3000000000ull);
+	mu_assert("the limit is reached past 32 bits", netman_limit_reached(session));
+	capture_destroy(en1);
+	netman_close(session);
+
+	// the capped job is killed at its limit, the others run to the end
+	session = netman_open();
+	jobs_add(session, jobs, count);
+	en1 = capture_create(session, "en1");
+	pthread_t thread;
+	pthread_create(&thread, NULL, countLater, en1);
+	u_int64_t start = monotonicNsec();
+	mu_assert("can run the jobs", jobs_run(session, jobs, count, 2) == 0);
+	pthread_join(thread, NULL);
+	mu_assert("a job that exits is done", jobs[0].state == JOB_DONE && WEXITSTATUS(jobs[0].status) == 3);
+	mu_assert("a job over its limit is killed", jobs[1].state == JOB_KILLED && monotonicNsec() - start < 4000000000ull);
+	mu_assert("a waiting job starts once another ends", jobs[2].state == JOB_DONE);
+	capture_destroy(en1);
+	netman_close(session);
+
+	jobs_free(jobs, count);
+	file = "broken 10 x en0 true\n";
+	fd = open(path, O_WRONLY | O_TRUNC);
+	mu_assert("can rewrite the job file", write(fd, file, strlen(file)) == (ssize_t) strlen(file));
+	close(fd);
+	mu_assert("a bad line is an error", jobs_load(path, &jobs, &line) == ERR_OPTIONS && line == 1);
+	unlink(path);
+	mu_assert("a missing file is an error", jobs_load(path, &jobs, &line) == ERR_OPEN);
+	return 0;
+}
+
+/**
+ * stands in for a capture thread: waits to be stopped, then takes the
+ * session's mutex as a capture thread reporting its stats would
+ */
+static void *waitForStop(void *arg) {
+	struct capture *c = arg;
+	while(!__atomic_load_n(&c->stop, __ATOMIC_ACQUIRE)) usleep(1000);
+	pthread_mutex_lock(&c->session->mutex);
+	pthread_mutex_unlock(&c->session->mutex);
+	__atomic_store_n(&c->running, 0, __ATOMIC_RELEASE);
+	return NULL;
+}
+
+static char *close_tests() {
+	// an empty descriptor wakes a spinning read so the thread can see `stop`
+	int fds[2], enable = 1;
+	mu_assert("can open a pipe", pipe(fds) == 0 && ioctl(fds[0], FIONBIO, &enable) == 0);
+	char buf[8];
+	u_int64_t start = monotonicNsec();
+	mu_assert("an idle read wakes empty", spin_read(fds[0], buf, sizeof(buf), 10) == 0);
+	mu_assert("after the wake interval", monotonicNsec() - start >= CAPTURE_WAKE_MSEC * 900000ull);
+	close(fds[0]);
+	close(fds[1]);
+
+	// closing stops the threads, and joins them without holding the session's mutex
+	netman_session *session = netman_open();
+	struct capture *c = capture_create(session, "test0");
+	mu_assert("can create a capture", c != NULL);
+	session->captures = calloc(1, sizeof(struct capture *));
+	session->captures[0] = c;
+	session->captureCount = session->captureCap = 1;
+	c->running = 1;
+	mu_assert("can start a thread", pthread_create(&c->thread, NULL, waitForStop, c) == 0);
+	mu_assert("the thread runs until stopped", netman_capture_count(session) == 1);
+	netman_close(session);
+	return 0;
+}
+
 static char *monitor_tests() {
 	int aval = (int) monitor(NULL);
 	printf("aval %d\n", aval);
 	mu_assert("can't monitor NULL interface",  aval == ERR_NULL );
-	mu_soft_assert("can't monitor bad interface", (int) monitor("abcd") < 0);
-	pthread_t thread;
-	int ret_status = pthread_create(&thread, NULL, monitor, (void *) interfaceToTest);
+
+	netman_session *session = netman_open();
+	mu_assert("can open a session", session != NULL);
+	mu_assert("can't capture NULL interface", netman_capture(session, NULL, 0) == ERR_NULL);
+	mu_soft_assert("can start capturing a bad interface", netman_capture(session, "abcd", 0) == 0);
+	sleep(1);
+	mu_soft_assert("can't monitor bad interface", netman_capture_count(session) == 0);
+
+	u_int64_t limitBytes = 0;
+	netman_set_limit(session, 1000);
+	netman_on_limit(session, onLimit, &limitBytes);
+	int ret_status = netman_capture(session, interfaceToTest, 0);
 	mu_soft_assert("can't create pthread", ret_status == 0);
-	pthread_mutex_lock(&thread_mutex);
-    threads[0] = thread;
-    pthread_mutex_unlock(&thread_mutex);
-    mu_soft_assert("thread should exist for monitor", threadCount() > 0);
+    mu_soft_assert("thread should exist for monitor", netman_capture_count(session) > 0);
     pid_t p = runCmd("ping google.com -c 5");
     mu_assert("cmd is not null",  p > 0);
     int status = 0; 
     waitpid(p, &status, 0);
-    mu_soft_assert("thread should exist for monitor, are you sudo?", threadCount() > 0);
+    mu_soft_assert("thread should exist for monitor, are you sudo?", netman_capture_count(session) > 0);
     sleep(1);
-    mu_soft_assert("some data should have been happening, are you sudo?", bytesRead > 0);
-	pthread_cancel(thread);
+    mu_soft_assert("some data should have been happening, are you sudo?", netman_bytes(session) > 0);
+    mu_soft_assert("limit should have been reached, are you sudo?", netman_limit_reached(session));
+    mu_soft_assert("limit callback should have fired, are you sudo?", limitBytes >= 1000);
+
+	struct netman_capture_stats stats[2];
+	mu_assert("stats need somewhere to go", netman_stats(session, NULL, 2) == ERR_NULL);
+	int n = netman_stats(session, stats, 2);
+	mu_assert("stats has an entry per capture", n >= 0 && n <= 2);
+	for(int i = 0; i < n; i++) {
+		mu_assert("stats are named", strlen(stats[i].name) > 0);
+		mu_assert("captures have been running", stats[i].wallNsec > 0);
+		mu_assert("processing is timed with the reads", stats[i].batches > 0 || stats[i].processNsec == 0);
+	}
+	netman_close(session);
+	return 0;
+}
+
+static char *buffer_tests() {
+	netman_session *session = netman_open();
+	mu_assert("can set the buffer max", netman_set_buffer_max(session, 1024 * 1024) == 0);
+	struct capture *c = capture_create(session, "test0");
+	mu_assert("can create a capture", c != NULL && c->bufferMax == 1024 * 1024);
+
+	mu_assert("the default buffer doubles", next_buffer_len(c, 0, 32768) == 65536);
+	mu_assert("a granted buffer doubles", next_buffer_len(c, 65536, 65536) == 131072);
+	mu_assert("doubling stops at the max", next_buffer_len(c, 0, 768 * 1024) == 1024 * 1024);
+	mu_assert("a full buffer can't grow", next_buffer_len(c, 1024 * 1024, 1024 * 1024) == 0);
+
+	// the kernel's maximum is below --buffer-max, found once a reopen is clamped
+	mu_assert("a clamped buffer can't grow", next_buffer_len(c, 262144, 131072) == 0);
+	mu_assert("the clamp is the capture's max", c->bufferMax == 131072 && session->bufferMax == 1024 * 1024);
+	mu_assert("no reopening past it", next_buffer_len(c, 0, 131072) == 0);
+	mu_assert("an unknown length can't grow", next_buffer_len(c, 0, 0) == 0);
+	capture_destroy(c);
+	netman_close(session);
+	return 0;
+}
+
+static char *parse_tests() {
+	u_int64_t bytes = 0;
+	mu_assert("parses a count", parseBytes("1000", &bytes) == 0 && bytes == 1000);
+	mu_assert("parses past 32 bits", parseBytes("50000000000", &bytes) == 0 && bytes == 50000000000ull);
+	mu_assert("rejects a negative count", parseBytes("-1", &bytes) == ERR_OPTIONS);
+	mu_assert("rejects an overflowing count", parseBytes("99999999999999999999", &bytes) == ERR_OPTIONS);
+	mu_assert("rejects trailing text", parseBytes("12k", &bytes) == ERR_OPTIONS);
+	mu_assert("rejects nothing", parseBytes("", &bytes) == ERR_OPTIONS);
+	mu_assert("rejects a sign", parseBytes("+5", &bytes) == ERR_OPTIONS);
+	mu_assert("left alone on errors", bytes == 50000000000ull);
 	return 0;
 }
 
 static char * cmd_tests() {
 	mu_assert("cmd is null", runCmd(NULL) == 0);
 	mu_assert("cmd is not null", runCmd("sleep 1") > 0);
+
+	pid_t p = runCmd("true");
+	mu_assert("cmd is not null", p > 0);
+	int kq = watchCmd(p);
+	mu_soft_assert("can watch the command", kq >= 0);
+	mu_assert("cmd should exit", cmdExited(kq, p, NULL));
+	if(kq >= 0) close(kq);
+
+	// still running, then exited, with the exit noticed by a later call
+	struct timespec none = {0, 0};
+	p = runCmd("sleep 1");
+	kq = watchCmd(p);
+	mu_assert("cmd is still running", !cmdExited(kq, p, &none));
+	sleep(2);
+	mu_assert("cmd should have exited", cmdExited(kq, p, &none));
+	if(kq >= 0) close(kq);
+
+	// exiting before it is watched leaves no event to wait for
+	p = runCmd("true");
+	sleep(1);
+	kq = watchCmd(p);
+	mu_assert("cmd exited before it was watched", cmdExited(kq, p, NULL));
+	if(kq >= 0) close(kq);
+	mu_assert("an empty group needs no killing", killGroup(p) == 0);
+
+	// a reaped command's group can outlive it, and is killed without its pid
+	p = runCmd("sleep 30 & exit 0");
+	mu_assert("cmd is not null", p > 0);
+	kq = watchCmd(p);
+	mu_assert("the shell exits", cmdExited(kq, p, NULL));
+	if(kq >= 0) close(kq);
+	mu_assert("can kill what the command left", killGroup(p) == 0);
+	sleep(1);
+	mu_soft_assert("what the command left should be gone", kill(-p, 0) < 0 && errno == ESRCH);
+
+	p = runCmd("sleep 30 | sleep 30");
+	mu_assert("pipeline is not null", p > 0);
+	sleep(1);
+	mu_assert("pipeline leads its own group", getpgid(p) == p);
+	mu_assert("can kill the pipeline", killCmd(p) == 0);
+	sleep(1);
+	mu_assert("whole pipeline should be gone", kill(-p, 0) < 0 && errno == ESRCH);
 	return 0;
 }
 
@@ -108,7 +1212,26 @@ static char *all_tests() {
 	mu_run_test(list_tests);
 	mu_run_test(cmd_tests);
 	mu_run_test(interface_tests);
+	mu_run_test(iftable_tests);
+	mu_run_test(netstats_tests);
+	mu_run_test(histogram_tests);
+	mu_run_test(history_tests);
+	mu_run_test(sketch_tests);
+	mu_run_test(prefix_tests);
+	mu_run_test(dedup_tests);
+	mu_run_test(procsock_tests);
+	mu_run_test(parse_tests);
+	mu_run_test(sample_tests);
+	mu_run_test(direction_tests);
+	mu_run_test(busy_poll_tests);
+	mu_run_test(buffer_tests);
+	mu_run_test(pipeline_tests);
+	mu_run_test(quota_tests);
+	mu_run_test(lease_tests);
+	mu_run_test(jobs_tests);
+	mu_run_test(watch_tests);
 	mu_run_test(monitor_tests);
+	mu_run_test(close_tests);
 	return 0;
 }
 
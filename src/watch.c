@@ -0,0 +1,116 @@
+#include "general.h"
+#include "watch.h"
+
+/**
+ * - returns: a watch following every interface, narrow it with `watch_add`, or NULL
+ */
+struct watch *watch_create(void) {
+	struct watch *w = calloc(1, sizeof(struct watch));
+	if(!w) return NULL;
+	w->all = true;
+	return w;
+}
+
+/**
+ * - parameter w: watch from `watch_create`
+ */
+void watch_free(struct watch *w) {
+	if(!w) return;
+	free(w->counters);
+	iftable_free(w->table);
+	free(w);
+}
+
+/**
+ * - returns: the counter for an interface, otherwise -1
+ */
+static int findCounter(struct watch *w, const char *name) {
+	for(int i = 0; i < w->count; i++) {
+		if(strncmp(w->counters[i].name, name, IFNAMSIZ) == 0) return i;
+	}
+	return -1;
+}
+
+/**
+ * - returns: a new counter for an interface, otherwise ERR_ALLOC
+ */
+static int addCounter(struct watch *w, const char *name) {
+	if(w->count == w->cap) {
+		int cap = w->cap ? w->cap * 2 : 16;
+		struct watch_counter *tmp = realloc(w->counters, cap * sizeof(struct watch_counter));
+		if(!tmp) return ERR_ALLOC;
+		w->counters = tmp;
+		w->cap = cap;
+	}
+	struct watch_counter *c = &w->counters[w->count];
+	memset(c, 0, sizeof(struct watch_counter));
+	strlcpy(c->name, name, sizeof(c->name));
+	return w->count++;
+}
+
+/**
+ * Follows only the interfaces added, instead of every one
+ * - parameter name: name of the interface
+ * - returns: 0 on success, otherwise error
+ */
+int watch_add(struct watch *w, const char *name) {
+	if(!w || !name) return ERR_NULL;
+	if(w->all) {
+		w->all = false;
+		w->count = 0;
+	}
+	if(findCounter(w, name) >= 0) return 0;
+	int res = addCounter(w, name);
+	return res < 0 ? res : 0;
+}
+
+/**
+ * Takes a sample, setting each counter's deltas since the last one
+ * An interface missing from the sample moved nothing, one seen for the
+ * first time starts from its counters and moved nothing yet
+ * - parameter t: the interfaces' current counters
+ * - parameter now: monotonic nanoseconds of the sample
+ * - returns: the number of counters, otherwise error
+ */
+int watch_update_table(struct watch *w, const struct iftable *t, u_int64_t now) {
+	if(!w || !t) return ERR_NULL;
+
+	for(int i = 0; i < w->count; i++) {
+		w->counters[i].idelta = w->counters[i].odelta = 0;
+		w->counters[i].seen = false;
+	}
+
+	for(int i = 0; i < t->count; i++) {
+		int slot = findCounter(w, t->names[i]);
+		int fresh = slot < 0;
+		if(fresh && !w->all) continue;
+		if(fresh && (slot = addCounter(w, t->names[i])) < 0) return slot;
+
+		struct watch_counter *c = &w->counters[slot];
+		if(c->known) {
+			c->idelta = watch_delta(c->ibytes, t->ibytes[i]);
+			c->odelta = watch_delta(c->obytes, t->obytes[i]);
+		}
+		c->ibytes = t->ibytes[i];
+		c->obytes = t->obytes[i];
+		c->known = c->seen = true;
+	}
+
+	w->intervalNsec = w->lastNsec ? now - w->lastNsec : 0;
+	w->lastNsec = now;
+	return w->count;
+}
+
+/**
+ * Refreshes the watch's interface table in place and takes a sample,
+ * so a steady set of interfaces costs one sysctl and no allocations
+ * - returns: the number of counters, otherwise error
+ */
+int watch_sample(struct watch *w) {
+	if(!w) return ERR_NULL;
+	if(!w->table && !(w->table = iftable_create())) return ERR_ALLOC;
+
+	int res = iftable_refresh(w->table);
+	if(res < 0) return res;
+	return watch_update_table(w, w->table, monotonicNsec());
+}